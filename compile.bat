@@ -1,3 +1,5 @@
 C:/VulkanSDK/1.3.236.0/Bin/glslc.exe shader.vert -o vert.spv
 C:/VulkanSDK/1.3.236.0/Bin/glslc.exe shader.frag -o frag.spv
+C:/VulkanSDK/1.3.236.0/Bin/glslc.exe buddhabrot.comp -o buddhabrot.spv
+C:/VulkanSDK/1.3.236.0/Bin/glslc.exe tonemap.comp -o tonemap.spv
 pause
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+// -----------------------------------------------------------------------------
+// Command line values of the demos and benches. The whole of text must be the
+// number, std::stoull and std::stod alone stop at the first character they
+// cannot read and std::stoull wraps a minus sign around. Bad values throw
+// std::runtime_error naming flag
+// -----------------------------------------------------------------------------
+inline uint64_t ParseUnsigned( const std::string &flag, const std::string &text )
+{
+    size_t end = 0;
+    uint64_t value = 0;
+    try
+    {
+        value = std::stoull( text, &end );
+    }
+    catch ( const std::logic_error & )
+    {
+    }
+    if ( end == 0 || end != text.size() || text.find( '-' ) != std::string::npos )
+    {
+        throw std::runtime_error( "invalid " + flag + " " + text + "!" );
+    }
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+inline double ParseDouble( const std::string &flag, const std::string &text )
+{
+    size_t end = 0;
+    double value = 0.0;
+    try
+    {
+        value = std::stod( text, &end );
+    }
+    catch ( const std::logic_error & )
+    {
+    }
+    if ( end == 0 || end != text.size() || !std::isfinite( value ) )
+    {
+        throw std::runtime_error( "invalid " + flag + " " + text + "!" );
+    }
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// ParseDouble of a value that cannot be negative
+// -----------------------------------------------------------------------------
+inline double ParseNonNegative( const std::string &flag, const std::string &text )
+{
+    const double value = ParseDouble( flag, text );
+    if ( value < 0.0 )
+    {
+        throw std::runtime_error( "invalid " + flag + " " + text + "!" );
+    }
+    return value;
+}
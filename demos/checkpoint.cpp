@@ -0,0 +1,541 @@
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <thread>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "checkpoint.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhMappedFile::~nhMappedFile()
+{
+    Close();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Create( const std::string &path, uint64_t size )
+{
+    Map( path, size, true, true );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Open( const std::string &path, bool writable )
+{
+    Map( path, 0, writable, false );
+}
+
+#if defined(_WIN32)
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Map( const std::string &path, uint64_t size, bool writable, bool resize )
+{
+    Close();
+
+    DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+    HANDLE file = CreateFileA( path.c_str(), access, FILE_SHARE_READ, nullptr,
+                               resize ? OPEN_ALWAYS : OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        throw std::runtime_error( "failed to open " + path + "!" );
+    }
+    p_file = file;
+
+    LARGE_INTEGER fileSize{};
+    if ( resize )
+    {
+        fileSize.QuadPart = static_cast<LONGLONG>(size);
+        if ( !SetFilePointerEx( file, fileSize, nullptr, FILE_BEGIN ) || !SetEndOfFile( file ) )
+        {
+            Close();
+            throw std::runtime_error( "failed to resize " + path + "!" );
+        }
+    }
+    else if ( !GetFileSizeEx( file, &fileSize ) )
+    {
+        Close();
+        throw std::runtime_error( "failed to read the size of " + path + "!" );
+    }
+    p_size = static_cast<uint64_t>(fileSize.QuadPart);
+
+    if ( p_size == 0 )
+    {
+        Close();
+        throw std::runtime_error( path + " is empty!" );
+    }
+
+    p_mapping = CreateFileMappingA( file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                    0, 0, nullptr );
+    void *data = p_mapping ? MapViewOfFile( p_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                            0, 0, 0 )
+                           : nullptr;
+    if ( data == nullptr )
+    {
+        Close();
+        throw std::runtime_error( "failed to map " + path + "!" );
+    }
+    p_data = static_cast<unsigned char *>(data);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Close()
+{
+    if ( p_data != nullptr )
+    {
+        UnmapViewOfFile( p_data );
+    }
+    if ( p_mapping != nullptr )
+    {
+        CloseHandle( p_mapping );
+    }
+    if ( p_file != nullptr )
+    {
+        CloseHandle( p_file );
+    }
+    p_data = nullptr;
+    p_mapping = nullptr;
+    p_file = nullptr;
+    p_size = 0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Flush()
+{
+    // starts writing the dirty pages without waiting for the disk
+    if ( p_data != nullptr )
+    {
+        FlushViewOfFile( p_data, 0 );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Release( uint64_t, uint64_t ) const
+{
+    // clean pages of a mapped view are trimmed from the working set by the
+    // memory manager, there is no per range hint worth the call
+}
+
+#else
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Map( const std::string &path, uint64_t size, bool writable, bool resize )
+{
+    Close();
+
+    int flags = writable ? O_RDWR : O_RDONLY;
+    p_file = ::open( path.c_str(), resize ? flags | O_CREAT : flags, 0644 );
+    if ( p_file < 0 )
+    {
+        throw std::runtime_error( "failed to open " + path + "!" );
+    }
+
+    if ( resize )
+    {
+        if ( ::ftruncate( p_file, static_cast<off_t>(size) ) != 0 )
+        {
+            Close();
+            throw std::runtime_error( "failed to resize " + path + "!" );
+        }
+        p_size = size;
+    }
+    else
+    {
+        struct stat info{};
+        if ( ::fstat( p_file, &info ) != 0 )
+        {
+            Close();
+            throw std::runtime_error( "failed to read the size of " + path + "!" );
+        }
+        p_size = static_cast<uint64_t>(info.st_size);
+    }
+
+    if ( p_size == 0 )
+    {
+        Close();
+        throw std::runtime_error( path + " is empty!" );
+    }
+
+    void *data = ::mmap( nullptr, p_size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                         MAP_SHARED, p_file, 0 );
+    if ( data == MAP_FAILED )
+    {
+        Close();
+        throw std::runtime_error( "failed to map " + path + "!" );
+    }
+    p_data = static_cast<unsigned char *>(data);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Close()
+{
+    if ( p_data != nullptr )
+    {
+        ::munmap( p_data, p_size );
+    }
+    if ( p_file >= 0 )
+    {
+        ::close( p_file );
+    }
+    p_data = nullptr;
+    p_file = -1;
+    p_size = 0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Flush()
+{
+    // starts writing the dirty pages without waiting for the disk
+    if ( p_data != nullptr )
+    {
+        ::msync( p_data, p_size, MS_ASYNC );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhMappedFile::Release( uint64_t offset, uint64_t size ) const
+{
+    // only whole pages inside the range, a page shared with a neighbouring
+    // range may still be in use
+    static const uint64_t PAGE = static_cast<uint64_t>(::sysconf( _SC_PAGESIZE ));
+    uint64_t first = (offset + PAGE - 1) / PAGE * PAGE;
+    uint64_t last = std::min( offset + size, p_size ) / PAGE * PAGE;
+    if ( p_data != nullptr && first < last )
+    {
+        ::madvise( p_data + first, last - first, MADV_DONTNEED );
+    }
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static bool SameRender( const nhCheckpoint::Header &a, const nhCheckpoint::Header &b )
+{
+    return std::equal( std::begin( a.viewport ), std::end( a.viewport ), std::begin( b.viewport ) ) &&
+           a.resolution[0] == b.resolution[0] && a.resolution[1] == b.resolution[1] &&
+           a.minIter == b.minIter && a.maxIter == b.maxIter &&
+           a.sampler == b.sampler && a.bandCount == b.bandCount &&
+           std::memcmp( a.bands, b.bands, sizeof( a.bands ) ) == 0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint32_t nhCheckpoint::CountBytes( const Header &header )
+{
+    return (header.flags & WIDE_COUNTS) ? sizeof( uint64_t ) : sizeof( uint32_t );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhCheckpoint::HistogramOffset( const Header &header )
+{
+    uint64_t end = sizeof( Header ) + uint64_t( header.workerCount ) * sizeof( WorkerRecord );
+    return (end + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhCheckpoint::HistogramStride( const Header &header )
+{
+    uint64_t bytes = uint64_t( header.bandCount ) * header.resolution[0] * header.resolution[1] *
+                     CountBytes( header );
+    return (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhCheckpoint::FileSize( const Header &header )
+{
+    return HistogramOffset( header ) + header.workerCount * HistogramStride( header );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhCheckpoint::Validate( const std::string &path ) const
+{
+    Header expected;
+    const Header *header = reinterpret_cast<const Header *>(p_file.Data());
+    if ( p_file.Size() < sizeof( Header ) ||
+         std::memcmp( header->magic, expected.magic, sizeof( expected.magic ) ) != 0 )
+    {
+        throw std::runtime_error( path + " is not a nebulabrot checkpoint!" );
+    }
+    if ( header->version != VERSION || header->headerSize != sizeof( Header ) )
+    {
+        throw std::runtime_error( path + " has unsupported checkpoint version " +
+                                  std::to_string( header->version ) + "!" );
+    }
+    if ( header->bandCount == 0 || header->bandCount > MAX_BANDS ||
+         header->resolution[0] <= 0 || header->resolution[1] <= 0 ||
+         p_file.Size() < FileSize( *header ) )
+    {
+        throw std::runtime_error( path + " is truncated or corrupt!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhCheckpoint::Open( const std::string &path, const Header &layout )
+{
+    p_resumed = std::ifstream( path, std::ios::binary ).good();
+
+    if ( !p_resumed )
+    {
+        Create( path, layout );
+        return;
+    }
+
+    p_file.Open( path, true );
+    Validate( path );
+
+    const Header &header = GetHeader();
+    if ( !SameRender( header, layout ) )
+    {
+        throw std::runtime_error( path + " holds a different render!" );
+    }
+    if ( header.flags & MERGED )
+    {
+        throw std::runtime_error( path + " is merged and can only be merged again!" );
+    }
+    if ( (header.flags & WIDE_COUNTS) != (layout.flags & WIDE_COUNTS) )
+    {
+        throw std::runtime_error( path + " holds " + std::to_string( 8 * CountBytes( header ) ) +
+                                  " bit counts!" );
+    }
+    if ( header.seed != layout.seed || header.workerCount != layout.workerCount )
+    {
+        throw std::runtime_error( path + " was written with seed " + std::to_string( header.seed ) +
+                                  " by " + std::to_string( header.workerCount ) +
+                                  " workers, resume it with the same!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// A fresh file reads as zeros: empty histograms and records
+// -----------------------------------------------------------------------------
+void nhCheckpoint::Create( const std::string &path, const Header &layout )
+{
+    p_resumed = false;
+    p_file.Create( path, FileSize( layout ) );
+    std::memcpy( p_file.Data(), &layout, sizeof( Header ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhCheckpoint::OpenReadOnly( const std::string &path )
+{
+    p_resumed = false;
+    p_file.Open( path, false );
+    Validate( path );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhCheckpoint::WorkerRecord &nhCheckpoint::Worker( uint32_t worker ) const
+{
+    return reinterpret_cast<WorkerRecord *>(p_file.Data() + sizeof( Header ))[worker];
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint32_t *nhCheckpoint::Histogram( uint32_t worker ) const
+{
+    assert( CountBytes() == sizeof( uint32_t ) );
+    return reinterpret_cast<uint32_t *>(Counts( worker ));
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+unsigned char *nhCheckpoint::Counts( uint32_t worker ) const
+{
+    const Header &header = GetHeader();
+    return p_file.Data() + HistogramOffset( header ) + worker * HistogramStride( header );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhCheckpoint::OrbitCount() const
+{
+    uint64_t orbits = 0;
+    for ( uint32_t ii = 0; ii < GetHeader().workerCount; ++ii )
+    {
+        orbits += Worker( ii ).orbits;
+    }
+    return orbits;
+}
+
+// -----------------------------------------------------------------------------
+// Adds count counts of width CountBytes to sum, clamping at 2^64 - 1. Returns
+// the number of clamped sums
+// -----------------------------------------------------------------------------
+template <class Count>
+static uint64_t AddSaturated( uint64_t *sum, const unsigned char *counts, size_t count )
+{
+    uint64_t saturated = 0;
+    const Count *source = reinterpret_cast<const Count *>(counts);
+    for ( size_t ii = 0; ii < count; ++ii )
+    {
+        uint64_t total = sum[ii] + source[ii];
+        saturated += total < sum[ii] ? 1 : 0;
+        sum[ii] = total < sum[ii] ? std::numeric_limits<uint64_t>::max() : total;
+    }
+    return saturated;
+}
+
+// -----------------------------------------------------------------------------
+// Blocks never straddle two bands, so each one adds to the maximum of a
+// single band. Workers pull blocks from a shared counter, the output is
+// written through its mapping and left to the OS to write back.
+// -----------------------------------------------------------------------------
+nhCheckpoint::MergeStats nhCheckpoint::Merge( const std::vector<std::string> &inputs,
+                                              const std::string &output,
+                                              unsigned threads )
+{
+    if ( inputs.empty() )
+    {
+        throw std::runtime_error( "nothing to merge!" );
+    }
+
+    std::vector<nhCheckpoint> sources( inputs.size() );
+    for ( size_t ii = 0; ii < inputs.size(); ++ii )
+    {
+        // the output is resized and zeroed before the inputs are read. Files
+        // are compared, not names, so ./a, a and hard links of a all match.
+        // A missing output is a fresh file and matches nothing
+        std::error_code error;
+        if ( std::filesystem::equivalent( inputs[ii], output, error ) )
+        {
+            throw std::runtime_error( "cannot merge " + output + " into itself!" );
+        }
+
+        sources[ii].OpenReadOnly( inputs[ii] );
+        const Header &header = sources[ii].GetHeader();
+        for ( size_t jj = 0; jj < ii; ++jj )
+        {
+            const Header &other = sources[jj].GetHeader();
+            if ( !SameRender( header, other ) )
+            {
+                throw std::runtime_error( inputs[ii] + " and " + inputs[jj] + " hold different renders!" );
+            }
+
+            // the same seed draws the same orbits, summing would count them twice
+            if ( !(header.flags & MERGED) && !(other.flags & MERGED) && header.seed == other.seed )
+            {
+                throw std::runtime_error( inputs[ii] + " and " + inputs[jj] + " share seed " +
+                                          std::to_string( header.seed ) + "!" );
+            }
+        }
+    }
+
+    Header layout = sources[0].GetHeader();
+    layout.seed = 0;
+    layout.workerCount = 1;
+    layout.flags = MERGED | WIDE_COUNTS;
+
+    nhCheckpoint merged;
+    merged.Create( output, layout );
+    std::memset( &merged.Worker( 0 ), 0, sizeof( WorkerRecord ) );
+
+    MergeStats stats;
+    WorkerRecord &record = merged.Worker( 0 );
+    for ( const nhCheckpoint &source : sources )
+    {
+        for ( uint32_t worker = 0; worker < source.GetHeader().workerCount; ++worker )
+        {
+            record.orbits += source.Worker( worker ).orbits;
+            record.candidates += source.Worker( worker ).candidates;
+        }
+    }
+    stats.orbits = record.orbits;
+    stats.candidates = record.candidates;
+
+    const size_t bandSize = size_t( layout.resolution[0] ) * layout.resolution[1];
+    const size_t bandBlocks = (bandSize + MERGE_BLOCK - 1) / MERGE_BLOCK;
+    const size_t blockCount = bandBlocks * layout.bandCount;
+    uint64_t *sum = reinterpret_cast<uint64_t *>(merged.Counts( 0 ));
+
+    if ( threads == 0 )
+    {
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+    threads = static_cast<unsigned>(std::min<size_t>( threads, blockCount ));
+
+    std::atomic<size_t> nextBlock{ 0 };
+    std::vector<MergeStats> workerStats( threads );
+    auto job = [&]( unsigned worker )
+    {
+        MergeStats &local = workerStats[worker];
+        size_t block;
+        while ( (block = nextBlock.fetch_add( 1 )) < blockCount )
+        {
+            const uint32_t band = static_cast<uint32_t>(block / bandBlocks);
+            const size_t first = band * bandSize + (block % bandBlocks) * MERGE_BLOCK;
+            const size_t count = std::min( MERGE_BLOCK, (band + 1) * bandSize - first );
+
+            uint64_t *blockSum = sum + first;
+            std::fill( blockSum, blockSum + count, 0 );
+            for ( const nhCheckpoint &source : sources )
+            {
+                const uint32_t countBytes = source.CountBytes();
+                for ( uint32_t jj = 0; jj < source.GetHeader().workerCount; ++jj )
+                {
+                    const unsigned char *counts = source.Counts( jj ) + first * countBytes;
+                    local.saturated += countBytes == sizeof( uint64_t )
+                                       ? AddSaturated<uint64_t>( blockSum, counts, count )
+                                       : AddSaturated<uint32_t>( blockSum, counts, count );
+                    source.p_file.Release( counts - source.p_file.Data(), count * countBytes );
+                }
+            }
+
+            uint64_t &maxHits = local.maxHits[band];
+            maxHits = std::max( maxHits, *std::max_element( blockSum, blockSum + count ) );
+        }
+    };
+
+    std::vector<std::thread> jobs;
+    for ( unsigned worker = 1; worker < threads; ++worker )
+    {
+        jobs.emplace_back( job, worker );
+    }
+    job( 0 );
+    for ( auto &thread : jobs )
+    {
+        thread.join();
+    }
+
+    for ( const MergeStats &local : workerStats )
+    {
+        stats.saturated += local.saturated;
+        for ( uint32_t band = 0; band < layout.bandCount; ++band )
+        {
+            stats.maxHits[band] = std::max( stats.maxHits[band], local.maxHits[band] );
+        }
+    }
+
+    merged.Flush();
+    return stats;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// -----------------------------------------------------------------------------
+// Read-write or read only mapping of a whole file. Writes through Data() land
+// in the page cache and are written back by the OS, Flush only schedules the
+// write back and never waits for it.
+// -----------------------------------------------------------------------------
+class nhMappedFile
+{
+public:
+
+    nhMappedFile() = default;
+    ~nhMappedFile();
+
+    nhMappedFile( const nhMappedFile & ) = delete;
+    nhMappedFile &operator=( const nhMappedFile & ) = delete;
+
+    // maps path read-write, creating it when missing and growing or
+    // shrinking it to size. Throws std::runtime_error on failure
+    void Create( const std::string &path, uint64_t size );
+
+    // maps an existing file at its current size
+    void Open( const std::string &path, bool writable );
+
+    void Close();
+    void Flush();
+
+    // drops the pages of [offset, offset + size) from this process once it
+    // is done reading them, they are read again if touched. Keeps a pass
+    // over a file larger than memory from pushing out everything else
+    void Release( uint64_t offset, uint64_t size ) const;
+
+    bool IsOpen() const { return p_data != nullptr; }
+    unsigned char *Data() const { return p_data; }
+    uint64_t Size() const { return p_size; }
+
+private:
+
+    void Map( const std::string &path, uint64_t size, bool writable, bool resize );
+
+    unsigned char *p_data = nullptr;
+    uint64_t       p_size = 0;
+
+#if defined(_WIN32)
+    void          *p_file = nullptr;
+    void          *p_mapping = nullptr;
+#else
+    int            p_file = -1;
+#endif
+};
+
+// -----------------------------------------------------------------------------
+// Nebulabrot accumulation file. A header describing the render is followed by
+// one record and one histogram per worker, so the workers deposit straight
+// into the mapping and a render killed at any point resumes from the last
+// orbit each worker finished. All values are in host byte order, little
+// endian on every platform built for.
+//
+//   Header
+//   WorkerRecord[workerCount]
+//   histogram[workerCount], each bandCount * resX * resY counts, uint32_t
+//                           or uint64_t with WIDE_COUNTS, starting on a
+//                           CACHE_LINE boundary
+// -----------------------------------------------------------------------------
+class nhCheckpoint
+{
+public:
+
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t MAX_BANDS = 8;
+    static constexpr size_t   CACHE_LINE = 64;
+
+    enum FLAGS : uint32_t
+    {
+        // sum of other files, their random streams are gone, so it can be
+        // merged again but not resumed
+        MERGED = 1,
+        // uint64_t counts, written by Merge, by --counter uint64 renders
+        // and by nhNebulabrot::WriteHistogram
+        WIDE_COUNTS = 2,
+    };
+
+    struct Header
+    {
+        char     magic[8] = { 'N', 'H', 'N', 'E', 'B', 'U', 'L', 'A' };
+        uint32_t version = VERSION;
+        uint32_t headerSize = sizeof( Header );
+        double   viewport[4] = {};          // xmin, xmax, ymin, ymax
+        int32_t  resolution[2] = {};
+        int32_t  minIter = 0;
+        int32_t  maxIter = 0;
+        uint32_t sampler = 0;
+        uint32_t bandCount = 0;
+        int32_t  bands[MAX_BANDS][2] = {};  // minIter, maxIter of each band
+        uint64_t seed = 0;
+        uint32_t workerCount = 0;
+        uint32_t flags = 0;
+    };
+
+    struct WorkerRecord
+    {
+        uint64_t orbits;        // orbits deposited into the histogram
+        uint64_t candidates;    // starting points drawn for them
+        uint64_t rng[4];        // generator state after the last orbit
+    };
+
+    static_assert( std::is_trivially_copyable<Header>::value, "header is copied as bytes" );
+    static_assert( std::is_trivially_copyable<WorkerRecord>::value, "record is copied as bytes" );
+
+    // maps path, resuming it when it exists and creating it for layout
+    // otherwise. An existing file must describe the same render as layout.
+    // Throws std::runtime_error on a mismatch or an unreadable file
+    void Open( const std::string &path, const Header &layout );
+
+    // maps a fresh file for layout, replacing any earlier one at path. The
+    // records and histograms read as zeros
+    void Create( const std::string &path, const Header &layout );
+
+    // maps an existing file, for instance to merge it
+    void OpenReadOnly( const std::string &path );
+
+    void Flush() { p_file.Flush(); }
+
+    // true when Open found an earlier run to continue
+    bool Resumed() const { return p_resumed; }
+
+    const Header &GetHeader() const { return *reinterpret_cast<const Header *>(p_file.Data()); }
+
+    WorkerRecord &Worker( uint32_t worker ) const;
+
+    // 4, or 8 with WIDE_COUNTS
+    uint32_t CountBytes() const { return CountBytes( GetHeader() ); }
+
+    // bandCount * resX * resY counts of worker, band after band. Narrow
+    // counts only, wide files are read through Counts
+    uint32_t *Histogram( uint32_t worker ) const;
+    unsigned char *Counts( uint32_t worker ) const;
+
+    // total orbits over the worker records
+    uint64_t OrbitCount() const;
+
+    struct MergeStats
+    {
+        uint64_t orbits = 0;
+        uint64_t candidates = 0;
+        uint64_t saturated = 0;                 // sums clamped to 2^64 - 1
+        std::array<uint64_t, MAX_BANDS> maxHits{};
+    };
+
+    // sums the histograms of inputs, which must describe the same render
+    // with different seeds, into output as a single worker with the MERGED
+    // and WIDE_COUNTS flags. Blocks of MERGE_BLOCK counts are summed by
+    // threads workers (0 for the hardware concurrency) and released from
+    // the inputs once read, so the inputs may be far larger than memory.
+    // Counts saturate instead of wrapping
+    static MergeStats Merge( const std::vector<std::string> &inputs, const std::string &output,
+                             unsigned threads = 0 );
+
+    // counts summed at once by one merge worker, 512 KiB of output
+    static constexpr size_t MERGE_BLOCK = size_t( 1 ) << 16;
+
+private:
+
+    static uint32_t CountBytes( const Header &header );
+    static uint64_t HistogramOffset( const Header &header );
+    static uint64_t HistogramStride( const Header &header );
+    static uint64_t FileSize( const Header &header );
+
+    // reads and checks the header of an open mapping
+    void Validate( const std::string &path ) const;
+
+    nhMappedFile p_file;
+    bool         p_resumed = false;
+};
@@ -0,0 +1,236 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "random.h"
+#include "histogram.h"
+#include "arguments.h"
+
+// -----------------------------------------------------------------------------
+// Orbit deposits per second into a single band histogram, row major against
+// tiled and one at a time against sorted batches, over the same stream of
+// Buddhabrot orbit points at each resolution.
+// -----------------------------------------------------------------------------
+
+// viewport and orbit lengths of the fractals demo
+static const double VIEW_XMIN = -2.0;
+static const double VIEW_XMAX = 1.0;
+static const double VIEW_YMIN = -1.0;
+static const double VIEW_YMAX = 1.0;
+static const int    MIN_ITER = 50;
+static const int    MAX_ITER = 10000;
+
+// -----------------------------------------------------------------------------
+// Orbit points in order, as fractions of the viewport so one stream serves
+// every resolution. Points outside the viewport are dropped, as the demo
+// drops them before touching the histogram
+// -----------------------------------------------------------------------------
+static std::vector<float> OrbitPoints( size_t count )
+{
+    nhRandom rng( 1 );
+    std::vector<float> points;
+    points.reserve( 2 * count + 2 * MAX_ITER );
+
+    std::vector<double> orbit( 2 * MAX_ITER );
+    while ( points.size() < 2 * count )
+    {
+        double cx = rng.NextDouble( VIEW_XMIN, VIEW_XMAX );
+        double cy = rng.NextDouble( VIEW_YMIN, VIEW_YMAX );
+
+        // main cardioid and period 2 bulb, never escape
+        double q = (cx - 0.25) * (cx - 0.25) + cy * cy;
+        if ( q * (q + (cx - 0.25)) < 0.25 * cy * cy || (cx + 1) * (cx + 1) + cy * cy < 0.0625 )
+        {
+            continue;
+        }
+
+        int length = 0;
+        double x = 0.0, y = 0.0;
+        while ( x * x + y * y < 4 && length < MAX_ITER )
+        {
+            double fx = x * x - y * y + cx;
+            y = 2.0 * x * y + cy;
+            x = fx;
+            orbit[2 * length] = x;
+            orbit[2 * length + 1] = y;
+            ++length;
+        }
+        if ( length < MIN_ITER || length >= MAX_ITER )
+        {
+            continue;
+        }
+
+        for ( int k = 0; k < length; ++k )
+        {
+            double u = (orbit[2 * k] - VIEW_XMIN) / (VIEW_XMAX - VIEW_XMIN);
+            double v = (orbit[2 * k + 1] - VIEW_YMIN) / (VIEW_YMAX - VIEW_YMIN);
+            if ( u >= 0.0 && u < 1.0 && v >= 0.0 && v < 1.0 )
+            {
+                points.push_back( static_cast<float>(u) );
+                points.push_back( static_cast<float>(v) );
+            }
+        }
+    }
+    points.resize( 2 * count );
+    return points;
+}
+
+// -----------------------------------------------------------------------------
+// Deposits all points into hits, through a batch of batchSize when non zero
+// -----------------------------------------------------------------------------
+static void DepositAll( const std::vector<float> &points, nhHistogram<uint32_t> &hits,
+                        nhDepositBatch &batch, size_t batchSize )
+{
+    const float width = static_cast<float>(hits.Width());
+    const float height = static_cast<float>(hits.Height());
+    for ( size_t ii = 0; ii < points.size(); ii += 2 )
+    {
+        uint32_t px = std::min( static_cast<uint32_t>(points[ii] * width), hits.Width() - 1 );
+        uint32_t py = std::min( static_cast<uint32_t>(points[ii + 1] * height), hits.Height() - 1 );
+        size_t index = hits.Index( px, py );
+        if ( batchSize == 0 )
+        {
+            hits.Increment( index );
+            continue;
+        }
+
+        batch.Add( index );
+        if ( batch.Size() >= batchSize )
+        {
+            batch.Apply( hits );
+        }
+    }
+    batch.Apply( hits );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class F>
+static double MegadepositsPerSecond( size_t deposits, double seconds, const F &deposit )
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    deposit();  // fault the pages in
+
+    int runs = 0;
+    auto start = Clock::now();
+    double elapsed = 0.0;
+    while ( elapsed < seconds )
+    {
+        deposit();
+        ++runs;
+        elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+    }
+    return elapsed > 0.0 ? deposits * runs / elapsed * 1.0e-6 : 0.0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    double seconds = 1.0;
+    size_t pointCount = size_t( 1 ) << 24;
+    size_t batchSize = size_t( 1 ) << 20;
+    try
+    {
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--seconds" && ii + 1 < argc )
+            {
+                seconds = ParseDouble( arg, argv[++ii] );
+            }
+            else if ( arg == "--points" && ii + 1 < argc )
+            {
+                pointCount = ParseUnsigned( arg, argv[++ii] );
+            }
+            else if ( arg == "--batch" && ii + 1 < argc )
+            {
+                batchSize = ParseUnsigned( arg, argv[++ii] );
+            }
+            else
+            {
+                throw std::runtime_error( "unknown argument " + arg + "!" );
+            }
+        }
+
+        // a zero batch would time the sorted variants one deposit at a time
+        if ( seconds <= 0.0 || pointCount == 0 || batchSize == 0 )
+        {
+            throw std::runtime_error( "--seconds, --points and --batch must be positive!" );
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "usage: depositBench [--seconds S] [--points N] [--batch N]" << std::endl;
+        return 1;
+    }
+
+    struct Resolution
+    {
+        const char *name;
+        uint32_t    width;
+        uint32_t    height;
+    };
+    // the 3:2 aspect ratio of the viewport
+    const Resolution resolutions[] = { { "1K", 1024, 683 }, { "4K", 4096, 2731 }, { "16K", 16384, 10923 } };
+
+    const std::vector<float> points = OrbitPoints( pointCount );
+    const size_t deposits = points.size() / 2;
+
+    struct Variant
+    {
+        const char               *name;
+        nhHistogramLayout::LAYOUT layout;
+        bool                      batched;
+    };
+    const Variant variants[] =
+    {
+        { "row major", nhHistogramLayout::ROW_MAJOR, false },
+        { "tiled", nhHistogramLayout::TILED, false },
+        { "row major sorted", nhHistogramLayout::ROW_MAJOR, true },
+        { "tiled sorted", nhHistogramLayout::TILED, true },
+    };
+
+    nhDepositBatch batch;
+    batch.Reserve( batchSize );
+    for ( const auto &res : resolutions )
+    {
+        std::cout << res.name << " (" << res.width << "x" << res.height << "):";
+
+        // every variant must end with the same counts in row major order
+        std::vector<uint32_t> reference;
+        bool match = true;
+        for ( const auto &variant : variants )
+        {
+            nhHistogram<uint32_t> hits( res.width, res.height, 1, variant.layout );
+            double rate = MegadepositsPerSecond( deposits, seconds, [&]
+            {
+                DepositAll( points, hits, batch, variant.batched ? batchSize : 0 );
+            } );
+
+            // runs differ between variants, one more pass on cleared counts
+            hits.Clear();
+            DepositAll( points, hits, batch, variant.batched ? batchSize : 0 );
+            std::vector<uint32_t> counts( static_cast<size_t>(res.width) * res.height, 0u );
+            hits.AddTo( counts.data() );
+            if ( reference.empty() )
+            {
+                reference.swap( counts );
+            }
+            else
+            {
+                match = match && counts == reference;
+            }
+
+            std::cout << " " << variant.name << " " << rate << " M/s,";
+        }
+        std::cout << (match ? " counts match" : " COUNTS DIFFER") << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "escapeKernelLanes.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NH_ESCAPE_KERNEL_X86
+
+// implemented in escapeKernel<Isa>.cpp, each built for its instruction set
+uint64_t nhIterateSse2( const double *, const double *, size_t, int, int * );
+uint64_t nhIterateAvx2( const double *, const double *, size_t, int, int * );
+uint64_t nhIterateAvx512( const double *, const double *, size_t, int, int * );
+uint64_t nhIterateRecordedSse2( const double *, const double *, size_t, int, int *,
+                                double *, double *, int, nhOrbitSink & );
+uint64_t nhIterateRecordedAvx2( const double *, const double *, size_t, int, int *,
+                                double *, double *, int, nhOrbitSink & );
+uint64_t nhIterateRecordedAvx512( const double *, const double *, size_t, int, int *,
+                                  double *, double *, int, nhOrbitSink & );
+#endif
+
+// -----------------------------------------------------------------------------
+// One lane wide stand-in for a SIMD register, used for recording on CPUs
+// without any of the vector kernels
+// -----------------------------------------------------------------------------
+struct nhScalarLanes
+{
+    static constexpr int WIDTH = 1;
+    using Reg = double;
+    using Mask = bool;
+
+    static Reg Load( const double *p ) { return *p; }
+    static void Store( double *p, Reg a ) { *p = a; }
+    static Reg Set1( double a ) { return a; }
+    static Reg Add( Reg a, Reg b ) { return a + b; }
+    static Reg Sub( Reg a, Reg b ) { return a - b; }
+    static Reg Mul( Reg a, Reg b ) { return a * b; }
+    static Reg Abs( Reg a ) { return std::fabs( a ); }
+
+    static Mask Lt( Reg a, Reg b ) { return a < b; }
+    static Mask Eq( Reg a, Reg b ) { return a == b; }
+    static Mask And( Mask a, Mask b ) { return a && b; }
+    static int Bits( Mask m ) { return m ? 1 : 0; }
+    static Reg Select( Mask m, Reg a, Reg b ) { return m ? a : b; }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static uint64_t IterateScalar( const double *cx, const double *cy, size_t count,
+                               int maxIter, int *iterations )
+{
+    uint64_t saved = 0;
+    for ( size_t ii = 0; ii < count; ++ii )
+    {
+        iterations[ii] = nhEscapeIterations( cx[ii], cy[ii], maxIter, &saved );
+    }
+    return saved;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static uint64_t IterateRecordedScalar( const double *cx, const double *cy, size_t count,
+                                       int maxIter, int *iterations,
+                                       double *ringX, double *ringY, int rows,
+                                       nhOrbitSink &sink )
+{
+    return IterateLanes<nhScalarLanes, true>( cx, cy, count, maxIter, iterations,
+                                              ringX, ringY, rows, &sink );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+const char *ToString( nhSimdLevel level )
+{
+    switch ( level )
+    {
+    case nhSimdLevel::SCALAR: return "scalar";
+    case nhSimdLevel::SSE2:   return "sse2";
+    case nhSimdLevel::AVX2:   return "avx2";
+    case nhSimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhSimdLevel nhEscapeKernel::DetectLevel()
+{
+#if defined(NH_ESCAPE_KERNEL_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid( info, 0 );
+    const int maxLeaf = info[0];
+
+    __cpuid( info, 1 );
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv( 0 ) : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false, avx512 = false;
+    if ( maxLeaf >= 7 )
+    {
+        __cpuidex( info, 7, 0 );
+        avx2 = ymmState && (info[1] & (1 << 5)) != 0;
+        avx512 = zmmState && (info[1] & (1 << 16)) != 0;
+    }
+#else
+    const bool avx2 = __builtin_cpu_supports( "avx2" );
+    const bool avx512 = __builtin_cpu_supports( "avx512f" );
+#endif
+    if ( avx512 )
+    {
+        return nhSimdLevel::AVX512;
+    }
+    if ( avx2 )
+    {
+        return nhSimdLevel::AVX2;
+    }
+    // SSE2 is part of the x86-64 baseline
+    return nhSimdLevel::SSE2;
+#else
+    return nhSimdLevel::SCALAR;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhEscapeKernel::nhEscapeKernel( nhSimdLevel level )
+    : p_level( std::min( level, DetectLevel() ) ),
+      p_iterate( IterateScalar ),
+      p_iterateRecorded( IterateRecordedScalar )
+{
+#if defined(NH_ESCAPE_KERNEL_X86)
+    switch ( p_level )
+    {
+    case nhSimdLevel::AVX512:
+        p_iterate = nhIterateAvx512;
+        p_iterateRecorded = nhIterateRecordedAvx512;
+        break;
+    case nhSimdLevel::AVX2:
+        p_iterate = nhIterateAvx2;
+        p_iterateRecorded = nhIterateRecordedAvx2;
+        break;
+    case nhSimdLevel::SSE2:
+        p_iterate = nhIterateSse2;
+        p_iterateRecorded = nhIterateRecordedSse2;
+        break;
+    case nhSimdLevel::SCALAR:
+        break;
+    }
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int nhEscapeKernel::Width() const
+{
+    switch ( p_level )
+    {
+    case nhSimdLevel::AVX512: return 8;
+    case nhSimdLevel::AVX2:   return 4;
+    case nhSimdLevel::SSE2:   return 2;
+    case nhSimdLevel::SCALAR: return 1;
+    }
+    return 1;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhEscapeKernel::Iterate( const double *cx, const double *cy, size_t count,
+                                  int maxIter, int *iterations ) const
+{
+    return p_iterate( cx, cy, count, maxIter, iterations );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhEscapeKernel::IterateRecorded( const double *cx, const double *cy, size_t count,
+                                          int maxIter, int *iterations,
+                                          double *ringX, double *ringY, int rows,
+                                          nhOrbitSink &sink ) const
+{
+    return p_iterateRecorded( cx, cy, count, maxIter, iterations, ringX, ringY, rows, sink );
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// Instruction sets the escape time kernel has an implementation for
+// -----------------------------------------------------------------------------
+enum class nhSimdLevel
+{
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+const char *ToString( nhSimdLevel level );
+
+// -----------------------------------------------------------------------------
+// Periodicity check: the orbit is compared against a saved point that is moved
+// along at iterations 2^k (Brent's scheme), so a cycle of any period p is
+// caught once 2^k >= p. Orbits that come back within the epsilon are treated
+// as never escaping.
+// -----------------------------------------------------------------------------
+constexpr double NH_CYCLE_EPSILON = 1.0e-12;
+constexpr int    NH_FIRST_CYCLE_CHECKPOINT = 16;
+
+// -----------------------------------------------------------------------------
+// Number of iterations of 0 under f(z) = z^2 + c before |z| reaches 2,
+// capped at maxIter. Orbits found to be periodic return maxIter straight
+// away, and the iterations that were skipped are added to saved when given.
+// Reference implementation every kernel must agree with.
+// -----------------------------------------------------------------------------
+inline int nhEscapeIterations( double cx, double cy, int maxIter,
+                               uint64_t *saved = nullptr )
+{
+    double x0 = 0.0, y0 = 0.0;
+    double sx = 0.0, sy = 0.0;
+    int checkpoint = NH_FIRST_CYCLE_CHECKPOINT;
+    int count = 0;
+    while ( x0 * x0 + y0 * y0 < 4 && count < maxIter )
+    {
+        double fx = x0 * x0 - y0 * y0 + cx;
+        double fy = 2.0 * x0 * y0 + cy;
+        x0 = fx;
+        y0 = fy;
+        ++count;
+
+        if ( std::fabs( x0 - sx ) < NH_CYCLE_EPSILON &&
+             std::fabs( y0 - sy ) < NH_CYCLE_EPSILON )
+        {
+            if ( saved )
+            {
+                *saved += maxIter - count;
+            }
+            return maxIter;
+        }
+
+        if ( count == checkpoint )
+        {
+            sx = x0;
+            sy = y0;
+            checkpoint *= 2;
+        }
+    }
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+// Orbit of one finished point as recorded by nhEscapeKernel::IterateRecorded.
+// The kernel writes every step of all lanes as one row of a ring buffer, so
+// the orbit is a column of consecutive rows. Point k is z_(k+1), the value
+// after k+1 iterations.
+// -----------------------------------------------------------------------------
+struct nhOrbitView
+{
+    const double *zx;       // column of the lane in the ring
+    const double *zy;
+    int           stride;   // doubles between two rows
+    int           first;    // row holding the first point
+    int           rowMask;  // ring rows - 1
+    int           count;    // iterations, maxIter for points that never escape
+    bool          complete; // false when the orbit outgrew the ring
+
+    double X( int k ) const { return zx[((first + k) & rowMask) * stride]; }
+    double Y( int k ) const { return zy[((first + k) & rowMask) * stride]; }
+};
+
+// -----------------------------------------------------------------------------
+// Receives the points of a recorded batch as their lanes finish. The orbit is
+// only valid during the call, the ring is overwritten right after.
+// -----------------------------------------------------------------------------
+class nhOrbitSink
+{
+public:
+
+    virtual void Finished( size_t index, const nhOrbitView &orbit ) = 0;
+
+protected:
+
+    ~nhOrbitSink() = default;
+};
+
+// -----------------------------------------------------------------------------
+// Batched escape time evaluation. Points are streamed through the SIMD lanes:
+// as soon as a lane escapes or runs out of iterations its result is written
+// and the next pending point is loaded in its place, so one long orbit does
+// not hold the other lanes idle. The widest instruction set supported by the
+// running CPU is picked at construction.
+// -----------------------------------------------------------------------------
+class nhEscapeKernel
+{
+public:
+
+    nhEscapeKernel() : nhEscapeKernel( DetectLevel() ) {}
+
+    // level is clamped to what the running CPU supports
+    explicit nhEscapeKernel( nhSimdLevel level );
+
+    // widest instruction set usable on this CPU
+    static nhSimdLevel DetectLevel();
+
+    nhSimdLevel Level() const { return p_level; }
+
+    // number of points evaluated side by side
+    int Width() const;
+
+    // writes nhEscapeIterations( cx[i], cy[i], maxIter ) to iterations[i]
+    // and returns the iterations saved by the periodicity check
+    uint64_t Iterate( const double *cx, const double *cy, size_t count,
+                      int maxIter, int *iterations ) const;
+
+    // doubles needed by each of the x and y rings of IterateRecorded
+    size_t RingSize( int rows ) const { return static_cast<size_t>(rows) * Width(); }
+
+    // as Iterate, also writing every orbit to the ringX / ringY ring buffers
+    // of rows rows (a power of two) and handing it to sink when its point is
+    // done, so accepted orbits can be replayed instead of recomputed
+    uint64_t IterateRecorded( const double *cx, const double *cy, size_t count,
+                              int maxIter, int *iterations,
+                              double *ringX, double *ringY, int rows,
+                              nhOrbitSink &sink ) const;
+
+private:
+
+    using IterateFn = uint64_t (*)( const double *, const double *, size_t, int, int * );
+    using IterateRecordedFn = uint64_t (*)( const double *, const double *, size_t, int, int *,
+                                            double *, double *, int, nhOrbitSink & );
+
+    nhSimdLevel         p_level;
+    IterateFn           p_iterate;
+    IterateRecordedFn   p_iterateRecorded;
+};
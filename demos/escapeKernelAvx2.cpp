@@ -0,0 +1,49 @@
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+#include "escapeKernelLanes.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct nhAvx2Lanes
+{
+    static constexpr int WIDTH = 4;
+    using Reg = __m256d;
+    using Mask = __m256d;
+
+    static Reg Load( const double *p ) { return _mm256_loadu_pd( p ); }
+    static void Store( double *p, Reg a ) { _mm256_storeu_pd( p, a ); }
+    static Reg Set1( double a ) { return _mm256_set1_pd( a ); }
+    static Reg Add( Reg a, Reg b ) { return _mm256_add_pd( a, b ); }
+    static Reg Sub( Reg a, Reg b ) { return _mm256_sub_pd( a, b ); }
+    static Reg Mul( Reg a, Reg b ) { return _mm256_mul_pd( a, b ); }
+    static Reg Abs( Reg a ) { return _mm256_andnot_pd( _mm256_set1_pd( -0.0 ), a ); }
+
+    static Mask Lt( Reg a, Reg b ) { return _mm256_cmp_pd( a, b, _CMP_LT_OQ ); }
+    static Mask Eq( Reg a, Reg b ) { return _mm256_cmp_pd( a, b, _CMP_EQ_OQ ); }
+    static Mask And( Mask a, Mask b ) { return _mm256_and_pd( a, b ); }
+    static int Bits( Mask m ) { return _mm256_movemask_pd( m ); }
+    static Reg Select( Mask m, Reg a, Reg b ) { return _mm256_blendv_pd( b, a, m ); }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhIterateAvx2( const double *cx, const double *cy, size_t count,
+                        int maxIter, int *iterations )
+{
+    return IterateLanes<nhAvx2Lanes, false>( cx, cy, count, maxIter, iterations );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhIterateRecordedAvx2( const double *cx, const double *cy, size_t count,
+                                int maxIter, int *iterations,
+                                double *ringX, double *ringY, int rows,
+                                nhOrbitSink &sink )
+{
+    return IterateLanes<nhAvx2Lanes, true>( cx, cy, count, maxIter, iterations,
+                                            ringX, ringY, rows, &sink );
+}
+
+#endif
@@ -0,0 +1,49 @@
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+#include "escapeKernelLanes.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct nhAvx512Lanes
+{
+    static constexpr int WIDTH = 8;
+    using Reg = __m512d;
+    using Mask = __mmask8;
+
+    static Reg Load( const double *p ) { return _mm512_loadu_pd( p ); }
+    static void Store( double *p, Reg a ) { _mm512_storeu_pd( p, a ); }
+    static Reg Set1( double a ) { return _mm512_set1_pd( a ); }
+    static Reg Add( Reg a, Reg b ) { return _mm512_add_pd( a, b ); }
+    static Reg Sub( Reg a, Reg b ) { return _mm512_sub_pd( a, b ); }
+    static Reg Mul( Reg a, Reg b ) { return _mm512_mul_pd( a, b ); }
+    static Reg Abs( Reg a ) { return _mm512_abs_pd( a ); }
+
+    static Mask Lt( Reg a, Reg b ) { return _mm512_cmp_pd_mask( a, b, _CMP_LT_OQ ); }
+    static Mask Eq( Reg a, Reg b ) { return _mm512_cmp_pd_mask( a, b, _CMP_EQ_OQ ); }
+    static Mask And( Mask a, Mask b ) { return static_cast<Mask>(a & b); }
+    static int Bits( Mask m ) { return m; }
+    static Reg Select( Mask m, Reg a, Reg b ) { return _mm512_mask_blend_pd( m, b, a ); }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhIterateAvx512( const double *cx, const double *cy, size_t count,
+                          int maxIter, int *iterations )
+{
+    return IterateLanes<nhAvx512Lanes, false>( cx, cy, count, maxIter, iterations );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhIterateRecordedAvx512( const double *cx, const double *cy, size_t count,
+                                  int maxIter, int *iterations,
+                                  double *ringX, double *ringY, int rows,
+                                  nhOrbitSink &sink )
+{
+    return IterateLanes<nhAvx512Lanes, true>( cx, cy, count, maxIter, iterations,
+                                              ringX, ringY, rows, &sink );
+}
+
+#endif
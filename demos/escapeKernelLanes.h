@@ -0,0 +1,182 @@
+#pragma once
+
+// Lane streaming escape time loop shared by the per instruction set kernels.
+// Every kernel translation unit is compiled with its own target flags, so the
+// template lives in an anonymous namespace to keep one unit's instantiation
+// from being merged into another.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "escapeKernel.h"
+
+namespace
+{
+
+// -----------------------------------------------------------------------------
+// V provides WIDTH, a register type Reg and a comparison result type Mask,
+// Load, Store, Set1, Add, Sub, Mul, Abs, Select on registers and Lt, Eq, And
+// and Bits (lane bit mask) on comparison results. With RECORD every step is
+// stored as row (step & (rows - 1)) of the rings and finished points are
+// reported to sink.
+// -----------------------------------------------------------------------------
+template <class V, bool RECORD>
+uint64_t IterateLanes( const double *cx, const double *cy, size_t count,
+                       int maxIter, int *iterations,
+                       double *ringX = nullptr, double *ringY = nullptr,
+                       int rows = 0, nhOrbitSink *sink = nullptr )
+{
+    constexpr int W = V::WIDTH;
+    using Reg = typename V::Reg;
+    using Mask = typename V::Mask;
+
+    alignas(64) double laneCx[W];
+    alignas(64) double laneCy[W];
+    alignas(64) double laneZx[W];
+    alignas(64) double laneZy[W];
+    alignas(64) double laneSx[W];
+    alignas(64) double laneSy[W];
+    alignas(64) double laneN[W];
+    alignas(64) double laneCheckpoint[W];
+    size_t laneIdx[W];
+    int laneFirst[W];
+
+    const int rowMask = rows - 1;
+    int step = 0;
+
+    const double idleN = static_cast<double>(maxIter);
+    size_t next = 0;
+    int liveMask = 0;
+    int cycleMask = 0;
+    uint64_t saved = 0;
+
+    // loads the next pending point into lane, or parks the lane when there is
+    // none left. A parked lane holds n == maxIter so it never counts as inside
+    auto refill = [&]( int lane )
+    {
+        laneZx[lane] = 0.0;
+        laneZy[lane] = 0.0;
+        laneSx[lane] = 0.0;
+        laneSy[lane] = 0.0;
+        laneCheckpoint[lane] = NH_FIRST_CYCLE_CHECKPOINT;
+        cycleMask &= ~(1 << lane);
+        if ( next < count )
+        {
+            laneIdx[lane] = next;
+            laneCx[lane] = cx[next];
+            laneCy[lane] = cy[next];
+            laneN[lane] = 0.0;
+            laneFirst[lane] = step;
+            liveMask |= 1 << lane;
+            ++next;
+        }
+        else
+        {
+            laneCx[lane] = 0.0;
+            laneCy[lane] = 0.0;
+            laneN[lane] = idleN;
+            liveMask &= ~(1 << lane);
+        }
+    };
+
+    for ( int lane = 0; lane < W; ++lane )
+    {
+        refill( lane );
+    }
+
+    Reg vcx = V::Load( laneCx ), vcy = V::Load( laneCy );
+    Reg zx = V::Load( laneZx ), zy = V::Load( laneZy );
+    Reg sx = V::Load( laneSx ), sy = V::Load( laneSy );
+    Reg n = V::Load( laneN );
+    Reg checkpoint = V::Load( laneCheckpoint );
+
+    const Reg four = V::Set1( 4.0 );
+    const Reg one = V::Set1( 1.0 );
+    const Reg two = V::Set1( 2.0 );
+    const Reg eps = V::Set1( NH_CYCLE_EPSILON );
+    const Reg vmax = V::Set1( idleN );
+
+    while ( liveMask != 0 )
+    {
+        Reg zx2 = V::Mul( zx, zx );
+        Reg zy2 = V::Mul( zy, zy );
+        int inside = V::Bits( V::And( V::Lt( V::Add( zx2, zy2 ), four ), V::Lt( n, vmax ) ) );
+        inside &= ~cycleMask;
+
+        if ( inside != liveMask )
+        {
+            // some lanes are done: hand out their results and restart them
+            V::Store( laneZx, zx );
+            V::Store( laneZy, zy );
+            V::Store( laneSx, sx );
+            V::Store( laneSy, sy );
+            V::Store( laneN, n );
+            V::Store( laneCheckpoint, checkpoint );
+            V::Store( laneCx, vcx );
+            V::Store( laneCy, vcy );
+
+            int done = liveMask & ~inside;
+            for ( int lane = 0; lane < W; ++lane )
+            {
+                if ( done & (1 << lane) )
+                {
+                    int laneCount = static_cast<int>(laneN[lane]);
+                    if ( cycleMask & (1 << lane) )
+                    {
+                        saved += maxIter - laneCount;
+                        laneCount = maxIter;
+                    }
+                    iterations[laneIdx[lane]] = laneCount;
+
+                    if ( RECORD )
+                    {
+                        nhOrbitView orbit{ ringX + lane, ringY + lane, W,
+                                           laneFirst[lane] & rowMask, rowMask,
+                                           laneCount, laneCount <= rows };
+                        sink->Finished( laneIdx[lane], orbit );
+                    }
+
+                    refill( lane );
+                }
+            }
+
+            vcx = V::Load( laneCx );
+            vcy = V::Load( laneCy );
+            zx = V::Load( laneZx );
+            zy = V::Load( laneZy );
+            sx = V::Load( laneSx );
+            sy = V::Load( laneSy );
+            n = V::Load( laneN );
+            checkpoint = V::Load( laneCheckpoint );
+            continue;
+        }
+
+        // same operation order as nhEscapeIterations so results match exactly
+        Reg fx = V::Add( V::Sub( zx2, zy2 ), vcx );
+        Reg fy = V::Add( V::Mul( V::Add( zx, zx ), zy ), vcy );
+        zx = fx;
+        zy = fy;
+        n = V::Add( n, one );
+
+        if ( RECORD )
+        {
+            int row = step & rowMask;
+            V::Store( ringX + row * W, zx );
+            V::Store( ringY + row * W, zy );
+        }
+        ++step;
+
+        Mask cycle = V::And( V::Lt( V::Abs( V::Sub( zx, sx ) ), eps ),
+                             V::Lt( V::Abs( V::Sub( zy, sy ) ), eps ) );
+        cycleMask = V::Bits( cycle );
+
+        Mask move = V::Eq( n, checkpoint );
+        sx = V::Select( move, zx, sx );
+        sy = V::Select( move, zy, sy );
+        checkpoint = V::Select( move, V::Mul( checkpoint, two ), checkpoint );
+    }
+
+    return saved;
+}
+
+} // namespace
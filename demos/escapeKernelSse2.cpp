@@ -0,0 +1,49 @@
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+#include "escapeKernelLanes.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct nhSse2Lanes
+{
+    static constexpr int WIDTH = 2;
+    using Reg = __m128d;
+    using Mask = __m128d;
+
+    static Reg Load( const double *p ) { return _mm_loadu_pd( p ); }
+    static void Store( double *p, Reg a ) { _mm_storeu_pd( p, a ); }
+    static Reg Set1( double a ) { return _mm_set1_pd( a ); }
+    static Reg Add( Reg a, Reg b ) { return _mm_add_pd( a, b ); }
+    static Reg Sub( Reg a, Reg b ) { return _mm_sub_pd( a, b ); }
+    static Reg Mul( Reg a, Reg b ) { return _mm_mul_pd( a, b ); }
+    static Reg Abs( Reg a ) { return _mm_andnot_pd( _mm_set1_pd( -0.0 ), a ); }
+
+    static Mask Lt( Reg a, Reg b ) { return _mm_cmplt_pd( a, b ); }
+    static Mask Eq( Reg a, Reg b ) { return _mm_cmpeq_pd( a, b ); }
+    static Mask And( Mask a, Mask b ) { return _mm_and_pd( a, b ); }
+    static int Bits( Mask m ) { return _mm_movemask_pd( m ); }
+    static Reg Select( Mask m, Reg a, Reg b ) { return _mm_or_pd( _mm_and_pd( m, a ), _mm_andnot_pd( m, b ) ); }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhIterateSse2( const double *cx, const double *cy, size_t count,
+                        int maxIter, int *iterations )
+{
+    return IterateLanes<nhSse2Lanes, false>( cx, cy, count, maxIter, iterations );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhIterateRecordedSse2( const double *cx, const double *cy, size_t count,
+                                int maxIter, int *iterations,
+                                double *ringX, double *ringY, int rows,
+                                nhOrbitSink &sink )
+{
+    return IterateLanes<nhSse2Lanes, true>( cx, cy, count, maxIter, iterations,
+                                            ringX, ringY, rows, &sink );
+}
+
+#endif
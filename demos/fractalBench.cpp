@@ -0,0 +1,354 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "random.h"
+#include "nebulabrot.h"
+#include "arguments.h"
+
+// -----------------------------------------------------------------------------
+// Throughput of the nhNebulabrot engine, for tracking regressions between
+// releases:
+//
+//   fractalBench [--orbits N] [--seconds S] [--max-threads N] [--seed N]
+//                [--json FILE]
+//
+//   escape       starting points rejection tested per second, scalar
+//                PointHasOrbitBetween against the batched escape kernel at
+//                each instruction set, and the fraction accepted
+//   paint        Paint until a budget of N orbits for each sampler, in
+//                orbits per second with the acceptance rate and duty cycle
+//   heat plot    GetHeatPlot of the painted histogram in megapixels per second
+//   scaling      the uniform budget on 2, 4 ... max threads workers, with
+//                the speedup over one worker
+//
+// Every run draws from fixed seeds, a given seed and worker count paint the
+// same histogram and report the same hit total. The JSON file holds the
+// same figures as the console, one object per benchmark.
+// -----------------------------------------------------------------------------
+
+// viewport, resolution and orbit lengths of the fractals demo
+static const double VIEW_XMIN = -2.0;
+static const double VIEW_XMAX = 1.0;
+static const double VIEW_YMIN = -1.0;
+static const double VIEW_YMAX = 1.0;
+static const int    WIDTH = 1200;
+static const int    HEIGHT = 800;
+static const int    MIN_ITER = 50;
+static const int    MAX_ITER = 10000;
+
+// -----------------------------------------------------------------------------
+// One benchmark's figures, in the order they are printed
+// -----------------------------------------------------------------------------
+struct BenchResult
+{
+    std::string                                   name;
+    std::vector<std::pair<std::string, double>>   values;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void Report( std::vector<BenchResult> &results, BenchResult result )
+{
+    std::cout << result.name << ":";
+    for ( const auto &value : result.values )
+    {
+        std::cout << " " << value.first << " " << value.second;
+    }
+    std::cout << std::endl;
+    results.push_back( std::move( result ) );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class F>
+static double RunsPerSecond( double seconds, const F &run )
+{
+    using Clock = std::chrono::steady_clock;
+
+    run();  // warm up caches and threads
+
+    int runs = 0;
+    auto start = Clock::now();
+    double elapsed = 0.0;
+    while ( elapsed < seconds )
+    {
+        run();
+        ++runs;
+        elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+    }
+    return elapsed > 0.0 ? runs / elapsed : 0.0;
+}
+
+// -----------------------------------------------------------------------------
+// Starting points per second through the scalar test and the kernel at
+// every instruction set this CPU has
+// -----------------------------------------------------------------------------
+static void BenchEscape( std::vector<BenchResult> &results, uint64_t seed, double seconds )
+{
+    const size_t count = 1 << 14;
+    nhRandom rng( seed );
+    std::vector<double> cx( count ), cy( count );
+    for ( size_t ii = 0; ii < count; ++ii )
+    {
+        cx[ii] = rng.NextDouble( VIEW_XMIN, VIEW_XMAX );
+        cy[ii] = rng.NextDouble( VIEW_YMIN, VIEW_YMAX );
+    }
+
+    size_t accepted = 0;
+    double rate = count * RunsPerSecond( seconds, [&]
+    {
+        accepted = 0;
+        for ( size_t ii = 0; ii < count; ++ii )
+        {
+            accepted += nhNebulabrot::PointHasOrbitBetween( cx[ii], cy[ii], MIN_ITER, MAX_ITER ) ? 1 : 0;
+        }
+    } );
+    Report( results, { "escape/PointHasOrbitBetween",
+                       { { "candidates_per_second", rate },
+                         { "acceptance_rate", static_cast<double>(accepted) / count } } } );
+
+    std::vector<int> iterations( count );
+    const nhSimdLevel levels[] = { nhSimdLevel::SCALAR, nhSimdLevel::SSE2, nhSimdLevel::AVX2, nhSimdLevel::AVX512 };
+    for ( nhSimdLevel level : levels )
+    {
+        if ( level > nhEscapeKernel::DetectLevel() )
+        {
+            break;
+        }
+
+        nhEscapeKernel kernel( level );
+        rate = count * RunsPerSecond( seconds, [&]
+        {
+            kernel.Iterate( cx.data(), cy.data(), count, MAX_ITER, iterations.data() );
+        } );
+
+        // the kernel skips the bulb tests, it must still accept the same points
+        accepted = std::count_if( iterations.begin(), iterations.end(), []( int iters )
+        {
+            return iters >= MIN_ITER && iters < MAX_ITER;
+        } );
+        Report( results, { std::string( "escape/kernel/" ) + ToString( level ),
+                           { { "candidates_per_second", rate },
+                             { "acceptance_rate", static_cast<double>(accepted) / count } } } );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Paints the budget of options on its workers, returns the seconds taken
+// -----------------------------------------------------------------------------
+static double PaintBudget( nhNebulabrot &fractal )
+{
+    using Clock = std::chrono::steady_clock;
+
+    nhJobSystem jobs( fractal.WorkerCount() );
+    auto start = Clock::now();
+    std::vector<std::shared_ptr<nhJob>> paintJobs;
+    for ( unsigned worker = 0; worker < fractal.WorkerCount(); ++worker )
+    {
+        paintJobs.push_back( jobs.Submit( [&fractal, worker]( nhJob &job ) { fractal.Paint( worker, job ); } ) );
+    }
+    for ( const auto &job : paintJobs )
+    {
+        job->Wait();
+    }
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+// -----------------------------------------------------------------------------
+// Paints options' budget and reports it as name, with the speedup over
+// baseline orbits per second when given. With heatPlotSeconds the heat plot
+// of the result is timed as well. Returns the orbits per second
+// -----------------------------------------------------------------------------
+static double BenchPaint( std::vector<BenchResult> &results, const std::string &name,
+                          const nhNebulabrot::Options &options, double heatPlotSeconds,
+                          double baseline = 0.0 )
+{
+    nhNebulabrot fractal( VIEW_XMIN, VIEW_XMAX, VIEW_YMIN, VIEW_YMAX, WIDTH, HEIGHT,
+                          MAX_ITER, MIN_ITER, options );
+    const double seconds = PaintBudget( fractal );
+
+    const uint64_t orbits = fractal.OrbitCount();
+    const nhNebulabrot::RejectionStats stats = fractal.GetRejectionStats();
+    uint64_t hits = 0;
+    for ( uint32_t count : fractal.GetHits() )
+    {
+        hits += count;
+    }
+
+    // the metropolis chains draw no uniform candidates
+    BenchResult result{ name, { { "workers", fractal.WorkerCount() },
+                                { "seconds", seconds },
+                                { "orbits", static_cast<double>(orbits) },
+                                { "orbits_per_second", orbits / seconds } } };
+    if ( stats.candidates > 0 )
+    {
+        result.values.push_back( { "acceptance_rate", static_cast<double>(orbits) / stats.candidates } );
+    }
+    result.values.push_back( { "duty_cycle", fractal.DutyCycle() } );
+    result.values.push_back( { "hits", static_cast<double>(hits) } );
+    if ( baseline > 0.0 )
+    {
+        // 1.0 per worker is perfect scaling
+        result.values.push_back( { "speedup", orbits / seconds / baseline } );
+    }
+    Report( results, result );
+
+    if ( heatPlotSeconds > 0.0 )
+    {
+        nhToneMapper toneMapper;
+        std::vector<unsigned char> rgba( 4 * static_cast<size_t>(WIDTH) * HEIGHT );
+        double rate = RunsPerSecond( heatPlotSeconds, [&] { fractal.GetHeatPlot( toneMapper, rgba.data() ); } );
+        Report( results, { "heat_plot", { { "threads", toneMapper.Threads() },
+                                          { "megapixels_per_second", rate * WIDTH * HEIGHT * 1.0e-6 } } } );
+    }
+
+    return orbits / seconds;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void WriteJson( const std::string &path, const std::vector<BenchResult> &results,
+                       uint64_t seed, uint64_t orbits )
+{
+    std::ofstream file( path );
+    if ( !file )
+    {
+        throw std::runtime_error( "failed to open " + path + "!" );
+    }
+
+    file << std::setprecision( 10 );
+    file << "{\n  \"context\": {\n"
+         << "    \"simd\": \"" << ToString( nhEscapeKernel::DetectLevel() ) << "\",\n"
+         << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+         << "    \"seed\": " << seed << ",\n"
+         << "    \"orbit_budget\": " << orbits << ",\n"
+         << "    \"width\": " << WIDTH << ",\n"
+         << "    \"height\": " << HEIGHT << ",\n"
+         << "    \"min_iter\": " << MIN_ITER << ",\n"
+         << "    \"max_iter\": " << MAX_ITER << "\n"
+         << "  },\n  \"benchmarks\": [";
+    for ( size_t ii = 0; ii < results.size(); ++ii )
+    {
+        file << (ii == 0 ? "\n" : ",\n") << "    { \"name\": \"" << results[ii].name << "\"";
+        for ( const auto &value : results[ii].values )
+        {
+            file << ", \"" << value.first << "\": " << value.second;
+        }
+        file << " }";
+    }
+    file << "\n  ]\n}\n";
+
+    if ( !file )
+    {
+        throw std::runtime_error( "failed to write " + path + "!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    uint64_t orbits = 100000;
+    double seconds = 1.0;
+    unsigned maxThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    uint64_t seed = 1;
+    std::string jsonFile;
+    try
+    {
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--orbits" && ii + 1 < argc )
+            {
+                orbits = ParseUnsigned( arg, argv[++ii] );
+            }
+            else if ( arg == "--seconds" && ii + 1 < argc )
+            {
+                seconds = ParseDouble( arg, argv[++ii] );
+            }
+            else if ( arg == "--max-threads" && ii + 1 < argc )
+            {
+                maxThreads = static_cast<unsigned>(std::clamp<uint64_t>(
+                    ParseUnsigned( arg, argv[++ii] ), 1, std::numeric_limits<unsigned>::max() ));
+            }
+            else if ( arg == "--seed" && ii + 1 < argc )
+            {
+                seed = ParseUnsigned( arg, argv[++ii] );
+            }
+            else if ( arg == "--json" && ii + 1 < argc )
+            {
+                jsonFile = argv[++ii];
+            }
+            else
+            {
+                throw std::runtime_error( "unknown argument " + arg + "!" );
+            }
+        }
+
+        // a zero budget never ends and zero seconds measure nothing
+        if ( orbits == 0 )
+        {
+            throw std::runtime_error( "--orbits must be positive!" );
+        }
+        if ( seconds <= 0.0 )
+        {
+            throw std::runtime_error( "--seconds must be positive!" );
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "usage: fractalBench [--orbits N] [--seconds S] [--max-threads N] [--seed N] "
+                     "[--json FILE]" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::vector<BenchResult> results;
+        BenchEscape( results, seed, seconds );
+
+        nhNebulabrot::Options options;
+        options.seed = seed;
+        options.orbitBudget = orbits;
+        options.workerCount = 1;
+        const double single = BenchPaint( results, "paint/uniform", options, seconds );
+
+        options.replayOrbits = true;
+        BenchPaint( results, "paint/uniform_replay", options, 0.0 );
+        options.replayOrbits = false;
+
+        options.sampler = nhNebulabrot::METROPOLIS;
+        BenchPaint( results, "paint/metropolis", options, 0.0 );
+        options.sampler = nhNebulabrot::UNIFORM;
+
+        // the one worker run is paint/uniform
+        for ( unsigned threads = std::min( 2u, maxThreads ); threads > 1; )
+        {
+            options.workerCount = threads;
+            BenchPaint( results, "scaling/" + std::to_string( threads ), options, 0.0, single );
+            threads = threads == maxThreads ? 0 : std::min( 2 * threads, maxThreads );
+        }
+
+        if ( !jsonFile.empty() )
+        {
+            WriteJson( jsonFile, results, seed, orbits );
+            std::cout << "wrote " << jsonFile << std::endl;
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
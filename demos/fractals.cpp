@@ -1,302 +1,599 @@
 #include <cmath>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cassert>
+#include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
 
 #include "fractals.h"
-#include <fstream>
+#include "arguments.h"
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-bool nhImage::PointAtPixel( const int px, const int py,
-                            double &x, double &y,
-                            const nhImage::PIXEL_CORNER loc ) const
+FractalsApp::FractalsApp( const nhNebulabrot::Options &options,
+                          ENGINE engine,
+                          bool deviceToneMap )
+    : _options( options ),
+      _engine( engine ),
+      _seed( options.seed ),
+      _deviceToneMap( deviceToneMap )
 {
-    if ( px < 0 || px > p_resX || py < 0 || py > p_resY )
+    if ( _deviceToneMap && options.bands.size() > 1 )
     {
-        return false;
+        throw std::runtime_error( "several bands cannot be tone mapped on the device!" );
     }
 
-    double pixelSpanX = (p_xMax - p_xMin) / p_resX;
-    x = p_xMin + px * pixelSpanX;
+    // the gpu engine needs the device, it starts with the first frame and
+    // only has cpu workers while VerifyGpu compares the two
+    if ( _engine == CPU_ENGINE )
+    {
+        CreateFractal();
+        StartPainting();
+    }
+}
 
-    double pixelSpanY = (p_yMax - p_yMin) / p_resY;
-    y = p_yMin + py * pixelSpanY;
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+FractalsApp::~FractalsApp()
+{
+    PausePainting();
 
-    switch ( loc )
+    if ( _engine == CPU_ENGINE )
     {
-    case CENTER:
-        x += 0.5 * pixelSpanX;
-        y += 0.5 * pixelSpanY;
-        break;
-    case LOWER_LEFT:
-        y += pixelSpanY;
-        break;
-    case LOWER_RIGHT:
-        x += pixelSpanX;
-        y += pixelSpanY;
-        break;
-    case UPPER_RIGHT:
-        x += pixelSpanX;
-        break;
-    case UPPER_LEFT:
-        break;
-    default:
-        return false;
+        _fractal->FlushCheckpoint();
+        std::cout << "sampler duty cycle " << 100.0 * _fractal->DutyCycle() << "%" << std::endl;
     }
+}
 
-    return true;
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::CreateFractal()
+{
+    auto wp = GetWindowParams();
+    _fractal = std::make_unique<nhNebulabrot>( VIEW_XMIN, VIEW_XMAX, VIEW_YMIN, VIEW_YMAX,
+                                               wp.width, wp.height, MAX_ITER, MIN_ITER, _options );
+    _jobs = std::make_unique<nhJobSystem>( _fractal->WorkerCount() );
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-bool nhImage::PixelAtPoint( const double x, const double y, int &px, int &py )
-const
+void FractalsApp::StartPainting()
 {
-    if ( x > p_xMax || x < p_xMin || y > p_yMax || y < p_yMin )
+    _fractal->PausePaint( false );
+    assert( _paintJobs.empty() );
+    for ( unsigned ii = 0; ii < _fractal->WorkerCount(); ++ii )
     {
-        return false;
+        nhNebulabrot *fractal = _fractal.get();
+        _paintJobs.push_back( _jobs->Submit( [fractal, ii]( nhJob &job ) { fractal->Paint( ii, job ); } ) );
     }
+}
 
-    double pixelSpan = (p_xMax - p_xMin) / (p_resX - 1);
-    px = static_cast<int>((x - p_xMin) / pixelSpan);
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::PausePainting()
+{
+    for ( auto &job : _paintJobs )
+    {
+        job->RequestStop();
+    }
 
-    pixelSpan = (p_yMax - p_yMin) / (p_resY - 1);
-    py = static_cast<int>((y - p_yMin) / pixelSpan);
+    // wait for every paint job to finish its current orbit, the pool
+    // threads stay up for the next start
+    for ( auto &job : _paintJobs )
+    {
+        job->Wait();
+    }
 
-    return true;
+    _paintJobs.clear();
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-bool nhImage::Paint( void )
+void FractalsApp::initResources()
 {
-    if ( p_colorData.empty() )
+    if ( _engine == GPU_ENGINE )
     {
-        p_colorData.resize( 4 * p_resX * p_resY, 0 );
-        return true;
+        CreateGpuEngine();
     }
 
-    return false;
+    if ( _deviceToneMap )
+    {
+        CreateDeviceToneMap();
+    }
+
+    if ( _engine == GPU_ENGINE && _verifyOrbits > 0 )
+    {
+        _gpuVerified = VerifyGpu( _verifyOrbits );
+    }
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-std::vector<unsigned char> nhNebulabrot::GetHeatPlot() const
+void FractalsApp::cleanupResources()
 {
-    auto hitPixels = p_colorData;
+    if ( _deviceToneMap )
+    {
+        DestroyDeviceToneMap();
+    }
 
-    uint32_t maxHits = 0u;
-    for ( size_t ii = 0; ii < hitPixels.size() / 4; ++ii )
+    if ( _engine == GPU_ENGINE )
     {
-        uint8_t *pixel = &hitPixels[4 * ii];
-        uint32_t hitCount = *reinterpret_cast<uint32_t *>(pixel);
-        if ( hitCount > maxHits )
-        {
-            maxHits = hitCount;
-        }
+        DestroyGpuEngine();
     }
+}
 
-    if ( maxHits != 0 )
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void RecordMemoryBarrier( VkCommandBuffer commandBuffer,
+                                 VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                                 VkPipelineStageFlags dstStage, VkAccessFlags dstAccess )
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier( commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::CreateGpuEngine()
+{
+    auto wp = GetWindowParams();
+    _gpu.hitsSize = static_cast<VkDeviceSize>(wp.width) * wp.height * sizeof( uint32_t );
+
+    // orbits and candidates of the last batch
+    const VkDeviceSize countersSize = 2 * sizeof( uint32_t );
+
+    createBuffer( _gpu.hitsSize,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  _gpu.hits, _gpu.hitsMemory );
+    createBuffer( countersSize,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  _gpu.counters, _gpu.countersMemory );
+    createBuffer( _gpu.hitsSize + countersSize,
+                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  _gpu.readback, _gpu.readbackMemory );
+    vkMapMemory( _device, _gpu.readbackMemory, 0, _gpu.hitsSize + countersSize, 0, &_gpu.readbackMapped );
+
+    createComputePipeline( "shaders/buddhabrot.spv", { _gpu.hits, _gpu.counters },
+                           sizeof( GpuSamplerParams ), _gpu.sampler );
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _computeCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if ( vkAllocateCommandBuffers( _device, &allocInfo, &_gpu.commands ) != VK_SUCCESS )
     {
-        for ( size_t ii = 0; ii < hitPixels.size() / 4; ++ii )
-        {
-            uint8_t *pixel = &hitPixels[4 * ii];
-            uint32_t hitCount = *reinterpret_cast<uint32_t *>(pixel);
-            if ( hitCount == 0 )
-            {
-                pixel[3] = 255;
-                continue;
-            }
-            float density = 1.0f * hitCount / maxHits;
-            density = std::pow( density, 0.85f );
-            // density *= 2.0f;
-            density = std::clamp( density, 0.0f, 1.0f );
-            uint8_t intensity = static_cast<uint8_t>(255 * density);
+        throw std::runtime_error( "failed to allocate gpu sampler command buffer!" );
+    }
 
-            if ( intensity != 0 )
-            {
-                pixel[0] = intensity;
-                pixel[1] = intensity;
-                pixel[2] = std::pow( (intensity / 255.0f), 0.85f ) * 255;
-            }
-            pixel[3] = 255;
-        }
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if ( vkCreateFence( _device, &fenceInfo, nullptr, &_gpu.fence ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create gpu sampler fence!" );
     }
 
-    return hitPixels;
+    BeginGpuCommands();
+    vkCmdFillBuffer( _gpu.commands, _gpu.hits, 0, VK_WHOLE_SIZE, 0 );
+    SubmitGpuCommands( true );
+
+    _gpu.pending = false;
+    _gpu.batch = 0;
+    _gpu.orbits = 0;
+    _gpu.candidates = 0;
 }
 
-// -------------------------------------------------------------------------- //
-// -------------------------------------------------------------------------- //
-int nhNebulabrot::IterationsToGetKnocked( int row, int col ) const
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::DestroyGpuEngine()
 {
-    int count = 0;
-    double cx = 0.0, cy = 0.0, x0 = 0.0, y0 = 0.0;
-    nhImage::PointAtPixel( row, col, cx, cy, nhImage::CENTER );
-    // Iteration of 0 under f(z) = z^2 + c //
-    while ( x0 * x0 + y0 * y0 < 4 && count < p_maxIter )
-    {
-        double fx = x0 * x0 - y0 * y0 + cx;
-        double fy = 2.0 * x0 * y0 + cy;
-        x0 = fx;
-        y0 = fy;
-        ++count;
-    }
-    return count;
+    CollectGpuBatch();
+
+    vkDestroyFence( _device, _gpu.fence, nullptr );
+    vkFreeCommandBuffers( _device, _computeCommandPool, 1, &_gpu.commands );
+    destroyComputePipeline( _gpu.sampler );
+
+    vkUnmapMemory( _device, _gpu.readbackMemory );
+    vkDestroyBuffer( _device, _gpu.readback, nullptr );
+    vkFreeMemory( _device, _gpu.readbackMemory, nullptr );
+    vkDestroyBuffer( _device, _gpu.counters, nullptr );
+    vkFreeMemory( _device, _gpu.countersMemory, nullptr );
+    vkDestroyBuffer( _device, _gpu.hits, nullptr );
+    vkFreeMemory( _device, _gpu.hitsMemory, nullptr );
+    _gpu = GpuEngine{};
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-void nhNebulabrot::GetAStartingPoint( double &x, double &y ) const
+void FractalsApp::BeginGpuCommands()
 {
-    x = 0.0;
-    y = 0.0;
+    vkResetCommandBuffer( _gpu.commands, 0 );
 
-    do
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if ( vkBeginCommandBuffer( _gpu.commands, &beginInfo ) != VK_SUCCESS )
     {
-        x = rand() / (float)RAND_MAX;
-        y = rand() / (float)RAND_MAX;
-        x = (p_xMax - p_xMin) * x + p_xMin;
-        y = (p_yMax - p_yMin) * y + p_yMin;
-    } while ( !PointHasOrbitBetween( x, y, p_minIter, p_maxIter ) );
+        throw std::runtime_error( "failed to begin recording gpu sampler commands!" );
+    }
 }
 
-// -------------------------------------------------------------------------- //
-// -------------------------------------------------------------------------- //
-bool nhNebulabrot::PointHasOrbitBetween( double cx,
-                                         double cy,
-                                         int minIter,
-                                         int maxIter )
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::SubmitGpuCommands( bool wait )
 {
-    bool circle_cond = (cx + 1) * (cx + 1) + cy * cy < 0.0625;
-
-    if ( circle_cond )
+    if ( vkEndCommandBuffer( _gpu.commands ) != VK_SUCCESS )
     {
-        return false;
+        throw std::runtime_error( "failed to record gpu sampler commands!" );
     }
 
-    double p = std::sqrt( (cx - 0.25) * (cx - 0.25) + cy * cy );
-    bool cardioid_cond = cx - (p - 2 * p * p + 0.25) < 0;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_gpu.commands;
 
-    if ( cardioid_cond )
+    vkResetFences( _device, 1, &_gpu.fence );
+    if ( vkQueueSubmit( _computeQueue, 1, &submitInfo, _gpu.fence ) != VK_SUCCESS )
     {
-        return false;
+        throw std::runtime_error( "failed to submit gpu sampler commands!" );
     }
 
-    double x0 = 0.0, y0 = 0.0;
-    int count = 0;
-    // Iteration of 0 under f(z) = z^2 + c //
-    while ( x0 * x0 + y0 * y0 < 4 && count < maxIter )
+    if ( wait )
     {
-        double fx = x0 * x0 - y0 * y0 + cx;
-        double fy = 2.0 * x0 * y0 + cy;
-        x0 = fx;
-        y0 = fy;
-        ++count;
+        vkWaitForFences( _device, 1, &_gpu.fence, VK_TRUE, UINT64_MAX );
     }
-
-    return (count >= minIter) && (count < maxIter);
 }
 
-// -------------------------------------------------------------------------- //
-// -------------------------------------------------------------------------- //
-bool nhNebulabrot::Paint( void )
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::DispatchGpuBatch()
 {
-    clock_t seed = clock();
-    srand( seed );
-
-    while ( !p_paused )
-    {
-        double cx = 0, cy = 0;
-        GetAStartingPoint( cx, cy );
+    CollectGpuBatch();
 
-        // Iteration of 0 under f(z) = z^2 + c //
-        int count = 0;
-        double x0 = 0.0, y0 = 0.0;
-        while ( x0 * x0 + y0 * y0 < 4 && count < p_maxIter )
-        {
-            ++count;
-
-            double fx = x0 * x0 - y0 * y0 + cx;
-            double fy = 2.0 * x0 * y0 + cy;
-            x0 = fx;
-            y0 = fy;
+    auto wp = GetWindowParams();
+    GpuSamplerParams params{};
+    params.viewport[0] = static_cast<float>(VIEW_XMIN);
+    params.viewport[1] = static_cast<float>(VIEW_XMAX);
+    params.viewport[2] = static_cast<float>(VIEW_YMIN);
+    params.viewport[3] = static_cast<float>(VIEW_YMAX);
+    params.resolution[0] = static_cast<int32_t>(wp.width);
+    params.resolution[1] = static_cast<int32_t>(wp.height);
+    params.minIter = _options.bands.empty() ? MIN_ITER : _options.bands[0].minIter;
+    params.maxIter = _options.bands.empty() ? MAX_ITER : _options.bands[0].maxIter;
+    params.seed = static_cast<uint32_t>(_seed ^ (_seed >> 32));
+    params.batch = _gpu.batch++;
+    params.samples = GPU_SAMPLES;
+
+    BeginGpuCommands();
+
+    // the counters restart from zero, and the previous batch's histogram
+    // writes land before this batch adds to them
+    vkCmdFillBuffer( _gpu.commands, _gpu.counters, 0, VK_WHOLE_SIZE, 0 );
+    RecordMemoryBarrier( _gpu.commands,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT );
+
+    recordDispatch( _gpu.commands, _gpu.sampler, &params, GPU_GROUPS );
+
+    RecordMemoryBarrier( _gpu.commands,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT );
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = _gpu.hitsSize;
+    copyRegion.size = 2 * sizeof( uint32_t );
+    vkCmdCopyBuffer( _gpu.commands, _gpu.counters, _gpu.readback, 1, &copyRegion );
+
+    RecordMemoryBarrier( _gpu.commands,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT );
+
+    SubmitGpuCommands( false );
+    _gpu.pending = true;
+}
 
-            int px = 0, py = 0;
-            if ( nhImage::PixelAtPoint( x0, y0, px, py ) )
-            {
-                // increase pixel brightness
-                uint8_t *pixel = &p_colorData[4 * (py * p_resX + px)];
-                uint32_t &hitCount = *reinterpret_cast<uint32_t *>(pixel);
-                ++hitCount;
-            }
-        }
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FractalsApp::CollectGpuBatch()
+{
+    if ( !_gpu.pending )
+    {
+        return;
     }
 
-    return true;
+    vkWaitForFences( _device, 1, &_gpu.fence, VK_TRUE, UINT64_MAX );
+
+    const uint32_t *counters = reinterpret_cast<const uint32_t *>(
+        static_cast<const unsigned char *>(_gpu.readbackMapped) + _gpu.hitsSize);
+    _gpu.orbits += counters[0];
+    _gpu.candidates += counters[1];
+    _gpu.pending = false;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-struct PaintJob
+void FractalsApp::ReadGpuHits( std::vector<uint32_t> &hits )
 {
-    PaintJob( nhNebulabrot *fractal ) : _fractal( fractal ) {}
+    CollectGpuBatch();
 
-    void operator()()
-    {
-        _fractal->Paint();
-    }
+    BeginGpuCommands();
+
+    RecordMemoryBarrier( _gpu.commands,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT );
 
-    nhNebulabrot *_fractal = nullptr;
-};
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = _gpu.hitsSize;
+    vkCmdCopyBuffer( _gpu.commands, _gpu.hits, _gpu.readback, 1, &copyRegion );
+
+    RecordMemoryBarrier( _gpu.commands,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT );
+
+    SubmitGpuCommands( true );
+
+    const uint32_t *mapped = static_cast<const uint32_t *>(_gpu.readbackMapped);
+    hits.assign( mapped, mapped + _gpu.hitsSize / sizeof( uint32_t ) );
+}
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-FractalsApp::FractalsApp()
+void FractalsApp::CreateDeviceToneMap()
 {
     auto wp = GetWindowParams();
-    auto width = wp.width;
-    auto height = wp.height;
+    const VkDeviceSize hitsSize = static_cast<VkDeviceSize>(wp.width) * wp.height * sizeof( uint32_t );
 
-    int minIter = 50;
-    int maxIter = 10000;
-    _fractal = std::make_unique<nhNebulabrot>( -2.0f, 1.0f, -1.0f, 1.0f, width, height, maxIter, minIter );
+    // the gpu engine's histogram is tone mapped where it is
+    VkBuffer hits = _gpu.hits;
+    if ( _engine == CPU_ENGINE )
+    {
+        createBuffer( hitsSize,
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                      _toneMap.hits, _toneMap.hitsMemory );
+        hits = _toneMap.hits;
+    }
 
-    StartPainting();
+    createBuffer( sizeof( uint32_t ),
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  _toneMap.stats, _toneMap.statsMemory );
+    createBuffer( hitsSize,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  _toneMap.pixels, _toneMap.pixelsMemory );
+
+    createComputePipeline( "shaders/tonemap.spv", { hits, _toneMap.stats, _toneMap.pixels },
+                           sizeof( ToneMapParams ), _toneMap.pipeline );
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _computeCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if ( vkAllocateCommandBuffers( _device, &allocInfo, &_toneMap.commands ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to allocate tone map command buffer!" );
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if ( vkCreateFence( _device, &fenceInfo, nullptr, &_toneMap.fence ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create tone map fence!" );
+    }
+
+    _toneMap.pending = false;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-FractalsApp::~FractalsApp()
+void FractalsApp::DestroyDeviceToneMap()
 {
-    PausePainting();
+    if ( _toneMap.pending )
+    {
+        vkWaitForFences( _device, 1, &_toneMap.fence, VK_TRUE, UINT64_MAX );
+    }
+
+    vkDestroyFence( _device, _toneMap.fence, nullptr );
+    vkFreeCommandBuffers( _device, _computeCommandPool, 1, &_toneMap.commands );
+    destroyComputePipeline( _toneMap.pipeline );
+
+    vkDestroyBuffer( _device, _toneMap.pixels, nullptr );
+    vkFreeMemory( _device, _toneMap.pixelsMemory, nullptr );
+    vkDestroyBuffer( _device, _toneMap.stats, nullptr );
+    vkFreeMemory( _device, _toneMap.statsMemory, nullptr );
+    if ( _toneMap.hits != VK_NULL_HANDLE )
+    {
+        vkDestroyBuffer( _device, _toneMap.hits, nullptr );
+        vkFreeMemory( _device, _toneMap.hitsMemory, nullptr );
+    }
+    _toneMap = DeviceToneMap{};
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-void FractalsApp::StartPainting()
+void FractalsApp::ToneMapOnDevice()
 {
-    _fractal->PausePaint( false );
-    assert( _paintJobs.empty() );
-    _paintJobs.emplace_back( PaintJob( _fractal.get() ) );
-    _paintJobs[0].detach();
+    auto wp = GetWindowParams();
+    const uint32_t count = wp.width * wp.height;
+    const VkDeviceSize hitsSize = static_cast<VkDeviceSize>(count) * sizeof( uint32_t );
+
+    // pixels and the command buffer are reused
+    if ( _toneMap.pending )
+    {
+        vkWaitForFences( _device, 1, &_toneMap.fence, VK_TRUE, UINT64_MAX );
+        _toneMap.pending = false;
+    }
+
+    // the worker histograms are summed straight into staging memory
+    StagingAllocation staging{};
+    if ( _engine == CPU_ENGINE )
+    {
+        staging = allocateStaging( hitsSize );
+        _fractal->GetHits( static_cast<uint32_t *>(staging.data) );
+    }
+
+    VkCommandBuffer commandBuffer = _toneMap.commands;
+    vkResetCommandBuffer( commandBuffer, 0 );
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if ( vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to begin recording tone map commands!" );
+    }
+
+    if ( _engine == CPU_ENGINE )
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = staging.offset;
+        copyRegion.dstOffset = 0;
+        copyRegion.size = hitsSize;
+        vkCmdCopyBuffer( commandBuffer, _stagingBuffer, _toneMap.hits, 1, &copyRegion );
+    }
+
+    // hit counts come from the copy above or from the sampler batches
+    vkCmdFillBuffer( commandBuffer, _toneMap.stats, 0, VK_WHOLE_SIZE, 0 );
+    RecordMemoryBarrier( commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT );
+
+    ToneMapParams params{ count, 0 };
+    recordDispatch( commandBuffer, _toneMap.pipeline, &params, TONE_MAP_REDUCE_GROUPS );
+
+    RecordMemoryBarrier( commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT );
+
+    params.pass = 1;
+    recordDispatch( commandBuffer, _toneMap.pipeline, &params,
+                    (count + TONE_MAP_GROUP_SIZE - 1) / TONE_MAP_GROUP_SIZE );
+
+    RecordMemoryBarrier( commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT );
+
+    recordTextureCopy( commandBuffer, _toneMap.pixels );
+
+    vkResetFences( _device, 1, &_toneMap.fence );
+    submitTextureWrite( commandBuffer, _toneMap.fence );
+    _toneMap.pending = true;
 }
 
 // -----------------------------------------------------------------------------
+// Both histograms are binned into blocks and normalized to densities. Orbits
+// deposit hundreds of correlated points each, so per pixel counting
+// statistics do not apply; the total variation distance between the block
+// densities is the pass criterion and the acceptance rates are reported next
+// to it as a second, independent check.
 // -----------------------------------------------------------------------------
-void FractalsApp::PausePainting()
+bool FractalsApp::VerifyGpu( uint64_t orbits )
 {
-    using namespace std::chrono_literals;
+    auto wp = GetWindowParams();
+    const int width = static_cast<int>(wp.width);
+    const int height = static_cast<int>(wp.height);
 
-    _fractal->PausePaint( true );
+    auto startTime = std::chrono::high_resolution_clock::now();
+    while ( _gpu.orbits < orbits )
+    {
+        DispatchGpuBatch();
+        CollectGpuBatch();
+    }
+    std::vector<uint32_t> gpuHits;
+    ReadGpuHits( gpuHits );
+    auto gpuTime = std::chrono::high_resolution_clock::now();
+
+    CreateFractal();
+    StartPainting();
+    while ( _fractal->OrbitCount() < orbits )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+    PausePainting();
+    std::vector<uint32_t> cpuHits = _fractal->GetHits();
+    auto cpuTime = std::chrono::high_resolution_clock::now();
+
+    const int blocksX = (width + VERIFY_BLOCK - 1) / VERIFY_BLOCK;
+    const int blocksY = (height + VERIFY_BLOCK - 1) / VERIFY_BLOCK;
+    std::vector<double> gpuBlocks( blocksX * blocksY, 0.0 );
+    std::vector<double> cpuBlocks( blocksX * blocksY, 0.0 );
+    double gpuTotal = 0.0, cpuTotal = 0.0;
+    for ( int py = 0; py < height; ++py )
+    {
+        for ( int px = 0; px < width; ++px )
+        {
+            int block = (py / VERIFY_BLOCK) * blocksX + px / VERIFY_BLOCK;
+            gpuBlocks[block] += gpuHits[py * width + px];
+            cpuBlocks[block] += cpuHits[py * width + px];
+        }
+    }
+    for ( size_t ii = 0; ii < gpuBlocks.size(); ++ii )
+    {
+        gpuTotal += gpuBlocks[ii];
+        cpuTotal += cpuBlocks[ii];
+    }
 
-    // wait for paint job to finish
-    std::this_thread::sleep_for( 1ms );
+    double distance = 1.0;
+    int occupied = 0;
+    if ( gpuTotal > 0.0 && cpuTotal > 0.0 )
+    {
+        distance = 0.0;
+        for ( size_t ii = 0; ii < gpuBlocks.size(); ++ii )
+        {
+            double p = gpuBlocks[ii] / gpuTotal;
+            double q = cpuBlocks[ii] / cpuTotal;
+            distance += 0.5 * std::fabs( p - q );
+            occupied += p + q > 0.0 ? 1 : 0;
+        }
+    }
 
-    // kill the thread
-    _paintJobs.clear();
+    nhNebulabrot::RejectionStats cpuStats = _fractal->GetRejectionStats();
+    uint64_t cpuOrbits = _fractal->OrbitCount();
+    double gpuRate = _gpu.candidates ? static_cast<double>(_gpu.orbits) / _gpu.candidates : 0.0;
+    double cpuRate = cpuStats.candidates ? static_cast<double>(cpuOrbits) / cpuStats.candidates : 0.0;
+    double pooled = static_cast<double>(_gpu.orbits + cpuOrbits) / std::max<uint64_t>( _gpu.candidates + cpuStats.candidates, 1 );
+    double rateError = std::sqrt( pooled * (1.0 - pooled) *
+                                  (1.0 / std::max<uint64_t>( _gpu.candidates, 1 ) +
+                                   1.0 / std::max<uint64_t>( cpuStats.candidates, 1 )) );
+    double rateZ = rateError > 0.0 ? (gpuRate - cpuRate) / rateError : 0.0;
+
+    float gpuMs = std::chrono::duration<float, std::chrono::milliseconds::period>( gpuTime - startTime ).count();
+    float cpuMs = std::chrono::duration<float, std::chrono::milliseconds::period>( cpuTime - gpuTime ).count();
+
+    bool passed = distance < _verifyTolerance;
+    std::cout << "gpu: " << _gpu.orbits << " orbits of " << _gpu.candidates << " candidates, "
+              << gpuTotal << " hits in " << gpuMs << " ms" << std::endl;
+    std::cout << "cpu: " << cpuOrbits << " orbits of " << cpuStats.candidates << " candidates, "
+              << cpuTotal << " hits in " << cpuMs << " ms" << std::endl;
+    std::cout << "acceptance rate gpu " << gpuRate << " cpu " << cpuRate << ", z " << rateZ << std::endl;
+    std::cout << "block densities (" << VERIFY_BLOCK << "x" << VERIFY_BLOCK << " px): total variation "
+              << distance << " over " << occupied << " occupied blocks" << std::endl;
+    std::cout << (passed ? "PASSED" : "FAILED") << ", tolerance " << _verifyTolerance << std::endl;
+
+    // the pool is joined before the histograms it paints go
+    _jobs.reset();
+    _fractal.reset();
+    return passed;
 }
 
 // -----------------------------------------------------------------------------
@@ -310,7 +607,17 @@ void FractalsApp::drawFrame()
 
     static float lastUpdateTime = 0.0f;
 
-    if ( time > lastUpdateTime + 1.0f )
+    // keeps one batch in flight, each frame waits for the previous one
+    if ( _engine == GPU_ENGINE )
+    {
+        DispatchGpuBatch();
+    }
+
+    // offscreen frames are read back, so each one shows the latest histogram.
+    // A histogram on the device is tone mapped there for every frame, while
+    // the cpu workers are asked for a snapshot once a second
+    bool everyFrame = isHeadless() || (_engine == GPU_ENGINE && _deviceToneMap);
+    if ( everyFrame || time > lastUpdateTime + 1.0f )
     {
         UpdatePixels( time );
         lastUpdateTime = time;
@@ -327,29 +634,250 @@ void FractalsApp::UpdatePixels( float time )
     uint32_t width = wp.width;
     uint32_t height = wp.height;
 
-    PausePainting();
+    if ( _deviceToneMap )
+    {
+        // the startup texture has its own size, the first refresh replaces
+        // it with a blank one the tone mapped pixels are copied into
+        VkExtent2D extent = textureExtent();
+        if ( extent.width != width || extent.height != height )
+        {
+            replaceTexture( std::vector<unsigned char>( 4 * static_cast<size_t>(width) * height, 0 ),
+                            width, height );
+        }
 
-    auto colorData = _fractal->GetHeatPlot();
+        ToneMapOnDevice();
+        return;
+    }
 
-    cleanupImageTexture();
-    createTextureImage( colorData, width, height );
-    createTextureImageView();
-    updateDescriptorSets();
-    vkFreeCommandBuffers( _device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data() );
-    createCommandBuffers();
+    _pixels.resize( 4 * static_cast<size_t>(width) * height );
+    if ( _engine == GPU_ENGINE )
+    {
+        ReadGpuHits( _hits );
+        _toneMapper.Map( _hits.data(), width, height, _pixels.data() );
+    }
+    else
+    {
+        _fractal->GetHeatPlot( _toneMapper, _pixels.data() );
+    }
 
-    StartPainting();
+    // the startup texture has its own size, after the first refresh the
+    // heat plot is written over the existing texture
+    VkExtent2D extent = textureExtent();
+    if ( extent.width == width && extent.height == height )
+    {
+        updateTexture( _pixels );
+    }
+    else
+    {
+        replaceTexture( _pixels, width, height );
+    }
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-int main()
+static void PrintUsage()
 {
-    FractalsApp app;
+    std::cerr << "usage: fractals [--threads N] [--seed N] [--metropolis] [--replay] "
+                 "[--band MIN:MAX[:RRGGBB]]... [--counter uint32|uint64|float] [--splat] "
+                 "[--tiled] [--batch-deposits] [--checkpoint FILE] [--gpu] [--host-tonemap] "
+                 "[--headless N] [--output FILE] [--verify-gpu N] [--verify-tolerance T] "
+                 "[--frame-timing] [--frame-trace FILE]\n"
+                 "       fractals --merge OUTPUT INPUT..." << std::endl;
+}
 
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    nhNebulabrot::Options options;
+    HeadlessParams headless;
+    bool runHeadless = false;
+    FractalsApp::ENGINE engine = FractalsApp::CPU_ENGINE;
+    uint64_t verifyOrbits = 0;
+    double verifyTolerance = 0.05;
+    bool deviceToneMap = true;
+    bool frameTiming = false;
+    std::string frameTraceFile;
     try
     {
-        app.run();
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--threads" && ii + 1 < argc )
+            {
+                options.workerCount = static_cast<unsigned>(std::min<uint64_t>(
+                    ParseUnsigned( arg, argv[++ii] ), std::numeric_limits<unsigned>::max() ));
+            }
+            else if ( arg == "--seed" && ii + 1 < argc )
+            {
+                options.seed = ParseUnsigned( arg, argv[++ii] );
+            }
+            else if ( arg == "--metropolis" )
+            {
+                options.sampler = nhNebulabrot::METROPOLIS;
+            }
+            else if ( arg == "--replay" )
+            {
+                options.replayOrbits = true;
+            }
+            else if ( arg == "--headless" && ii + 1 < argc )
+            {
+                runHeadless = true;
+                headless.frameCount = static_cast<uint32_t>(std::min<uint64_t>(
+                    ParseUnsigned( arg, argv[++ii] ), UINT32_MAX ));
+            }
+            else if ( arg == "--output" && ii + 1 < argc )
+            {
+                headless.outputFile = argv[++ii];
+            }
+            else if ( arg == "--gpu" )
+            {
+                engine = FractalsApp::GPU_ENGINE;
+            }
+            else if ( arg == "--verify-gpu" && ii + 1 < argc )
+            {
+                // draws no frames, only compares the engines
+                engine = FractalsApp::GPU_ENGINE;
+                verifyOrbits = ParseUnsigned( arg, argv[++ii] );
+                runHeadless = true;
+                headless.frameCount = 0;
+            }
+            else if ( arg == "--verify-tolerance" && ii + 1 < argc )
+            {
+                verifyTolerance = ParseDouble( arg, argv[++ii] );
+                if ( verifyTolerance <= 0.0 )
+                {
+                    throw std::runtime_error( "verify tolerance must be positive!" );
+                }
+            }
+            else if ( arg == "--frame-timing" )
+            {
+                frameTiming = true;
+            }
+            else if ( arg == "--frame-trace" && ii + 1 < argc )
+            {
+                // chrome://tracing or Perfetto json of the timed frames
+                frameTiming = true;
+                frameTraceFile = argv[++ii];
+            }
+            else if ( arg == "--host-tonemap" )
+            {
+                deviceToneMap = false;
+            }
+            else if ( arg == "--counter" && ii + 1 < argc )
+            {
+                std::string counter( argv[++ii] );
+                if ( counter == "uint32" )
+                {
+                    options.counter = nhNebulabrot::COUNT_UINT32;
+                }
+                else if ( counter == "uint64" )
+                {
+                    options.counter = nhNebulabrot::COUNT_UINT64;
+                }
+                else if ( counter == "float" )
+                {
+                    options.counter = nhNebulabrot::COUNT_FLOAT;
+                }
+                else
+                {
+                    throw std::runtime_error( "unknown counter " + counter + "!" );
+                }
+            }
+            else if ( arg == "--splat" )
+            {
+                // anti-aliased at native resolution, on float counts
+                options.deposit = nhNebulabrot::BILINEAR;
+                options.counter = nhNebulabrot::COUNT_FLOAT;
+            }
+            else if ( arg == "--tiled" )
+            {
+                options.layout = nhHistogramLayout::TILED;
+            }
+            else if ( arg == "--batch-deposits" )
+            {
+                options.batchDeposits = true;
+            }
+            else if ( arg == "--checkpoint" && ii + 1 < argc )
+            {
+                options.checkpointFile = argv[++ii];
+            }
+            else if ( arg == "--merge" && ii + 2 < argc )
+            {
+                // --merge OUTPUT INPUT... sums checkpoint files and exits
+                std::string output = argv[++ii];
+                std::vector<std::string> inputs( argv + ii + 1, argv + argc );
+                nhCheckpoint::Merge( inputs, output );
+                return 0;
+            }
+            else if ( arg == "--band" && ii + 1 < argc )
+            {
+                // repeated for each band, e.g. the classic nebulabrot
+                // --band 50:10000:ff0000 --band 50:1000:00ff00 --band 50:200:0000ff
+                options.bands.push_back( nhNebulabrot::ParseBand( argv[++ii] ) );
+            }
+            else
+            {
+                // an unknown flag, or a known one missing its value
+                std::cerr << "unknown argument " << arg << std::endl;
+                PrintUsage();
+                return 1;
+            }
+        }
+
+        if ( engine == FractalsApp::GPU_ENGINE && options.sampler != nhNebulabrot::UNIFORM )
+        {
+            throw std::runtime_error( "the gpu engine only samples uniformly!" );
+        }
+
+        if ( engine == FractalsApp::GPU_ENGINE && options.bands.size() > 1 )
+        {
+            throw std::runtime_error( "the gpu engine only samples a single band!" );
+        }
+
+        // the device pass maps a single band, several are composed on the host
+        if ( deviceToneMap && options.bands.size() > 1 )
+        {
+            std::cout << "composing " << options.bands.size() << " bands on the host" << std::endl;
+            deviceToneMap = false;
+        }
+
+        // the gpu engine keeps its own 32 bit row major histogram in device
+        // memory, a checkpoint file would be created and never written
+        if ( engine == FractalsApp::GPU_ENGINE &&
+             (!options.checkpointFile.empty() || options.counter != nhNebulabrot::COUNT_UINT32 ||
+              options.deposit != nhNebulabrot::NEAREST || options.layout != nhHistogramLayout::ROW_MAJOR ||
+              options.batchDeposits) )
+        {
+            throw std::runtime_error( "--checkpoint, --counter, --splat, --tiled and --batch-deposits "
+                                      "need the cpu engine!" );
+        }
+
+        FractalsApp app( options, engine, deviceToneMap );
+        app.VerifyGpuOnStart( verifyOrbits, verifyTolerance );
+        if ( frameTiming )
+        {
+            app.enableFrameTiming( frameTraceFile );
+        }
+        if ( app.Resumed() )
+        {
+            std::cout << "resuming " << options.checkpointFile << " at "
+                      << app.OrbitCount() << " orbits" << std::endl;
+        }
+
+        if ( runHeadless )
+        {
+            app.runHeadless( headless );
+        }
+        else
+        {
+            app.run();
+        }
+
+        if ( verifyOrbits > 0 )
+        {
+            return app.GpuVerified() ? 0 : 1;
+        }
     }
     catch ( const std::exception &e )
     {
@@ -358,4 +886,4 @@ int main()
     }
 
     return 0;
-}
\ No newline at end of file
+}
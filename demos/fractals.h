@@ -1,137 +1,198 @@
-#include <atomic>
+#include <memory>
+#include <string>
 #include <vector>
-#include <thread>
 #include <cassert>
 
 #include "../vulkanApp.h"
+#include "nebulabrot.h"
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
-class nhImage
+class FractalsApp : public VulkanApp
 {
 public:
 
-    nhImage() = delete;
-
-    nhImage( double xmin, double xmax,
-             double ymin, double ymax,
-             int resX, int resY )
-        : p_xMin( xmin ),
-          p_xMax( xmax ),
-          p_yMin( ymin ),
-          p_yMax( ymax ),
-          p_resX( resX ),
-          p_resY( resY )
-    {
-        Paint();
-    }
-
-    virtual ~nhImage() = default;
-
-    enum PIXEL_CORNER
+    // where orbits are sampled
+    enum ENGINE
     {
-        CENTER,
-        LOWER_LEFT,
-        LOWER_RIGHT,
-        UPPER_RIGHT,
-        UPPER_LEFT,
+        // nhNebulabrot worker threads
+        CPU_ENGINE,
+        // shaders/buddhabrot.comp, uniform sampling of at most one band in
+        // single precision, one batch dispatched per frame
+        GPU_ENGINE,
     };
 
-    // initializes pixels of the image
-    virtual bool Paint( void );
-
-    // Gets the point (x,y) lying on pixel px, py which
-    // corresponds to coordinate of the provided pixel corner
-    bool PointAtPixel( const int px, const int py,
-                       double &x, double &y,
-                       const PIXEL_CORNER loc = CENTER ) const;
-
-    // Gets the pixel lying on point
-    bool PixelAtPoint( const double x, const double y,
-                       int &px, int &py ) const;
-
-    std::vector<uint8_t> &Pixels() { return p_colorData; }
-
-protected:
-
-    // pixel color info
-    std::vector<uint8_t> p_colorData;
-
-    // Geometry corresponding to image
-    double  p_xMin;
-    double  p_xMax;
-    double  p_yMin;
-    double  p_yMax;
-
-    // Image resolution
-    int     p_resX;
-    int     p_resY;
-};
+    // with deviceToneMap the histogram is turned into pixels by a compute
+    // pass, otherwise by nhToneMapper and uploaded. Several iteration bands
+    // are composed by nhToneMapper and throw std::runtime_error with
+    // deviceToneMap
+    explicit FractalsApp( const nhNebulabrot::Options &options,
+                          ENGINE engine = CPU_ENGINE,
+                          bool deviceToneMap = true );
+    virtual ~FractalsApp();
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-class nhNebulabrot : public nhImage
-{
-public:
+    virtual WindowParams GetWindowParams() const override;
 
-    nhNebulabrot( double xmin, double xmax,
-                  double ymin, double ymax,
-                  int resX, int resY, int maxIter, int minIter )
-        : nhImage( xmin, xmax, ymin, ymax, resX, resY ),
-          p_maxIter( maxIter ),
-          p_minIter( minIter )
+    // with orbits > 0, both engines sample that many orbits as soon as the
+    // device is up and their histograms are compared, see VerifyGpu
+    void VerifyGpuOnStart( uint64_t orbits, double tolerance )
     {
-        assert( minIter < maxIter );
+        _verifyOrbits = orbits;
+        _verifyTolerance = tolerance;
     }
 
-    virtual ~nhNebulabrot() = default;
-
-    // Manipulates the color space so that to represent each pixel
-    // belonging or not belonging to the mandelbrot set.
-    bool Paint( void ) override;
-
-    void PausePaint( bool flag ) { p_paused = flag; }
-
-    std::vector<unsigned char> GetHeatPlot() const;
-private:
+    bool GpuVerified() const { return _gpuVerified; }
 
-    int IterationsToGetKnocked( int row, int col ) const;
-    static bool PointHasOrbitBetween( double cx,
-                                      double cy,
-                                      int minIter,
-                                      int maxIter );
-    void GetAStartingPoint( double &x, double &y ) const;
+    bool Resumed() const { return _fractal && _fractal->Resumed(); }
+    uint64_t OrbitCount() const { return _fractal ? _fractal->OrbitCount() : _gpu.orbits; }
 
-    int p_maxIter;
-    int p_minIter;
+protected:
 
-    std::atomic_bool p_paused = false;
-};
+    virtual void drawFrame() override;
+    virtual void initResources() override;
+    virtual void cleanupResources() override;
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-class FractalsApp : public VulkanApp
-{
-public:
+private:
 
-    FractalsApp();
-    virtual ~FractalsApp();
+    // plane region shown and band of orbit lengths kept, shared by engines
+    static constexpr double VIEW_XMIN = -2.0;
+    static constexpr double VIEW_XMAX = 1.0;
+    static constexpr double VIEW_YMIN = -1.0;
+    static constexpr double VIEW_YMAX = 1.0;
+    static constexpr int    MIN_ITER = 50;
+    static constexpr int    MAX_ITER = 10000;
+
+    // gpu batch: GPU_GROUPS workgroups of GPU_GROUP_SIZE invocations, each
+    // drawing GPU_SAMPLES starting points
+    static constexpr uint32_t GPU_GROUP_SIZE = 64;
+    static constexpr uint32_t GPU_GROUPS = 256;
+    static constexpr uint32_t GPU_SAMPLES = 16;
+
+    // tone mapping: pass 0 reduces the maximum with a fixed number of
+    // workgroups, pass 1 runs one invocation per pixel
+    static constexpr uint32_t TONE_MAP_GROUP_SIZE = 256;
+    static constexpr uint32_t TONE_MAP_REDUCE_GROUPS = 64;
+
+    // histograms are compared over blocks of VERIFY_BLOCK^2 pixels
+    static constexpr int      VERIFY_BLOCK = 16;
+
+    // push constants of shaders/buddhabrot.comp
+    struct GpuSamplerParams
+    {
+        float    viewport[4];
+        int32_t  resolution[2];
+        int32_t  minIter;
+        int32_t  maxIter;
+        uint32_t seed;
+        uint32_t batch;
+        uint32_t samples;
+    };
 
-    virtual WindowParams GetWindowParams() const override;
+    // push constants of shaders/tonemap.comp
+    struct ToneMapParams
+    {
+        uint32_t count;
+        uint32_t pass;
+    };
 
-protected:
+    // device heat plot. The hit counts, uploaded for the cpu engine and the
+    // gpu engine's own histogram otherwise, are mapped to packed rgba8 in
+    // pixels, which is then copied into the texture
+    struct DeviceToneMap
+    {
+        ComputePipeline pipeline;
+        VkBuffer        hits = VK_NULL_HANDLE;
+        VkDeviceMemory  hitsMemory = VK_NULL_HANDLE;
+        VkBuffer        stats = VK_NULL_HANDLE;
+        VkDeviceMemory  statsMemory = VK_NULL_HANDLE;
+        VkBuffer        pixels = VK_NULL_HANDLE;
+        VkDeviceMemory  pixelsMemory = VK_NULL_HANDLE;
+        VkCommandBuffer commands = VK_NULL_HANDLE;
+        VkFence         fence = VK_NULL_HANDLE;
+        bool            pending = false;
+    };
 
-    virtual void drawFrame() override;
+    // device side of the gpu engine. Histogram and per batch counters stay
+    // in device memory and are copied to the host visible readback buffer,
+    // the counters after every batch and the histogram when displayed
+    struct GpuEngine
+    {
+        ComputePipeline sampler;
+        VkBuffer        hits = VK_NULL_HANDLE;
+        VkDeviceMemory  hitsMemory = VK_NULL_HANDLE;
+        VkBuffer        counters = VK_NULL_HANDLE;
+        VkDeviceMemory  countersMemory = VK_NULL_HANDLE;
+        VkBuffer        readback = VK_NULL_HANDLE;
+        VkDeviceMemory  readbackMemory = VK_NULL_HANDLE;
+        void           *readbackMapped = nullptr;
+        VkDeviceSize    hitsSize = 0;
+        VkCommandBuffer commands = VK_NULL_HANDLE;
+        VkFence         fence = VK_NULL_HANDLE;
+        bool            pending = false;   // submitted, counters not collected
+        uint32_t        batch = 0;
+        uint64_t        orbits = 0;
+        uint64_t        candidates = 0;
+    };
 
-private:
+    // the cpu engine's fractal and its worker pool
+    void CreateFractal();
 
     void PausePainting();
     void StartPainting();
 
     void UpdatePixels( float time );
 
-    std::unique_ptr<nhNebulabrot> _fractal;
-    std::vector<std::thread>      _paintJobs;
+    void CreateGpuEngine();
+    void DestroyGpuEngine();
+
+    // records into the gpu command buffer, which is submitted on the
+    // compute queue and signals the gpu fence
+    void BeginGpuCommands();
+    void SubmitGpuCommands( bool wait );
+
+    // submits the next gpu batch once the one in flight is done
+    void DispatchGpuBatch();
+
+    // waits for the batch in flight and adds its counters to the totals
+    void CollectGpuBatch();
+
+    void ReadGpuHits( std::vector<uint32_t> &hits );
+
+    void CreateDeviceToneMap();
+    void DestroyDeviceToneMap();
+
+    // tone maps the current histogram into the texture on the device, the
+    // host only sums (cpu engine) or never sees (gpu engine) the hit counts
+    void ToneMapOnDevice();
+
+    // samples the same number of orbits on both engines and checks that the
+    // histograms agree within the tolerance on total variation distance
+    bool VerifyGpu( uint64_t orbits );
+
+    // of the cpu engine, whose fractal the gpu engine only has while
+    // VerifyGpu runs
+    nhNebulabrot::Options               _options;
+
+    // one long running job per fractal worker on a pool as large, started
+    // once. Declared after _fractal so the pool is joined first
+    std::unique_ptr<nhNebulabrot>       _fractal;
+    std::unique_ptr<nhJobSystem>        _jobs;
+    std::vector<std::shared_ptr<nhJob>> _paintJobs;
+
+    // host tone mapping, buffers are kept from one refresh to the next.
+    // Only the gpu engine's hit counts go through _hits
+    nhToneMapper                  _toneMapper;
+    std::vector<uint32_t>         _hits;
+    std::vector<unsigned char>    _pixels;
+
+    ENGINE          _engine;
+    uint64_t        _seed;
+    GpuEngine       _gpu;
+    bool            _deviceToneMap;
+    DeviceToneMap   _toneMap;
+    uint64_t        _verifyOrbits = 0;
+    double          _verifyTolerance = 0.0;
+    bool            _gpuVerified = false;
 };
 
 // -----------------------------------------------------------------------------
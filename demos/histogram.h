@@ -0,0 +1,295 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+// -----------------------------------------------------------------------------
+// Order of the counts within one layer. Orbit points scatter over the whole
+// image, so row major deposits touch a new cache line, and past a few
+// thousand pixels across a new page, almost every time. TILED stores tiles of
+// TILE x TILE pixels back to back, each in Morton order, so points close in
+// the plane are close in memory too. Width and height are then padded to
+// whole tiles.
+// -----------------------------------------------------------------------------
+class nhHistogramLayout
+{
+public:
+
+    enum LAYOUT
+    {
+        ROW_MAJOR,
+        TILED,
+    };
+
+    static constexpr uint32_t TILE_BITS = 6;
+    static constexpr uint32_t TILE = 1u << TILE_BITS;
+
+    // moves the bits of v < 256 to the even bit positions
+    static uint32_t Spread( uint32_t v )
+    {
+        v = (v | (v << 4)) & 0x0f0fu;
+        v = (v | (v << 2)) & 0x3333u;
+        v = (v | (v << 1)) & 0x5555u;
+        return v;
+    }
+
+    // offset of pixel x, y of a tile within it
+    static uint32_t Morton( uint32_t x, uint32_t y )
+    {
+        return Spread( x ) | (Spread( y ) << 1);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// layers histograms of width * height counts stored back to back, each in
+// the order of a LAYOUT. Count picks the memory and precision trade-off:
+// uint32_t counts saturate after 4G hits on one pixel, uint64_t counts never
+// do in practice at twice the memory, and float counts take fractional
+// weights but stop growing past 2^24 on one pixel. The counts are owned, or live in storage owned by
+// someone else such as a memory mapped file, which must then be row major.
+// -----------------------------------------------------------------------------
+template <class Count>
+class nhHistogram : public nhHistogramLayout
+{
+public:
+
+    static_assert( std::is_arithmetic<Count>::value, "counts are numbers" );
+
+    using CountType = Count;
+
+    nhHistogram() = default;
+
+    // owns zeroed counts
+    nhHistogram( uint32_t width, uint32_t height, uint32_t layers = 1,
+                 LAYOUT layout = ROW_MAJOR )
+        : p_width( width ),
+          p_height( height ),
+          p_layers( layers ),
+          p_layout( layout ),
+          p_tilesX( (width + TILE - 1) >> TILE_BITS )
+    {
+        size_t tilesY = (height + TILE - 1) >> TILE_BITS;
+        p_layerSize = layout == TILED ? p_tilesX * tilesY * TILE * TILE
+                                      : static_cast<size_t>(width) * height;
+        p_storage.assign( p_layerSize * layers, Count( 0 ) );
+        p_counts = p_storage.data();
+    }
+
+    // counts owned by the caller, which keeps them alive
+    nhHistogram( Count *counts, uint32_t width, uint32_t height, uint32_t layers = 1 )
+        : p_counts( counts ),
+          p_width( width ),
+          p_height( height ),
+          p_layers( layers ),
+          p_layerSize( static_cast<size_t>(width) * height )
+    {
+    }
+
+    // a copy would share or duplicate the counts depending on who owns them
+    nhHistogram( const nhHistogram & ) = delete;
+    nhHistogram &operator=( const nhHistogram & ) = delete;
+    nhHistogram( nhHistogram && ) = default;
+    nhHistogram &operator=( nhHistogram && ) = default;
+
+    uint32_t Width() const { return p_width; }
+    uint32_t Height() const { return p_height; }
+    uint32_t Layers() const { return p_layers; }
+    LAYOUT Layout() const { return p_layout; }
+
+    // counts per layer, padding included
+    size_t LayerSize() const { return p_layerSize; }
+    size_t Size() const { return p_layerSize * p_layers; }
+
+    Count *Data() { return p_counts; }
+    const Count *Data() const { return p_counts; }
+    Count *Layer( uint32_t layer ) { return p_counts + layer * LayerSize(); }
+    const Count *Layer( uint32_t layer ) const { return p_counts + layer * LayerSize(); }
+
+    Count &operator[]( size_t index ) { return p_counts[index]; }
+    Count operator[]( size_t index ) const { return p_counts[index]; }
+
+    bool SameShape( uint32_t width, uint32_t height, uint32_t layers ) const
+    {
+        return p_width == width && p_height == height && p_layers == layers;
+    }
+
+    // index of pixel x, y within a layer
+    size_t Index( uint32_t x, uint32_t y ) const
+    {
+        if ( p_layout == ROW_MAJOR )
+        {
+            return static_cast<size_t>(y) * p_width + x;
+        }
+
+        size_t tile = static_cast<size_t>(y >> TILE_BITS) * p_tilesX + (x >> TILE_BITS);
+        return (tile << (2 * TILE_BITS)) | Morton( x & (TILE - 1), y & (TILE - 1) );
+    }
+
+    // one more hit, integer counts stick at their largest value
+    void Increment( size_t index )
+    {
+        if constexpr ( std::is_integral<Count>::value )
+        {
+            p_counts[index] += p_counts[index] != std::numeric_limits<Count>::max();
+        }
+        else
+        {
+            p_counts[index] += Count( 1 );
+        }
+    }
+
+    // a fractional hit, for float counts
+    void Add( size_t index, Count weight )
+    {
+        static_assert( std::is_floating_point<Count>::value, "integer counts take whole hits" );
+        p_counts[index] += weight;
+    }
+
+    void Clear()
+    {
+        std::fill( p_counts, p_counts + Size(), Count( 0 ) );
+    }
+
+    // adds count counts of another type from source, integer sums saturate
+    template <class Other>
+    static void Accumulate( Count *sum, const Other *source, size_t count )
+    {
+        for ( size_t ii = 0; ii < count; ++ii )
+        {
+            AddCount( sum[ii], source[ii] );
+        }
+    }
+
+    // adds the counts of every layer to sum, width * height * layers counts
+    // in row major order whatever the layout of this histogram
+    template <class Sum>
+    void AddTo( Sum *sum ) const
+    {
+        if ( p_layout == ROW_MAJOR )
+        {
+            nhHistogram<Sum>::Accumulate( sum, p_counts, Size() );
+            return;
+        }
+
+        // tile by tile, so the reads stream and the writes stay within
+        // TILE rows of sum
+        for ( uint32_t layer = 0; layer < p_layers; ++layer )
+        {
+            const Count *tile = Layer( layer );
+            Sum *rows = sum + layer * static_cast<size_t>(p_width) * p_height;
+            for ( uint32_t y0 = 0; y0 < p_height; y0 += TILE )
+            {
+                for ( uint32_t x0 = 0; x0 < p_width; x0 += TILE, tile += TILE * TILE )
+                {
+                    const uint32_t height = std::min( TILE, p_height - y0 );
+                    const uint32_t width = std::min( TILE, p_width - x0 );
+                    for ( uint32_t y = 0; y < height; ++y )
+                    {
+                        Sum *row = rows + static_cast<size_t>(y0 + y) * p_width + x0;
+                        for ( uint32_t x = 0; x < width; ++x )
+                        {
+                            nhHistogram<Sum>::AddCount( row[x], tile[Morton( x, y )] );
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // sum += value, integer sums saturate
+    template <class Other>
+    static void AddCount( Count &sum, Other value )
+    {
+        if constexpr ( std::is_integral<Count>::value )
+        {
+            Count total = sum + static_cast<Count>(value);
+            sum = total < sum ? std::numeric_limits<Count>::max() : total;
+        }
+        else
+        {
+            sum += static_cast<Count>(value);
+        }
+    }
+
+private:
+
+    std::vector<Count> p_storage;
+    Count             *p_counts = nullptr;
+    uint32_t           p_width = 0;
+    uint32_t           p_height = 0;
+    uint32_t           p_layers = 0;
+    LAYOUT             p_layout = ROW_MAJOR;
+    size_t             p_tilesX = 0;
+    size_t             p_layerSize = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Deposits of one worker held back and applied in index order, so that a
+// batch sweeps the histogram once from front to back instead of jumping all
+// over it, and hits on nearby counts share the cache lines and pages already
+// loaded. Indices are 32 bits, histograms of up to 4G counts.
+// -----------------------------------------------------------------------------
+class nhDepositBatch
+{
+public:
+
+    // radix sort digit
+    static constexpr uint32_t DIGIT_BITS = 11;
+
+    void Reserve( size_t count )
+    {
+        p_indices.reserve( count );
+        p_scratch.reserve( count );
+    }
+
+    void Add( size_t index ) { p_indices.push_back( static_cast<uint32_t>(index) ); }
+
+    size_t Size() const { return p_indices.size(); }
+    bool Empty() const { return p_indices.empty(); }
+
+    // increments hits at each held back index, in order, and empties the batch
+    template <class Count>
+    void Apply( nhHistogram<Count> &hits )
+    {
+        Sort( hits.Size() );
+        for ( uint32_t index : p_indices )
+        {
+            hits.Increment( index );
+        }
+        p_indices.clear();
+    }
+
+private:
+
+    // least significant digit first radix sort, only over the digits
+    // indices below size can have
+    void Sort( size_t size )
+    {
+        const size_t count = p_indices.size();
+        p_scratch.resize( count );
+        for ( uint32_t shift = 0; shift < 32 && (size - 1) >> shift != 0; shift += DIGIT_BITS )
+        {
+            uint32_t offsets[(1u << DIGIT_BITS) + 1] = {};
+            for ( uint32_t index : p_indices )
+            {
+                ++offsets[((index >> shift) & ((1u << DIGIT_BITS) - 1)) + 1];
+            }
+            for ( uint32_t digit = 1; digit <= (1u << DIGIT_BITS); ++digit )
+            {
+                offsets[digit] += offsets[digit - 1];
+            }
+            for ( uint32_t index : p_indices )
+            {
+                p_scratch[offsets[(index >> shift) & ((1u << DIGIT_BITS) - 1)]++] = index;
+            }
+            p_indices.swap( p_scratch );
+        }
+    }
+
+    std::vector<uint32_t> p_indices;
+    std::vector<uint32_t> p_scratch;
+};
@@ -0,0 +1,153 @@
+#include <algorithm>
+
+#include "jobSystem.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhJob::Wait()
+{
+    std::unique_lock<std::mutex> lock( p_mutex );
+    p_finished.wait( lock, [this] { return Done(); } );
+    if ( p_error )
+    {
+        std::rethrow_exception( p_error );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhJob::Finish( std::exception_ptr error )
+{
+    {
+        std::lock_guard<std::mutex> lock( p_mutex );
+        p_error = error;
+        p_task = nullptr;
+        p_done.store( true, std::memory_order_release );
+    }
+    p_finished.notify_all();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhJobSystem::nhJobSystem( unsigned threads )
+{
+    if ( threads == 0 )
+    {
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    p_threads.reserve( threads );
+    for ( unsigned ii = 0; ii < threads; ++ii )
+    {
+        p_threads.emplace_back( [this] { Run(); } );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhJobSystem::~nhJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock( p_mutex );
+        p_shutdown = true;
+        for ( auto &job : p_queue )
+        {
+            job->RequestStop();
+        }
+        for ( auto &job : p_running )
+        {
+            job->RequestStop();
+        }
+    }
+    p_wake.notify_all();
+
+    for ( auto &thread : p_threads )
+    {
+        thread.join();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+std::shared_ptr<nhJob> nhJobSystem::Submit( Task task )
+{
+    auto job = std::make_shared<nhJob>();
+    job->p_task = std::move( task );
+    {
+        std::lock_guard<std::mutex> lock( p_mutex );
+        p_queue.push_back( job );
+    }
+    p_wake.notify_one();
+    return job;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhJobSystem::StopAll()
+{
+    std::vector<std::shared_ptr<nhJob>> jobs;
+    {
+        std::lock_guard<std::mutex> lock( p_mutex );
+        jobs.assign( p_queue.begin(), p_queue.end() );
+        jobs.insert( jobs.end(), p_running.begin(), p_running.end() );
+    }
+
+    for ( auto &job : jobs )
+    {
+        job->RequestStop();
+    }
+
+    // a failed task was the submitter's to handle
+    for ( auto &job : jobs )
+    {
+        try
+        {
+            job->Wait();
+        }
+        catch ( ... )
+        {
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhJobSystem::Run()
+{
+    while ( true )
+    {
+        std::shared_ptr<nhJob> job;
+        {
+            std::unique_lock<std::mutex> lock( p_mutex );
+            p_wake.wait( lock, [this] { return p_shutdown || !p_queue.empty(); } );
+
+            // on shutdown the queue is drained, its tasks are dropped below
+            if ( p_queue.empty() )
+            {
+                return;
+            }
+            job = std::move( p_queue.front() );
+            p_queue.pop_front();
+            p_running.push_back( job );
+        }
+
+        std::exception_ptr error;
+        if ( !job->StopRequested() )
+        {
+            try
+            {
+                job->p_task( *job );
+            }
+            catch ( ... )
+            {
+                error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( p_mutex );
+            p_running.erase( std::find( p_running.begin(), p_running.end(), job ) );
+        }
+        job->Finish( error );
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+// -----------------------------------------------------------------------------
+// One task submitted to nhJobSystem, shared by the submitter and the pool
+// thread running it. Cancellation is cooperative in the manner of
+// std::stop_token: RequestStop only raises a flag the task polls through
+// StopRequested, a task that is still queued is dropped without running.
+// The task reports its progress in units of its own choosing.
+// -----------------------------------------------------------------------------
+class nhJob
+{
+public:
+
+    // submitter side
+
+    void RequestStop() { p_stop.store( true, std::memory_order_relaxed ); }
+
+    // blocks until the task has returned or was dropped, and rethrows what
+    // it threw
+    void Wait();
+
+    bool Done() const { return p_done.load( std::memory_order_acquire ); }
+
+    uint64_t Progress() const { return p_progress.load( std::memory_order_relaxed ); }
+
+    // task side
+
+    bool StopRequested() const { return p_stop.load( std::memory_order_relaxed ); }
+
+    void SetProgress( uint64_t progress ) { p_progress.store( progress, std::memory_order_relaxed ); }
+    void AddProgress( uint64_t units ) { p_progress.fetch_add( units, std::memory_order_relaxed ); }
+
+private:
+
+    friend class nhJobSystem;
+
+    void Finish( std::exception_ptr error );
+
+    std::function<void( nhJob & )> p_task;
+    std::atomic_bool               p_stop = false;
+    std::atomic_bool               p_done = false;
+    std::atomic<uint64_t>          p_progress{ 0 };
+    std::exception_ptr             p_error;
+    std::mutex                     p_mutex;
+    std::condition_variable        p_finished;
+};
+
+// -----------------------------------------------------------------------------
+// Fixed pool of threads running submitted tasks in order. The threads are
+// started once, so handing work to the pool costs a queue push instead of a
+// thread start. The destructor asks every task to stop, drops the queued
+// ones and joins the threads, so nothing a task touches may be destroyed
+// before the pool.
+// -----------------------------------------------------------------------------
+class nhJobSystem
+{
+public:
+
+    using Task = std::function<void( nhJob & )>;
+
+    // 0 sizes the pool to the hardware concurrency
+    explicit nhJobSystem( unsigned threads = 0 );
+    ~nhJobSystem();
+
+    nhJobSystem( const nhJobSystem & ) = delete;
+    nhJobSystem &operator=( const nhJobSystem & ) = delete;
+
+    unsigned Threads() const { return static_cast<unsigned>(p_threads.size()); }
+
+    // queues task, which runs as soon as a thread is free. Long running
+    // tasks hold their thread until they stop, a pool of n threads runs at
+    // most n of them at once
+    std::shared_ptr<nhJob> Submit( Task task );
+
+    // asks every queued and running task to stop and waits for all of them
+    void StopAll();
+
+private:
+
+    void Run();
+
+    std::vector<std::thread>            p_threads;
+    std::deque<std::shared_ptr<nhJob>>  p_queue;
+    std::vector<std::shared_ptr<nhJob>> p_running;
+    std::mutex                          p_mutex;
+    std::condition_variable             p_wake;
+    bool                                p_shutdown = false;
+};
@@ -0,0 +1,191 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "checkpoint.h"
+#include "toneMapper.h"
+#include "../imageWriter.h"
+
+// -----------------------------------------------------------------------------
+// Sums nhCheckpoint shards written by fractals --checkpoint on any number of
+// machines into one merged file and writes its heat plot, or for several
+// iteration bands their colored composition, as a PNG:
+//
+//   mergeShards [--threads N] [--png FILE] [--color RRGGBB]... OUTPUT SHARD...
+//
+// The PNG defaults to OUTPUT.png, band n to the n-th --color and otherwise
+// to the n-th entry of DEFAULT_COLORS.
+// -----------------------------------------------------------------------------
+
+static const uint32_t DEFAULT_COLORS[nhCheckpoint::MAX_BANDS] =
+{
+    0xff0000, 0x00ff00, 0x0000ff, 0xffff00, 0x00ffff, 0xff00ff, 0xff8000, 0xffffff
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static nhToneMapper::Color ToColor( uint32_t rgb )
+{
+    return { ((rgb >> 16) & 0xff) / 255.0f, ((rgb >> 8) & 0xff) / 255.0f, (rgb & 0xff) / 255.0f };
+}
+
+// -----------------------------------------------------------------------------
+// Whole of text as an unsigned number in base, throws std::runtime_error on
+// anything else
+// -----------------------------------------------------------------------------
+static unsigned long ParseUnsigned( const std::string &text, int base )
+{
+    size_t end = 0;
+    unsigned long value = 0;
+    try
+    {
+        value = std::stoul( text, &end, base );
+    }
+    catch ( const std::exception & )
+    {
+        end = 0;
+    }
+    if ( end == 0 || end != text.size() || text[0] == '-' )
+    {
+        throw std::runtime_error( "invalid number " + text + "!" );
+    }
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void PrintUsage()
+{
+    std::cerr << "usage: mergeShards [--threads N] [--png FILE] [--color RRGGBB]... "
+                 "OUTPUT SHARD..." << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// The merged counts are tone mapped where they are mapped, no copy is made
+// -----------------------------------------------------------------------------
+static void WritePlot( const nhCheckpoint &merged, const std::vector<nhToneMapper::Color> &colors,
+                       unsigned threads, const std::string &path )
+{
+    const nhCheckpoint::Header &header = merged.GetHeader();
+    const uint32_t width = static_cast<uint32_t>(header.resolution[0]);
+    const uint32_t height = static_cast<uint32_t>(header.resolution[1]);
+    const uint64_t *counts = reinterpret_cast<const uint64_t *>(merged.Counts( 0 ));
+
+    nhToneMapper toneMapper( threads );
+    std::vector<unsigned char> pixels( 4 * static_cast<size_t>(width) * height );
+    if ( header.bandCount == 1 )
+    {
+        toneMapper.Map( counts, width, height, pixels.data() );
+    }
+    else
+    {
+        toneMapper.Compose( counts, colors.data(), header.bandCount, width, height, pixels.data() );
+    }
+
+    writePng( path, pixels.data(), width, height, 4 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    unsigned threads = 0;
+    std::string pngFile;
+    std::vector<uint32_t> colorArgs;
+    std::vector<std::string> files;
+    try
+    {
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--threads" && ii + 1 < argc )
+            {
+                threads = static_cast<unsigned>(ParseUnsigned( argv[++ii], 10 ));
+            }
+            else if ( arg == "--png" && ii + 1 < argc )
+            {
+                pngFile = argv[++ii];
+            }
+            else if ( arg == "--color" && ii + 1 < argc )
+            {
+                unsigned long color = ParseUnsigned( argv[++ii], 16 );
+                if ( color > 0xffffff )
+                {
+                    throw std::runtime_error( std::string( "invalid color " ) + argv[ii] + "!" );
+                }
+                colorArgs.push_back( static_cast<uint32_t>(color) );
+            }
+            else if ( arg.size() > 1 && arg[0] == '-' )
+            {
+                // an unknown flag, or a known one missing its value, caught
+                // before it is taken for the output and truncated
+                throw std::runtime_error( "unknown argument " + arg + "!" );
+            }
+            else
+            {
+                files.push_back( arg );
+            }
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        PrintUsage();
+        return 1;
+    }
+
+    if ( files.size() < 2 )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const std::string output = files[0];
+    const std::vector<std::string> shards( files.begin() + 1, files.end() );
+    if ( pngFile.empty() )
+    {
+        pngFile = output + ".png";
+    }
+
+    try
+    {
+        using Clock = std::chrono::high_resolution_clock;
+        auto start = Clock::now();
+        nhCheckpoint::MergeStats stats = nhCheckpoint::Merge( shards, output, threads );
+        double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        nhCheckpoint merged;
+        merged.OpenReadOnly( output );
+        const nhCheckpoint::Header &header = merged.GetHeader();
+
+        std::cout << "merged " << shards.size() << " shards, " << stats.orbits << " orbits of "
+                  << stats.candidates << " candidates in " << seconds << " s" << std::endl;
+        for ( uint32_t band = 0; band < header.bandCount; ++band )
+        {
+            std::cout << "band [" << header.bands[band][0] << ", " << header.bands[band][1]
+                      << "): brightest pixel " << stats.maxHits[band] << " hits" << std::endl;
+        }
+        if ( stats.saturated > 0 )
+        {
+            std::cout << stats.saturated << " counts saturated" << std::endl;
+        }
+
+        std::vector<nhToneMapper::Color> colors;
+        for ( uint32_t band = 0; band < header.bandCount; ++band )
+        {
+            colors.push_back( ToColor( band < colorArgs.size() ? colorArgs[band] : DEFAULT_COLORS[band] ) );
+        }
+        WritePlot( merged, colors, threads, pngFile );
+        std::cout << "wrote " << output << " and " << pngFile << std::endl;
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,1084 @@
+#include <cmath>
+#include <cctype>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include "nebulabrot.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool nhImage::PointAtPixel( const int px, const int py,
+                            double &x, double &y,
+                            const nhImage::PIXEL_CORNER loc ) const
+{
+    if ( px < 0 || px >= p_resX || py < 0 || py >= p_resY )
+    {
+        return false;
+    }
+
+    double pixelSpanX = 1.0 / p_scaleX;
+    x = p_xMin + px * pixelSpanX;
+
+    double pixelSpanY = 1.0 / p_scaleY;
+    y = p_yMin + py * pixelSpanY;
+
+    switch ( loc )
+    {
+    case CENTER:
+        x += 0.5 * pixelSpanX;
+        y += 0.5 * pixelSpanY;
+        break;
+    case LOWER_LEFT:
+        y += pixelSpanY;
+        break;
+    case LOWER_RIGHT:
+        x += pixelSpanX;
+        y += pixelSpanY;
+        break;
+    case UPPER_RIGHT:
+        x += pixelSpanX;
+        break;
+    case UPPER_LEFT:
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static unsigned DefaultWorkerCount()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count != 0 ? count : 1;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhNebulabrot::nhNebulabrot( double xmin, double xmax,
+                            double ymin, double ymax,
+                            int resX, int resY, int maxIter, int minIter )
+    : nhNebulabrot( xmin, xmax, ymin, ymax, resX, resY, maxIter, minIter,
+                    Options() )
+{
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhNebulabrot::nhNebulabrot( double xmin, double xmax,
+                            double ymin, double ymax,
+                            int resX, int resY, int maxIter, int minIter,
+                            const Options &options )
+    : nhImage( xmin, xmax, ymin, ymax, resX, resY ),
+      p_maxIter( maxIter ),
+      p_minIter( minIter ),
+      p_bands( options.bands ),
+      p_sum( EmptyHistogram( options.counter ) ),
+      p_sampler( options.sampler ),
+      p_replayOrbits( options.replayOrbits ),
+      p_batchDeposits( options.batchDeposits ),
+      p_deposit( options.deposit ),
+      p_workers( options.workerCount != 0 ? options.workerCount : DefaultWorkerCount() )
+{
+    assert( minIter < maxIter );
+
+    if ( p_bands.empty() )
+    {
+        p_bands.push_back( Band{ minIter, maxIter, { 1.0f, 1.0f, 1.0f } } );
+    }
+    if ( p_bands.size() > MAX_BANDS )
+    {
+        throw std::runtime_error( "too many iteration bands!" );
+    }
+    for ( const Band &band : p_bands )
+    {
+        if ( band.minIter >= band.maxIter || band.minIter < minIter || band.maxIter > maxIter )
+        {
+            throw std::runtime_error( "iteration band outside [minIter, maxIter)!" );
+        }
+    }
+
+    if ( p_deposit == BILINEAR && options.counter != COUNT_FLOAT )
+    {
+        throw std::runtime_error( "bilinear deposits need float counts!" );
+    }
+    if ( p_deposit == BILINEAR && p_batchDeposits )
+    {
+        throw std::runtime_error( "bilinear deposits cannot be batched!" );
+    }
+
+    // the render a histogram file describes, checkpoint or WriteHistogram
+    p_header.viewport[0] = xmin;
+    p_header.viewport[1] = xmax;
+    p_header.viewport[2] = ymin;
+    p_header.viewport[3] = ymax;
+    p_header.resolution[0] = resX;
+    p_header.resolution[1] = resY;
+    p_header.minIter = minIter;
+    p_header.maxIter = maxIter;
+    p_header.sampler = static_cast<uint32_t>(p_sampler);
+    p_header.bandCount = static_cast<uint32_t>(p_bands.size());
+    for ( size_t ii = 0; ii < p_bands.size(); ++ii )
+    {
+        p_header.bands[ii][0] = p_bands[ii].minIter;
+        p_header.bands[ii][1] = p_bands[ii].maxIter;
+    }
+    p_header.seed = options.seed;
+    p_header.workerCount = static_cast<uint32_t>(p_workers.size());
+
+    if ( !options.checkpointFile.empty() )
+    {
+        if ( options.counter == COUNT_FLOAT )
+        {
+            throw std::runtime_error( "float histograms cannot be checkpointed!" );
+        }
+        if ( options.layout != nhHistogramLayout::ROW_MAJOR )
+        {
+            throw std::runtime_error( "tiled histograms cannot be checkpointed!" );
+        }
+
+        nhCheckpoint::Header layout = p_header;
+        layout.flags = options.counter == COUNT_UINT64 ? uint32_t( nhCheckpoint::WIDE_COUNTS ) : 0u;
+
+        p_checkpoint = std::make_unique<nhCheckpoint>();
+        p_checkpoint->Open( options.checkpointFile, layout );
+    }
+
+    for ( size_t ii = 0; ii < p_workers.size(); ++ii )
+    {
+        WorkerState &worker = p_workers[ii];
+        worker.rng.Seed( options.seed, ii );
+        worker.hits = EmptyHistogram( options.counter );
+        std::visit( [&]( auto &hits )
+        {
+            using Count = typename std::decay_t<decltype(hits)>::CountType;
+            const uint32_t layers = BandCount();
+            if ( p_checkpoint )
+            {
+                Count *counts = reinterpret_cast<Count *>(p_checkpoint->Counts( static_cast<uint32_t>(ii) ));
+                hits = nhHistogram<Count>( counts, resX, resY, layers );
+            }
+            else
+            {
+                hits = nhHistogram<Count>( resX, resY, layers, options.layout );
+            }
+
+            // batches hold 32 bit indices
+            if ( p_batchDeposits && hits.Size() > UINT32_MAX )
+            {
+                throw std::runtime_error( "histogram too large for batched deposits!" );
+            }
+        }, worker.hits );
+
+        if ( p_batchDeposits )
+        {
+            // flushed after every orbit, so never more than one orbit past
+            // DEPOSIT_BATCH
+            worker.deposits.Reserve( DEPOSIT_BATCH + static_cast<size_t>(maxIter) * BandCount() );
+        }
+
+        if ( p_checkpoint )
+        {
+            worker.record = &p_checkpoint->Worker( static_cast<uint32_t>(ii) );
+        }
+
+        // a metropolis chain starts over, everything else carries on
+        if ( Resumed() )
+        {
+            nhRandom::State state;
+            std::copy( std::begin( worker.record->rng ), std::end( worker.record->rng ), state.begin() );
+            worker.rng.SetState( state );
+            worker.orbits = worker.record->orbits;
+            worker.candidates = worker.record->candidates;
+        }
+
+        if ( options.orbitBudget > 0 )
+        {
+            worker.orbitLimit = options.orbitBudget / p_workers.size() +
+                                (ii < options.orbitBudget % p_workers.size() ? 1 : 0);
+        }
+
+        worker.candidatesX.resize( CANDIDATE_BATCH );
+        worker.candidatesY.resize( CANDIDATE_BATCH );
+        worker.candidateIters.resize( CANDIDATE_BATCH );
+
+        if ( p_replayOrbits )
+        {
+            worker.ringX.resize( p_kernel.RingSize( ORBIT_RING_ROWS ) );
+            worker.ringY.resize( p_kernel.RingSize( ORBIT_RING_ROWS ) );
+            worker.pendingX.reserve( CANDIDATE_BATCH );
+            worker.pendingY.reserve( CANDIDATE_BATCH );
+            worker.pendingBands.reserve( CANDIDATE_BATCH );
+            worker.chainOrbit.resize( 2 * ORBIT_RING_ROWS );
+            worker.proposalOrbit.resize( 2 * ORBIT_RING_ROWS );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t nhNebulabrot::OrbitCount() const
+{
+    uint64_t total = 0;
+    for ( const auto &worker : p_workers )
+    {
+        total += worker.orbits.load( std::memory_order_relaxed );
+    }
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool nhNebulabrot::BudgetSpent() const
+{
+    for ( const auto &worker : p_workers )
+    {
+        if ( worker.orbits.load( std::memory_order_relaxed ) < worker.orbitLimit )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhNebulabrot::RejectionStats nhNebulabrot::GetRejectionStats() const
+{
+    RejectionStats stats{ 0, 0, 0 };
+    for ( const auto &worker : p_workers )
+    {
+        stats.candidates += worker.candidates.load( std::memory_order_relaxed );
+        stats.bulbRejections += worker.bulbRejections.load( std::memory_order_relaxed );
+        stats.cycleIterationsSaved += worker.cycleIterationsSaved.load( std::memory_order_relaxed );
+    }
+    return stats;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhNebulabrot::Histogram nhNebulabrot::EmptyHistogram( COUNTER counter )
+{
+    switch ( counter )
+    {
+    case COUNT_UINT64: return nhHistogram<uint64_t>();
+    case COUNT_FLOAT:  return nhHistogram<float>();
+    case COUNT_UINT32: break;
+    }
+    return nhHistogram<uint32_t>();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+double nhNebulabrot::DutyCycle() const
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - p_created;
+    double sampling = 0.0;
+    for ( const auto &worker : p_workers )
+    {
+        sampling += 1.0e-9 * worker.samplingNanos.load( std::memory_order_relaxed );
+    }
+    return elapsed.count() > 0.0 ? sampling / (elapsed.count() * p_workers.size()) : 0.0;
+}
+
+// -----------------------------------------------------------------------------
+// Each worker either answers the request with a snapshot or is found idle
+// and held idle while its histogram is read in place. Workers answer at
+// their next orbit or candidate batch boundary, so the wait is about one
+// orbit or one batch of escape tests, however rarely candidates are accepted.
+// -----------------------------------------------------------------------------
+void nhNebulabrot::SumHits()
+{
+    const uint64_t epoch = p_snapshotEpoch.fetch_add( 1, std::memory_order_acq_rel ) + 1;
+
+    std::vector<const Histogram *> sources( p_workers.size(), nullptr );
+    std::vector<bool> claimed( p_workers.size(), false );
+    for ( size_t pending = p_workers.size(); pending > 0; )
+    {
+        for ( size_t ii = 0; ii < p_workers.size(); ++ii )
+        {
+            WorkerState &worker = p_workers[ii];
+            if ( sources[ii] )
+            {
+                continue;
+            }
+
+            int idle = IDLE;
+            if ( worker.publishedEpoch.load( std::memory_order_acquire ) >= epoch )
+            {
+                sources[ii] = &worker.published;
+                --pending;
+            }
+            else if ( worker.activity.compare_exchange_strong( idle, READING, std::memory_order_acquire ) )
+            {
+                sources[ii] = &worker.hits;
+                claimed[ii] = true;
+                --pending;
+            }
+        }
+
+        if ( pending > 0 )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // reduction step: sum up the private histograms of all workers
+    std::visit( [this, &sources]( auto &sum )
+    {
+        using Count = typename std::decay_t<decltype(sum)>::CountType;
+        if ( !sum.SameShape( p_resX, p_resY, BandCount() ) )
+        {
+            sum = nhHistogram<Count>( p_resX, p_resY, BandCount() );
+        }
+
+        // the sum is row major whatever the layout of the workers
+        sum.Clear();
+        for ( const Histogram *source : sources )
+        {
+            std::get<nhHistogram<Count>>( *source ).AddTo( sum.Data() );
+        }
+    }, p_sum );
+
+    for ( size_t ii = 0; ii < p_workers.size(); ++ii )
+    {
+        if ( claimed[ii] )
+        {
+            p_workers[ii].activity.store( IDLE, std::memory_order_release );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+std::vector<uint32_t> nhNebulabrot::GetHits()
+{
+    std::vector<uint32_t> hits( static_cast<size_t>(p_resX) * p_resY * BandCount() );
+    GetHits( hits.data() );
+    return hits;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhNebulabrot::GetHits( uint32_t *hits )
+{
+    SumHits();
+    std::visit( [hits]( const auto &sum )
+    {
+        using Count = typename std::decay_t<decltype(sum)>::CountType;
+        if constexpr ( std::is_same<Count, uint32_t>::value )
+        {
+            std::copy( sum.Data(), sum.Data() + sum.Size(), hits );
+        }
+        else
+        {
+            for ( uint32_t layer = 0; layer < sum.Layers(); ++layer )
+            {
+                const Count *counts = sum.Layer( layer );
+                const size_t size = sum.LayerSize();
+                double maxHits = static_cast<double>(nhToneMapper::MaxHits( counts, size ));
+                double scale = maxHits > UINT32_MAX ? UINT32_MAX / maxHits : 1.0;
+                uint32_t *layerHits = hits + layer * size;
+                for ( size_t ii = 0; ii < size; ++ii )
+                {
+                    layerHits[ii] = static_cast<uint32_t>(counts[ii] * scale + 0.5);
+                }
+            }
+        }
+    }, p_sum );
+}
+
+// -----------------------------------------------------------------------------
+// The sum is row major whatever the layout of the workers, so it is written
+// as it is. Float counts are never negative and round half up
+// -----------------------------------------------------------------------------
+void nhNebulabrot::WriteHistogram( const std::string &path )
+{
+    nhCheckpoint::Header layout = p_header;
+    layout.seed = 0;
+    layout.workerCount = 1;
+    layout.flags = nhCheckpoint::MERGED | nhCheckpoint::WIDE_COUNTS;
+
+    nhCheckpoint file;
+    file.Create( path, layout );
+    nhCheckpoint::WorkerRecord &record = file.Worker( 0 );
+    record = nhCheckpoint::WorkerRecord{};
+    record.orbits = OrbitCount();
+    record.candidates = GetRejectionStats().candidates;
+
+    SumHits();
+    uint64_t *counts = reinterpret_cast<uint64_t *>(file.Counts( 0 ));
+    std::visit( [counts]( const auto &sum )
+    {
+        using Count = typename std::decay_t<decltype(sum)>::CountType;
+        for ( size_t ii = 0; ii < sum.Size(); ++ii )
+        {
+            if constexpr ( std::is_floating_point<Count>::value )
+            {
+                counts[ii] = static_cast<uint64_t>(sum[ii] + Count( 0.5 ));
+            }
+            else
+            {
+                counts[ii] = sum[ii];
+            }
+        }
+    }, p_sum );
+    file.Flush();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhNebulabrot::GetHeatPlot( nhToneMapper &toneMapper, unsigned char *rgba )
+{
+    SumHits();
+    std::visit( [this, &toneMapper, rgba]( const auto &sum )
+    {
+        if ( p_bands.size() == 1 )
+        {
+            toneMapper.Map( sum.Data(), p_resX, p_resY, rgba );
+            return;
+        }
+
+        nhToneMapper::Color colors[MAX_BANDS];
+        for ( size_t ii = 0; ii < p_bands.size(); ++ii )
+        {
+            colors[ii] = p_bands[ii].color;
+        }
+        toneMapper.Compose( sum.Data(), colors, BandCount(), p_resX, p_resY, rgba );
+    }, p_sum );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhNebulabrot::GetHeatPlot( nhToneMapper &toneMapper, float *rgb )
+{
+    SumHits();
+    std::visit( [this, &toneMapper, rgb]( const auto &sum )
+    {
+        if ( p_bands.size() == 1 )
+        {
+            toneMapper.MapFloat( sum.Data(), p_resX, p_resY, rgb );
+            return;
+        }
+
+        nhToneMapper::Color colors[MAX_BANDS];
+        for ( size_t ii = 0; ii < p_bands.size(); ++ii )
+        {
+            colors[ii] = p_bands[ii].color;
+        }
+        toneMapper.ComposeFloat( sum.Data(), colors, BandCount(), p_resX, p_resY, rgb );
+    }, p_sum );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+std::vector<unsigned char> nhNebulabrot::GetHeatPlot()
+{
+    std::vector<unsigned char> hitPixels( 4 * static_cast<size_t>(p_resX) * p_resY );
+    nhToneMapper toneMapper;
+    GetHeatPlot( toneMapper, hitPixels.data() );
+    return hitPixels;
+}
+
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+int nhNebulabrot::IterationsToGetKnocked( int row, int col ) const
+{
+    double cx = 0.0, cy = 0.0;
+    nhImage::PointAtPixel( row, col, cx, cy, nhImage::CENTER );
+    if ( InsideKnownBulbs( cx, cy ) )
+    {
+        return p_maxIter;
+    }
+    return nhEscapeIterations( cx, cy, p_maxIter );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool nhNebulabrot::GetAStartingPoint( WorkerState &worker, double &x, double &y,
+                                      unsigned &bands ) const
+{
+    while ( true )
+    {
+        // bail out between batches so that neither a pause nor a snapshot
+        // request waits on the rejection loop
+        if ( Stopping( worker ) || SnapshotRequested( worker ) )
+        {
+            return false;
+        }
+
+        while ( worker.nextCandidate < worker.candidateCount )
+        {
+            size_t ii = worker.nextCandidate++;
+            bands = BandsOf( worker.candidateIters[ii] );
+            if ( bands != 0 )
+            {
+                x = worker.candidatesX[ii];
+                y = worker.candidatesY[ii];
+                return true;
+            }
+        }
+
+        // escape test a fresh batch in one go
+        DrawCandidates( worker );
+        uint64_t saved = p_kernel.Iterate( worker.candidatesX.data(), worker.candidatesY.data(),
+                                           worker.candidateCount, p_maxIter,
+                                           worker.candidateIters.data() );
+        worker.cycleIterationsSaved.fetch_add( saved, std::memory_order_relaxed );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhNebulabrot::DrawCandidates( WorkerState &worker ) const
+{
+    double *candX = worker.candidatesX.data();
+    double *candY = worker.candidatesY.data();
+    worker.rng.Fill( candX, CANDIDATE_BATCH, p_xMin, p_xMax );
+    worker.rng.Fill( candY, CANDIDATE_BATCH, p_yMin, p_yMax );
+
+    size_t kept = 0;
+    for ( size_t ii = 0; ii < CANDIDATE_BATCH; ++ii )
+    {
+        if ( !InsideKnownBulbs( candX[ii], candY[ii] ) )
+        {
+            candX[kept] = candX[ii];
+            candY[kept] = candY[ii];
+            ++kept;
+        }
+    }
+
+    worker.candidates.fetch_add( CANDIDATE_BATCH, std::memory_order_relaxed );
+    worker.bulbRejections.fetch_add( CANDIDATE_BATCH - kept, std::memory_order_relaxed );
+    worker.candidateCount = kept;
+    worker.nextCandidate = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Deposits the in band orbits of a recorded batch as their lanes finish and
+// keeps the starting points of those that outgrew the ring for later
+// -----------------------------------------------------------------------------
+template <class Count>
+class nhNebulabrot::ReplaySink : public nhOrbitSink
+{
+public:
+
+    ReplaySink( nhNebulabrot &fractal, WorkerState &worker, nhHistogram<Count> &hits )
+        : _fractal( fractal ), _worker( worker ), _hits( hits ) {}
+
+    void Finished( size_t index, const nhOrbitView &orbit ) override
+    {
+        unsigned bands = _fractal.BandsOf( orbit.count );
+        if ( bands == 0 )
+        {
+            return;
+        }
+
+        if ( !orbit.complete )
+        {
+            _worker.pendingX.push_back( _worker.candidatesX[index] );
+            _worker.pendingY.push_back( _worker.candidatesY[index] );
+            _worker.pendingBands.push_back( bands );
+            return;
+        }
+
+        for ( int k = 0; k < orbit.count; ++k )
+        {
+            _fractal.Deposit( _worker, _hits, bands, orbit.X( k ), orbit.Y( k ) );
+        }
+        _worker.orbits.fetch_add( 1, std::memory_order_relaxed );
+
+        // a whole batch of orbits may finish before FinishOrbit runs
+        FlushDeposits( _worker, _hits, false );
+    }
+
+private:
+
+    nhNebulabrot       &_fractal;
+    WorkerState        &_worker;
+    nhHistogram<Count> &_hits;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhNebulabrot::SampleAndReplay( WorkerState &worker, nhHistogram<Count> &hits )
+{
+    DrawCandidates( worker );
+
+    ReplaySink<Count> sink( *this, worker, hits );
+    uint64_t saved = p_kernel.IterateRecorded( worker.candidatesX.data(), worker.candidatesY.data(),
+                                               worker.candidateCount, p_maxIter,
+                                               worker.candidateIters.data(),
+                                               worker.ringX.data(), worker.ringY.data(),
+                                               ORBIT_RING_ROWS, sink );
+    worker.cycleIterationsSaved.fetch_add( saved, std::memory_order_relaxed );
+    worker.nextCandidate = worker.candidateCount;
+
+    // orbits longer than the ring are iterated a second time
+    for ( size_t ii = 0; ii < worker.pendingX.size(); ++ii )
+    {
+        DepositOrbit( worker, hits, worker.pendingX[ii], worker.pendingY[ii], worker.pendingBands[ii] );
+        FlushDeposits( worker, hits, false );
+    }
+    worker.pendingX.clear();
+    worker.pendingY.clear();
+    worker.pendingBands.clear();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+double nhNebulabrot::Contribution( WorkerState &worker, double cx, double cy,
+                                   bool record ) const
+{
+    worker.proposalOrbitLength = 0;
+    worker.proposalBands = 0;
+
+    if ( InsideKnownBulbs( cx, cy ) )
+    {
+        return 0.0;
+    }
+
+    // cheap band test first, it stops early on periodic orbits
+    int length = nhEscapeIterations( cx, cy, p_maxIter );
+    unsigned bands = BandsOf( length );
+    if ( bands == 0 )
+    {
+        return 0.0;
+    }
+    worker.proposalBands = bands;
+
+    // orbits that fit are kept so an accepted proposal is not iterated again
+    record = record && length <= ORBIT_RING_ROWS;
+    double *orbit = worker.proposalOrbit.data();
+
+    int count = 0;
+    int inView = 0;
+    double x0 = 0.0, y0 = 0.0;
+    while ( x0 * x0 + y0 * y0 < 4 && count < p_maxIter )
+    {
+        double fx = x0 * x0 - y0 * y0 + cx;
+        double fy = 2.0 * x0 * y0 + cy;
+        x0 = fx;
+        y0 = fy;
+
+        if ( record )
+        {
+            orbit[2 * count] = x0;
+            orbit[2 * count + 1] = y0;
+        }
+        ++count;
+
+        // the half-open viewport PixelAtPoint deposits into
+        if ( x0 >= p_xMin && x0 < p_xMax && y0 >= p_yMin && y0 < p_yMax )
+        {
+            ++inView;
+        }
+    }
+
+    if ( record )
+    {
+        worker.proposalOrbitLength = count;
+    }
+
+    return static_cast<double>(inView) / count;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool nhNebulabrot::GetAMutatedPoint( WorkerState &worker, double &x, double &y,
+                                     unsigned &bands ) const
+{
+    // orbits from anywhere in |c| <= 2 may cross the viewport, so unlike the
+    // uniform sampler the chain is free to leave it
+    static const double DOMAIN_MIN = -2.0;
+    static const double DOMAIN_MAX = 2.0;
+
+    // probability of a fresh uniform proposal instead of a local mutation,
+    // keeps the chain from getting stuck on one island of good orbits
+    static const double JUMP_PROBABILITY = 0.2;
+
+    nhRandom &rng = worker.rng;
+
+    while ( worker.chainContribution == 0.0 )
+    {
+        if ( Stopping( worker ) || SnapshotRequested( worker ) )
+        {
+            return false;
+        }
+
+        double cx = rng.NextDouble( DOMAIN_MIN, DOMAIN_MAX );
+        double cy = rng.NextDouble( DOMAIN_MIN, DOMAIN_MAX );
+        double contribution = Contribution( worker, cx, cy, p_replayOrbits );
+        if ( contribution > 0.0 )
+        {
+            AcceptProposal( worker, cx, cy, contribution );
+        }
+    }
+
+    double cx = 0.0, cy = 0.0;
+    if ( rng.NextDouble() < JUMP_PROBABILITY )
+    {
+        cx = rng.NextDouble( DOMAIN_MIN, DOMAIN_MAX );
+        cy = rng.NextDouble( DOMAIN_MIN, DOMAIN_MAX );
+    }
+    else
+    {
+        // step of random direction whose length is log-uniform between
+        // 1e-4 and 1e-1 of the viewport width
+        double viewSize = p_xMax - p_xMin;
+        double rMax = 0.1 * viewSize;
+        double rMin = 1.0e-4 * viewSize;
+        double radius = rMax * std::exp( -std::log( rMax / rMin ) * rng.NextDouble() );
+        double phi = 2.0 * M_PI * rng.NextDouble();
+        cx = worker.chainX + radius * std::cos( phi );
+        cy = worker.chainY + radius * std::sin( phi );
+    }
+
+    // both proposals are symmetric so the acceptance ratio is the ratio of
+    // contributions
+    double contribution = Contribution( worker, cx, cy, p_replayOrbits );
+    if ( contribution > 0.0 &&
+         rng.NextDouble() * worker.chainContribution < contribution )
+    {
+        AcceptProposal( worker, cx, cy, contribution );
+    }
+
+    // a rejected proposal deposits the current state once more
+    x = worker.chainX;
+    y = worker.chainY;
+    bands = worker.chainBands;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void nhNebulabrot::AcceptProposal( WorkerState &worker, double cx, double cy,
+                                   double contribution )
+{
+    worker.chainX = cx;
+    worker.chainY = cy;
+    worker.chainContribution = contribution;
+    worker.chainBands = worker.proposalBands;
+
+    // the recorded proposal orbit becomes the chain's, the old one is reused
+    // as scratch for the next proposal
+    std::swap( worker.chainOrbit, worker.proposalOrbit );
+    worker.chainOrbitLength = worker.proposalOrbitLength;
+    worker.proposalOrbitLength = 0;
+}
+
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+bool nhNebulabrot::InsideKnownBulbs( double cx, double cy )
+{
+    bool circle_cond = (cx + 1) * (cx + 1) + cy * cy < 0.0625;
+
+    if ( circle_cond )
+    {
+        return true;
+    }
+
+    double p = std::sqrt( (cx - 0.25) * (cx - 0.25) + cy * cy );
+    bool cardioid_cond = cx - (p - 2 * p * p + 0.25) < 0;
+
+    if ( cardioid_cond )
+    {
+        return true;
+    }
+
+    // the bulbs are not exact discs, radii are shrunk until no point of the
+    // disc escapes within 200000 iterations
+
+    // period 4 bulb left of the period 2 bulb
+    bool period4_cond = (cx + 1.309) * (cx + 1.309) + cy * cy < 0.058 * 0.058;
+
+    // period 3 bulbs above and below the main cardioid
+    double ay = std::fabs( cy ) - 0.744;
+    bool period3_cond = (cx + 0.125) * (cx + 0.125) + ay * ay < 0.092 * 0.092;
+
+    return period4_cond || period3_cond;
+}
+
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+bool nhNebulabrot::PointHasOrbitBetween( double cx,
+                                         double cy,
+                                         int minIter,
+                                         int maxIter )
+{
+    if ( InsideKnownBulbs( cx, cy ) )
+    {
+        return false;
+    }
+
+    int count = nhEscapeIterations( cx, cy, maxIter );
+    return (count >= minIter) && (count < maxIter);
+}
+
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+bool nhNebulabrot::Paint( void )
+{
+    return Paint( 0u );
+}
+
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+bool nhNebulabrot::Paint( unsigned worker )
+{
+    if ( worker >= p_workers.size() )
+    {
+        return false;
+    }
+
+    return PaintAs( worker, nullptr );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool nhNebulabrot::Paint( unsigned worker, nhJob &job )
+{
+    if ( worker >= p_workers.size() )
+    {
+        return false;
+    }
+
+    return PaintAs( worker, &job );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool nhNebulabrot::PaintAs( unsigned worker, nhJob *job )
+{
+    // wait out a sum reading the histogram in place
+    WorkerState &state = p_workers[worker];
+    for ( int idle = IDLE; !state.activity.compare_exchange_weak( idle, PAINTING, std::memory_order_acquire ); idle = IDLE )
+    {
+        std::this_thread::yield();
+    }
+
+    state.job = job;
+
+    // the counter type is resolved once, the loop is compiled for each
+    std::visit( [this, &state]( auto &hits ) { PaintWith( state, hits ); }, state.hits );
+
+    state.job = nullptr;
+    state.activity.store( IDLE, std::memory_order_release );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhNebulabrot::PaintWith( WorkerState &state, nhHistogram<Count> &hits )
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    state.publishNanos = 0;
+
+    while ( !Stopping( state ) )
+    {
+        if ( p_replayOrbits && p_sampler == UNIFORM )
+        {
+            SampleAndReplay( state, hits );
+            FinishOrbit( state, hits );
+            continue;
+        }
+
+        double cx = 0, cy = 0;
+        unsigned bands = 0;
+        bool found = p_sampler == METROPOLIS ? GetAMutatedPoint( state, cx, cy, bands )
+                                             : GetAStartingPoint( state, cx, cy, bands );
+        if ( !found )
+        {
+            if ( Stopping( state ) )
+            {
+                break;
+            }
+
+            // a snapshot was requested between two candidate batches
+            FinishOrbit( state, hits );
+            continue;
+        }
+
+        if ( p_replayOrbits && state.chainOrbitLength > 0 )
+        {
+            DepositRecordedOrbit( state, hits, state.chainOrbit.data(), state.chainOrbitLength, bands );
+        }
+        else
+        {
+            DepositOrbit( state, hits, cx, cy, bands );
+        }
+
+        FinishOrbit( state, hits );
+    }
+
+    // paused, the histogram must be complete for whoever reads it next
+    FlushDeposits( state, hits, true );
+    if ( state.record )
+    {
+        SaveProgress( state );
+    }
+
+    auto sampling = Clock::now() - start - std::chrono::nanoseconds( state.publishNanos );
+    state.samplingNanos.fetch_add( std::chrono::duration_cast<std::chrono::nanoseconds>( sampling ).count(),
+                                   std::memory_order_relaxed );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhNebulabrot::FinishOrbit( WorkerState &worker, nhHistogram<Count> &hits )
+{
+    const bool requested = SnapshotRequested( worker );
+    const bool complete = FlushDeposits( worker, hits, requested );
+    if ( requested )
+    {
+        worker.publishNanos += Publish( worker, hits ).count();
+    }
+
+    // held back deposits are not in the file yet, the record waits for them
+    if ( complete && worker.record )
+    {
+        SaveProgress( worker );
+    }
+
+    if ( worker.job )
+    {
+        worker.job->SetProgress( worker.orbits.load( std::memory_order_relaxed ) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+std::chrono::nanoseconds nhNebulabrot::Publish( WorkerState &worker, nhHistogram<Count> &hits )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // the request is read before the copy, a later one gets the next copy
+    const uint64_t epoch = p_snapshotEpoch.load( std::memory_order_acquire );
+
+    nhHistogram<Count> *published = std::get_if<nhHistogram<Count>>( &worker.published );
+    if ( !published || !published->SameShape( hits.Width(), hits.Height(), hits.Layers() ) )
+    {
+        worker.published = nhHistogram<Count>( hits.Width(), hits.Height(), hits.Layers(), hits.Layout() );
+        published = &std::get<nhHistogram<Count>>( worker.published );
+    }
+    std::copy( hits.Data(), hits.Data() + hits.Size(), published->Data() );
+    worker.publishedEpoch.store( epoch, std::memory_order_release );
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start );
+}
+
+// -----------------------------------------------------------------------------
+// An orbit counted here is already in the histogram. Candidates of the batch
+// the saved generator state has drawn past are lost if the process dies, the
+// orbit count stays exact and no sample is ever deposited twice.
+// -----------------------------------------------------------------------------
+void nhNebulabrot::SaveProgress( WorkerState &worker )
+{
+    nhCheckpoint::WorkerRecord &record = *worker.record;
+    record.orbits = worker.orbits.load( std::memory_order_relaxed );
+    record.candidates = worker.candidates.load( std::memory_order_relaxed );
+    const nhRandom::State &state = worker.rng.GetState();
+    std::copy( state.begin(), state.end(), std::begin( record.rng ) );
+}
+
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+template <class Count>
+void nhNebulabrot::DepositOrbit( WorkerState &worker, nhHistogram<Count> &hits,
+                                 double cx, double cy, unsigned bands )
+{
+    // Iteration of 0 under f(z) = z^2 + c //
+    int count = 0;
+    double x0 = 0.0, y0 = 0.0;
+    while ( x0 * x0 + y0 * y0 < 4 && count < p_maxIter )
+    {
+        ++count;
+
+        double fx = x0 * x0 - y0 * y0 + cx;
+        double fy = 2.0 * x0 * y0 + cy;
+        x0 = fx;
+        y0 = fy;
+
+        Deposit( worker, hits, bands, x0, y0 );
+    }
+
+    worker.orbits.fetch_add( 1, std::memory_order_relaxed );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhNebulabrot::DepositRecordedOrbit( WorkerState &worker, nhHistogram<Count> &hits,
+                                         const double *orbit, int length, unsigned bands )
+{
+    for ( int k = 0; k < length; ++k )
+    {
+        Deposit( worker, hits, bands, orbit[2 * k], orbit[2 * k + 1] );
+    }
+
+    worker.orbits.fetch_add( 1, std::memory_order_relaxed );
+}
+
+// -----------------------------------------------------------------------------
+// Parses MIN:MAX[:RRGGBB], the color defaulting to white. Every field must be
+// a number through to its end, so 50:100x is rejected rather than read as
+// 50:100
+// -----------------------------------------------------------------------------
+nhNebulabrot::Band nhNebulabrot::ParseBand( const std::string &text )
+{
+    nhNebulabrot::Band band{ 0, 0, { 1.0f, 1.0f, 1.0f } };
+
+    size_t first = text.find( ':' );
+    if ( first == std::string::npos )
+    {
+        throw std::runtime_error( "invalid band " + text + ", expected MIN:MAX[:RRGGBB]!" );
+    }
+    size_t second = text.find( ':', first + 1 );
+
+    const std::string minText = text.substr( 0, first );
+    const std::string maxText = text.substr( first + 1, second - first - 1 );
+    const std::string rgbText = second != std::string::npos ? text.substr( second + 1 ) : "";
+
+    // stoi and stoul stop at the first character they cannot read
+    try
+    {
+        size_t pos = 0;
+        band.minIter = std::stoi( minText, &pos );
+        bool valid = pos == minText.size();
+
+        band.maxIter = std::stoi( maxText, &pos );
+        valid = valid && pos == maxText.size();
+
+        if ( second != std::string::npos )
+        {
+            unsigned long rgb = std::stoul( rgbText, &pos, 16 );
+            valid = valid && pos == rgbText.size() && rgbText.size() == 6 &&
+                    std::all_of( rgbText.begin(), rgbText.end(),
+                                 []( unsigned char c ) { return std::isxdigit( c ) != 0; } );
+            band.color = { ((rgb >> 16) & 0xff) / 255.0f,
+                           ((rgb >> 8) & 0xff) / 255.0f,
+                           (rgb & 0xff) / 255.0f };
+        }
+
+        if ( !valid )
+        {
+            throw std::invalid_argument( text );
+        }
+    }
+    catch ( const std::logic_error & )
+    {
+        // invalid_argument and out_of_range
+        throw std::runtime_error( "invalid band " + text + ", expected MIN:MAX[:RRGGBB]!" );
+    }
+    return band;
+}
@@ -0,0 +1,608 @@
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <variant>
+#include <thread>
+#include <cassert>
+
+#include "random.h"
+#include "escapeKernel.h"
+#include "histogram.h"
+#include "toneMapper.h"
+#include "checkpoint.h"
+#include "jobSystem.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+class nhImage
+{
+public:
+
+    nhImage() = delete;
+
+    nhImage( double xmin, double xmax,
+             double ymin, double ymax,
+             int resX, int resY )
+        : p_xMin( xmin ),
+          p_xMax( xmax ),
+          p_yMin( ymin ),
+          p_yMax( ymax ),
+          p_resX( resX ),
+          p_resY( resY ),
+          p_scaleX( resX / (xmax - xmin) ),
+          p_scaleY( resY / (ymax - ymin) )
+    {
+    }
+
+    virtual ~nhImage() = default;
+
+    enum PIXEL_CORNER
+    {
+        CENTER,
+        LOWER_LEFT,
+        LOWER_RIGHT,
+        UPPER_RIGHT,
+        UPPER_LEFT,
+    };
+
+    // Pixel px, py covers [xmin + px * w, xmin + (px + 1) * w) x
+    // [ymin + py * h, ymin + (py + 1) * h) with w = (xmax - xmin) / resX and
+    // h = (ymax - ymin) / resY, so PixelAtPoint of the CENTER of px, py
+    // gives back px, py. Points on xmax or ymax lie on no pixel
+
+    // Gets the point (x,y) lying on pixel px, py which
+    // corresponds to coordinate of the provided pixel corner
+    bool PointAtPixel( const int px, const int py,
+                       double &x, double &y,
+                       const PIXEL_CORNER loc = CENTER ) const;
+
+    // Gets the pixel lying on point. Inlined, the orbit deposits call it
+    // for every point
+    bool PixelAtPoint( const double x, const double y,
+                       int &px, int &py ) const
+    {
+        double fx = 0.0, fy = 0.0;
+        if ( !PixelCoordinatesAtPoint( x, y, fx, fy ) )
+        {
+            return false;
+        }
+
+        // a point just short of xmax or ymax may still round up to resX
+        // or resY
+        px = static_cast<int>(fx);
+        py = static_cast<int>(fy);
+        px = px < p_resX ? px : p_resX - 1;
+        py = py < p_resY ? py : p_resY - 1;
+        return true;
+    }
+
+    // Gets the point in pixel units, pixel px, py spanning
+    // [px, px + 1) x [py, py + 1)
+    bool PixelCoordinatesAtPoint( const double x, const double y,
+                                  double &fx, double &fy ) const
+    {
+        fx = (x - p_xMin) * p_scaleX;
+        fy = (y - p_yMin) * p_scaleY;
+
+        // no short circuit, one branch for both axes. NaN fails every compare
+        return (x >= p_xMin) & (x < p_xMax) & (y >= p_yMin) & (y < p_yMax);
+    }
+
+protected:
+
+    // Geometry corresponding to image
+    double  p_xMin;
+    double  p_xMax;
+    double  p_yMin;
+    double  p_yMax;
+
+    // Image resolution
+    int     p_resX;
+    int     p_resY;
+
+    // pixels per unit of the plane
+    double  p_scaleX;
+    double  p_scaleY;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+class nhNebulabrot : public nhImage
+{
+public:
+
+    // How starting points c are chosen
+    enum SAMPLER
+    {
+        // c uniform over the viewport, kept when its orbit length lies
+        // in [minIter, maxIter)
+        UNIFORM,
+        // Metropolis-Hastings chain per worker that mutates the last
+        // accepted c and favours orbits spending much of their length in
+        // the viewport. Orders of magnitude more useful orbits on deep
+        // zooms, at the price of a bias towards bright orbits.
+        METROPOLIS,
+    };
+
+    // Type of the hit counts, see nhHistogram
+    enum COUNTER
+    {
+        COUNT_UINT32,
+        COUNT_UINT64,
+        // fractional weights, never checkpointed, see WriteHistogram
+        COUNT_FLOAT,
+    };
+
+    // How an orbit point is counted
+    enum DEPOSIT
+    {
+        // one hit on the pixel the point lies on
+        NEAREST,
+        // one hit spread over the four pixels whose centers surround the
+        // point, weighted by a tent of one pixel radius. Smooth at native
+        // resolution, needs COUNT_FLOAT
+        BILINEAR,
+    };
+
+    // Orbits whose length lies in [minIter, maxIter) are deposited into the
+    // band's own histogram. Bands may overlap, an orbit then counts in each
+    // of them. color is the rgb weight the band adds to a composed image.
+    struct Band
+    {
+        int                 minIter;
+        int                 maxIter;
+        nhToneMapper::Color color;
+    };
+
+    // Parses MIN:MAX[:RRGGBB], the color defaulting to white. Throws
+    // std::runtime_error on anything else
+    static Band ParseBand( const std::string &text );
+
+    // an orbit's bands are tracked as a bit mask, and every band costs each
+    // worker a full histogram
+    static constexpr size_t MAX_BANDS = nhCheckpoint::MAX_BANDS;
+
+    struct Options
+    {
+        // 0 sizes the worker pool to the hardware concurrency
+        unsigned workerCount = 0;
+
+        // worker n draws its samples from random stream (seed, n), so a
+        // given seed and worker count always produce the same render
+        uint64_t seed = 0;
+
+        SAMPLER  sampler = UNIFORM;
+
+        // record orbits while escape testing and replay the accepted ones
+        // into the histogram instead of iterating them a second time.
+        // Orbits longer than ORBIT_RING_ROWS are still recomputed
+        bool     replayOrbits = false;
+
+        COUNTER  counter = COUNT_UINT32;
+
+        // BILINEAR cannot be combined with batchDeposits
+        DEPOSIT  deposit = NEAREST;
+
+        // order of the counts in the worker histograms, TILED keeps
+        // orbit points close in the plane close in memory. Tiled histograms
+        // are not checkpointed, see WriteHistogram
+        nhHistogramLayout::LAYOUT layout = nhHistogramLayout::ROW_MAJOR;
+
+        // hold back DEPOSIT_BATCH deposits per worker and apply them sorted
+        // by address instead of one random write at a time
+        bool     batchDeposits = false;
+
+        // histograms kept from one sampling pass, each within
+        // [minIter, maxIter) of the constructor. Empty keeps the single band
+        // [minIter, maxIter)
+        std::vector<Band> bands;
+
+        // total orbits after which Paint returns, split evenly over the
+        // workers and counting those of a resumed checkpoint. 0 paints until
+        // paused. Replayed uniform sampling may overshoot by a candidate batch
+        uint64_t orbitBudget = 0;
+
+        // when set the histograms live in this memory mapped nhCheckpoint
+        // file, which is resumed when it exists. Resuming takes the seed
+        // and worker count the file was started with
+        std::string checkpointFile;
+    };
+
+    // orbit points a worker keeps per lane for replay
+    static constexpr int ORBIT_RING_ROWS = 4096;
+
+    // deposits a worker holds back with batchDeposits, 4 MiB of indices
+    static constexpr size_t DEPOSIT_BATCH = size_t( 1 ) << 20;
+
+    nhNebulabrot( double xmin, double xmax,
+                  double ymin, double ymax,
+                  int resX, int resY, int maxIter, int minIter );
+
+    nhNebulabrot( double xmin, double xmax,
+                  double ymin, double ymax,
+                  int resX, int resY, int maxIter, int minIter,
+                  const Options &options );
+
+    virtual ~nhNebulabrot() = default;
+
+    // Paint( 0 ), samples orbits on the calling thread until paused
+    bool Paint( void );
+
+    // Samples orbits on behalf of worker until paused. Each worker owns a
+    // private hit-count buffer so any number of workers can run at once.
+    bool Paint( unsigned worker );
+
+    // Same as a task of an nhJobSystem, until paused or until the job is
+    // asked to stop. The job's progress is the worker's orbit count
+    bool Paint( unsigned worker, nhJob &job );
+
+    void PausePaint( bool flag ) { p_paused = flag; }
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(p_workers.size()); }
+
+    // Total orbits deposited by all workers so far
+    uint64_t OrbitCount() const;
+
+    // Rejection work avoided so far by the analytic bulb tests and by the
+    // periodicity check of the escape test
+    struct RejectionStats
+    {
+        uint64_t candidates;            // starting points escape tested
+        uint64_t bulbRejections;        // rejected without iterating
+        uint64_t cycleIterationsSaved;  // iterations cut short on cycles
+    };
+
+    RejectionStats GetRejectionStats() const;
+
+    // true when the histograms continue those of a checkpoint file
+    bool Resumed() const { return p_checkpoint && p_checkpoint->Resumed(); }
+
+    // schedules the write back of the checkpoint file, never blocks
+    void FlushCheckpoint() { if ( p_checkpoint ) p_checkpoint->Flush(); }
+
+    // fraction of the time since construction the workers spent sampling
+    // rather than stopped or publishing snapshots, averaged over workers.
+    // Counts the Paint calls that have returned
+    double DutyCycle() const;
+
+    // true when the orbit of c escapes after [minIter, maxIter) iterations,
+    // the scalar rejection test of one starting point
+    static bool PointHasOrbitBetween( double cx,
+                                      double cy,
+                                      int minIter,
+                                      int maxIter );
+
+    const std::vector<Band> &Bands() const { return p_bands; }
+    unsigned BandCount() const { return static_cast<unsigned>(p_bands.size()); }
+
+    // The per worker histograms are summed into a buffer kept for the next
+    // call, so these run on one thread at a time. Workers keep painting:
+    // each one publishes a copy of its histogram at its next orbit boundary
+    // and the copies are summed, a worker that is not painting is read in
+    // place and cannot start until the sum is done
+
+    // Sums the per worker hit counts, one resX * resY histogram per band
+    // back to back. Wider or fractional counts are scaled down per band
+    // until the largest fits 32 bits
+    std::vector<uint32_t> GetHits();
+
+    // Same into hits, resX * resY * BandCount() of them
+    void GetHits( uint32_t *hits );
+
+    // Sums the per worker hit counts into path as a merged nhCheckpoint of
+    // 64 bit counts, which mergeShards reads like any other, for histograms
+    // that cannot be checkpointed. Float counts are rounded to whole hits.
+    // Throws std::runtime_error when path cannot be written
+    void WriteHistogram( const std::string &path );
+
+    // Sums the per worker hit counts and maps them to resX * resY RGBA
+    // pixels, as a heat plot for a single band and composed from the band
+    // colors otherwise
+    void GetHeatPlot( nhToneMapper &toneMapper, unsigned char *rgba );
+    std::vector<unsigned char> GetHeatPlot();
+
+    // Same as resX * resY RGB floats in [0, 1], for 16 bit and float images
+    void GetHeatPlot( nhToneMapper &toneMapper, float *rgb );
+
+    // true once every worker has used up its share of the orbit budget
+    bool BudgetSpent() const;
+private:
+
+    int IterationsToGetKnocked( int row, int col ) const;
+
+    // true for points inside the main cardioid, the period 2 bulb or
+    // discs fitted inside the period 3 and period 4 bulbs, which never escape
+    static bool InsideKnownBulbs( double cx, double cy );
+
+    // number of candidate points generated and escape tested at once by a
+    // worker. Large enough that the SIMD lanes rarely run dry at the tail
+    static constexpr size_t CANDIDATE_BATCH = 1024;
+
+    // state private to one paint worker, padded to keep the orbit
+    // counters of neighbouring workers off the same cache line
+    // one layer per band, counts of the COUNTER type
+    using Histogram = std::variant<nhHistogram<uint32_t>, nhHistogram<uint64_t>, nhHistogram<float>>;
+
+    static Histogram EmptyHistogram( COUNTER counter );
+
+    // who may touch the histogram of a worker that has not published
+    enum ACTIVITY
+    {
+        IDLE,
+        PAINTING,
+        // being summed in place, Paint waits
+        READING,
+    };
+
+    struct alignas(64) WorkerState
+    {
+        Histogram               hits;
+        nhDepositBatch          deposits;
+        nhCheckpoint::WorkerRecord *record = nullptr;
+
+        // snapshot handed to the reader, allocated on the first request,
+        // and the last request it answers
+        Histogram               published;
+        std::atomic<uint64_t>   publishedEpoch{ 0 };
+        std::atomic<int>        activity{ IDLE };
+        std::atomic<uint64_t>   samplingNanos{ 0 };
+        uint64_t                publishNanos = 0;
+
+        // set while painting as a job
+        nhJob                  *job = nullptr;
+
+        // share of the orbit budget
+        uint64_t                orbitLimit = UINT64_MAX;
+
+        std::atomic<uint64_t>   orbits{ 0 };
+        std::atomic<uint64_t>   candidates{ 0 };
+        std::atomic<uint64_t>   bulbRejections{ 0 };
+        std::atomic<uint64_t>   cycleIterationsSaved{ 0 };
+
+        nhRandom                rng;
+        std::vector<double>     candidatesX;
+        std::vector<double>     candidatesY;
+        std::vector<int>        candidateIters;
+        size_t                  candidateCount = 0;
+        size_t                  nextCandidate = 0;
+
+        // current state of the metropolis chain, contribution 0 until
+        // the chain has been seeded
+        double                  chainX = 0.0;
+        double                  chainY = 0.0;
+        double                  chainContribution = 0.0;
+        unsigned                chainBands = 0;
+        unsigned                proposalBands = 0;
+
+        // orbit replay scratch: the kernel's ring of recent steps, accepted
+        // starting points whose orbit did not fit, and the recorded x,y
+        // pairs of the chain state and of the last proposal (length 0 when
+        // not recorded)
+        std::vector<double>     ringX;
+        std::vector<double>     ringY;
+        std::vector<double>     pendingX;
+        std::vector<double>     pendingY;
+        std::vector<unsigned>   pendingBands;
+        std::vector<double>     chainOrbit;
+        std::vector<double>     proposalOrbit;
+        int                     chainOrbitLength = 0;
+        int                     proposalOrbitLength = 0;
+    };
+
+    template <class Count>
+    class ReplaySink;
+
+    // the sampling loop of Paint for the counter type
+    template <class Count>
+    void PaintWith( WorkerState &worker, nhHistogram<Count> &hits );
+
+    // sums the worker histograms into p_sum
+    void SumHits();
+
+    // fills the candidate buffer of worker with a fresh batch, dropping
+    // the points the bulb tests already reject
+    void DrawCandidates( WorkerState &worker ) const;
+
+    // bit mask of the bands an orbit of count iterations belongs to, 0 when
+    // it is rejected
+    unsigned BandsOf( int count ) const
+    {
+        if ( count < p_minIter || count >= p_maxIter )
+        {
+            return 0;
+        }
+
+        unsigned bands = 0;
+        for ( size_t ii = 0; ii < p_bands.size(); ++ii )
+        {
+            if ( count >= p_bands[ii].minIter && count < p_bands[ii].maxIter )
+            {
+                bands |= 1u << ii;
+            }
+        }
+        return bands;
+    }
+
+    // Paint with job, or nullptr when not painting as a job
+    bool PaintAs( unsigned worker, nhJob *job );
+
+    // true once worker is to return from Paint
+    bool Stopping( const WorkerState &worker ) const
+    {
+        return p_paused || (worker.job && worker.job->StopRequested()) ||
+               worker.orbits.load( std::memory_order_relaxed ) >= worker.orbitLimit;
+    }
+
+    // true while a snapshot request waits for worker to publish
+    bool SnapshotRequested( const WorkerState &worker ) const
+    {
+        return p_snapshotEpoch.load( std::memory_order_acquire ) !=
+               worker.publishedEpoch.load( std::memory_order_relaxed );
+    }
+
+    // both also return the bands of the orbit of the point. False when
+    // stopping, or when a snapshot was requested while looking for a point,
+    // to be answered before looking on
+    bool GetAStartingPoint( WorkerState &worker, double &x, double &y, unsigned &bands ) const;
+    bool GetAMutatedPoint( WorkerState &worker, double &x, double &y, unsigned &bands ) const;
+
+    // draws and escape tests a batch while recording the orbits, accepted
+    // orbits are deposited straight from the recording
+    template <class Count>
+    void SampleAndReplay( WorkerState &worker, nhHistogram<Count> &hits );
+
+    // fraction of the orbit of c that lands inside the viewport, 0 when
+    // the orbit length is in no band. The bands of the orbit are stored in
+    // the proposal of worker, with record the orbit as well
+    double Contribution( WorkerState &worker, double cx, double cy, bool record ) const;
+
+    // moves the chain of worker to c along with the recorded proposal orbit
+    static void AcceptProposal( WorkerState &worker, double cx, double cy,
+                                double contribution );
+
+    // copies the counters and generator state of worker to its checkpoint
+    // record, after each orbit so the file is consistent at any point
+    static void SaveProgress( WorkerState &worker );
+
+    template <class Count>
+    void DepositOrbit( WorkerState &worker, nhHistogram<Count> &hits,
+                       double cx, double cy, unsigned bands );
+    template <class Count>
+    void DepositRecordedOrbit( WorkerState &worker, nhHistogram<Count> &hits,
+                               const double *orbit, int length, unsigned bands );
+
+    // counts one orbit point in the layer of each of bands, or holds the
+    // deposits back in the batch of worker
+    template <class Count>
+    void Deposit( WorkerState &worker, nhHistogram<Count> &hits, unsigned bands, double x, double y )
+    {
+        if constexpr ( std::is_floating_point<Count>::value )
+        {
+            if ( p_deposit == BILINEAR )
+            {
+                Splat( hits, bands, x, y );
+                return;
+            }
+        }
+
+        int px = 0, py = 0;
+        if ( nhImage::PixelAtPoint( x, y, px, py ) )
+        {
+            // increase pixel brightness
+            size_t index = hits.Index( px, py );
+            for ( ; bands != 0; bands >>= 1, index += hits.LayerSize() )
+            {
+                if ( !(bands & 1) )
+                {
+                    continue;
+                }
+                if ( p_batchDeposits )
+                {
+                    worker.deposits.Add( index );
+                }
+                else
+                {
+                    hits.Increment( index );
+                }
+            }
+        }
+    }
+
+    // spreads one hit of an orbit point over its four nearest pixel
+    // centers in the layer of each of bands. Weight falling off the image
+    // is lost
+    template <class Count>
+    void Splat( nhHistogram<Count> &hits, unsigned bands, double x, double y )
+    {
+        double fx = 0.0, fy = 0.0;
+        if ( !nhImage::PixelCoordinatesAtPoint( x, y, fx, fy ) )
+        {
+            return;
+        }
+
+        // the pixel centers left of and below the point
+        fx -= 0.5;
+        fy -= 0.5;
+        const double left = std::floor( fx );
+        const double bottom = std::floor( fy );
+        const Count tx = static_cast<Count>(fx - left);
+        const Count ty = static_cast<Count>(fy - bottom);
+        const int px = static_cast<int>(left);
+        const int py = static_cast<int>(bottom);
+
+        const Count weights[4] = { (1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty };
+        for ( int corner = 0; corner < 4; ++corner )
+        {
+            const int cx = px + (corner & 1);
+            const int cy = py + (corner >> 1);
+            if ( cx < 0 || cx >= p_resX || cy < 0 || cy >= p_resY )
+            {
+                continue;
+            }
+
+            size_t index = hits.Index( cx, cy );
+            for ( unsigned layers = bands; layers != 0; layers >>= 1, index += hits.LayerSize() )
+            {
+                if ( layers & 1 )
+                {
+                    hits.Add( index, weights[corner] );
+                }
+            }
+        }
+    }
+
+    // between two orbits: keeps or applies the held back deposits, answers a
+    // snapshot request and saves the progress once the histogram accounts
+    // for every orbit counted
+    template <class Count>
+    void FinishOrbit( WorkerState &worker, nhHistogram<Count> &hits );
+
+    // copies hits of worker to its published snapshot, with no deposits held
+    // back. Returns the time it took
+    template <class Count>
+    std::chrono::nanoseconds Publish( WorkerState &worker, nhHistogram<Count> &hits );
+
+    // applies the deposits worker held back once DEPOSIT_BATCH of them piled
+    // up, or all of them with force. True when none are left held back, so
+    // the histogram accounts for every orbit counted
+    template <class Count>
+    static bool FlushDeposits( WorkerState &worker, nhHistogram<Count> &hits, bool force )
+    {
+        if ( force || worker.deposits.Size() >= DEPOSIT_BATCH )
+        {
+            worker.deposits.Apply( hits );
+        }
+        return worker.deposits.Empty();
+    }
+
+    int p_maxIter;
+    int p_minIter;
+
+    std::vector<Band> p_bands;
+    Histogram         p_sum;
+
+    SAMPLER p_sampler;
+    bool    p_replayOrbits;
+    bool    p_batchDeposits;
+    DEPOSIT p_deposit;
+
+    nhEscapeKernel p_kernel;
+
+    // the render described by a checkpoint or WriteHistogram
+    nhCheckpoint::Header          p_header;
+    std::unique_ptr<nhCheckpoint> p_checkpoint;
+
+    std::vector<WorkerState> p_workers;
+
+    std::atomic_bool p_paused = false;
+
+    // raised by SumHits to ask the painting workers for a snapshot
+    std::atomic<uint64_t> p_snapshotEpoch{ 0 };
+
+    std::chrono::steady_clock::time_point p_created = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,229 @@
+#include <cmath>
+#include <limits>
+#include <string>
+#include <iostream>
+
+#include "random.h"
+#include "nebulabrot.h"
+
+// -----------------------------------------------------------------------------
+// Checks of the nhImage pixel mapping the orbit deposits rely on:
+//
+//   nebulabrotTests [--viewports N] [--seed N]
+//
+//   round trip   PixelAtPoint of the CENTER of every sampled pixel gives the
+//                pixel back, over N random viewports and resolutions
+//   edges        xmin and ymin land on the first pixel, points just short
+//                of xmax or ymax on the last one, xmax and ymax on none
+//   nan          NaN and infinite coordinates land on no pixel
+//
+// Prints the failures of each check and exits with 1 when any failed.
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// A viewport centered within [-2, 2]^2, spanning 1e-9 to 10 along each axis
+// independently, at 1 to 2048 pixels per axis
+// -----------------------------------------------------------------------------
+struct TestViewport
+{
+    double  xmin, xmax, ymin, ymax;
+    int     resX, resY;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static TestViewport RandomViewport( nhRandom &random )
+{
+    TestViewport view;
+    const double cx = random.NextDouble( -2.0, 2.0 );
+    const double cy = random.NextDouble( -2.0, 2.0 );
+    const double spanX = std::pow( 10.0, random.NextDouble( -9.0, 1.0 ) );
+    const double spanY = std::pow( 10.0, random.NextDouble( -9.0, 1.0 ) );
+    view.xmin = cx - 0.5 * spanX;
+    view.xmax = cx + 0.5 * spanX;
+    view.ymin = cy - 0.5 * spanY;
+    view.ymax = cy + 0.5 * spanY;
+    view.resX = 1 + static_cast<int>(random.NextU64() % 2048);
+    view.resY = 1 + static_cast<int>(random.NextU64() % 2048);
+    return view;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void PrintViewport( const TestViewport &view )
+{
+    std::cout.precision( 17 );
+    std::cout << "  view " << view.xmin << " " << view.xmax << " "
+              << view.ymin << " " << view.ymax << " at "
+              << view.resX << "x" << view.resY << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static int Report( const std::string &name, uint64_t checks, int failures )
+{
+    std::cout << name << ": " << checks << " checks, " << failures << " failures" << std::endl;
+    return failures;
+}
+
+// -----------------------------------------------------------------------------
+// The four corner pixels and 64 random ones of each viewport
+// -----------------------------------------------------------------------------
+static int TestRoundTrip( uint64_t seed, int viewports )
+{
+    nhRandom random( seed );
+    uint64_t checks = 0;
+    int failures = 0;
+    for ( int vv = 0; vv < viewports; ++vv )
+    {
+        const TestViewport view = RandomViewport( random );
+        const nhImage image( view.xmin, view.xmax, view.ymin, view.ymax, view.resX, view.resY );
+        for ( int ii = 0; ii < 68; ++ii )
+        {
+            int px = 0, py = 0;
+            if ( ii < 4 )
+            {
+                px = ii & 1 ? view.resX - 1 : 0;
+                py = ii & 2 ? view.resY - 1 : 0;
+            }
+            else
+            {
+                px = static_cast<int>(random.NextU64() % view.resX);
+                py = static_cast<int>(random.NextU64() % view.resY);
+            }
+
+            ++checks;
+            double x = 0.0, y = 0.0;
+            int qx = -1, qy = -1;
+            if ( !image.PointAtPixel( px, py, x, y, nhImage::CENTER ) ||
+                 !image.PixelAtPoint( x, y, qx, qy ) ||
+                 qx != px || qy != py )
+            {
+                if ( failures++ < 8 )
+                {
+                    std::cout << "round trip: pixel " << px << " " << py
+                              << " came back as " << qx << " " << qy << std::endl;
+                    PrintViewport( view );
+                }
+            }
+        }
+
+        // pixels outside the image have no point
+        double x = 0.0, y = 0.0;
+        checks += 4;
+        failures += image.PointAtPixel( -1, 0, x, y ) ? 1 : 0;
+        failures += image.PointAtPixel( 0, -1, x, y ) ? 1 : 0;
+        failures += image.PointAtPixel( view.resX, 0, x, y ) ? 1 : 0;
+        failures += image.PointAtPixel( 0, view.resY, x, y ) ? 1 : 0;
+    }
+    return Report( "round trip", checks, failures );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static int TestEdges( uint64_t seed, int viewports )
+{
+    nhRandom random( seed + 1 );
+    uint64_t checks = 0;
+    int failures = 0;
+    for ( int vv = 0; vv < viewports; ++vv )
+    {
+        const TestViewport view = RandomViewport( random );
+        const nhImage image( view.xmin, view.xmax, view.ymin, view.ymax, view.resX, view.resY );
+        const double midX = 0.5 * (view.xmin + view.xmax);
+        const double midY = 0.5 * (view.ymin + view.ymax);
+        const double belowX = std::nextafter( view.xmax, view.xmin );
+        const double belowY = std::nextafter( view.ymax, view.ymin );
+        const double inf = std::numeric_limits<double>::infinity();
+
+        int failed = 0;
+        int px = -1, py = -1;
+        failed += !image.PixelAtPoint( view.xmin, view.ymin, px, py ) || px != 0 || py != 0;
+        failed += !image.PixelAtPoint( belowX, belowY, px, py ) ||
+                  px != view.resX - 1 || py != view.resY - 1;
+        failed += image.PixelAtPoint( view.xmax, midY, px, py );
+        failed += image.PixelAtPoint( midX, view.ymax, px, py );
+        failed += image.PixelAtPoint( view.xmax, view.ymax, px, py );
+        failed += image.PixelAtPoint( std::nextafter( view.xmin, -inf ), midY, px, py );
+        failed += image.PixelAtPoint( midX, std::nextafter( view.ymin, -inf ), px, py );
+        checks += 7;
+
+        if ( failed > 0 && failures < 8 )
+        {
+            std::cout << "edges: " << failed << " wrong pixels" << std::endl;
+            PrintViewport( view );
+        }
+        failures += failed;
+    }
+    return Report( "edges", checks, failures );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static int TestNan()
+{
+    const nhImage image( -2.0, 1.0, -1.0, 1.0, 1200, 800 );
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double inf = std::numeric_limits<double>::infinity();
+    const double points[][2] = {
+        { nan, 0.0 }, { 0.0, nan }, { nan, nan },
+        { -nan, 0.0 }, { 0.0, -nan },
+        { inf, 0.0 }, { -inf, 0.0 }, { 0.0, inf }, { 0.0, -inf },
+    };
+
+    int failures = 0;
+    for ( const auto &point : points )
+    {
+        int px = -1, py = -1;
+        double fx = 0.0, fy = 0.0;
+        if ( image.PixelAtPoint( point[0], point[1], px, py ) ||
+             image.PixelCoordinatesAtPoint( point[0], point[1], fx, fy ) )
+        {
+            ++failures;
+            std::cout << "nan: " << point[0] << " " << point[1]
+                      << " landed on pixel " << px << " " << py << std::endl;
+        }
+    }
+    return Report( "nan", sizeof( points ) / sizeof( points[0] ), failures );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    try
+    {
+        int viewports = 1000;
+        uint64_t seed = 1;
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--viewports" && ii + 1 < argc )
+            {
+                viewports = std::stoi( argv[++ii] );
+            }
+            else if ( arg == "--seed" && ii + 1 < argc )
+            {
+                seed = std::stoull( argv[++ii] );
+            }
+            else
+            {
+                std::cerr << "usage: nebulabrotTests [--viewports N] [--seed N]" << std::endl;
+                return 1;
+            }
+        }
+
+        int failures = 0;
+        failures += TestRoundTrip( seed, viewports );
+        failures += TestEdges( seed, viewports );
+        failures += TestNan();
+
+        std::cout << (failures == 0 ? "PASSED" : "FAILED") << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
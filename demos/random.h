@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// xoshiro256** generator. Every instance is private to one thread, so drawing
+// numbers never takes a lock. Streams with the same seed but different stream
+// ids are decorrelated by running both through splitmix64 at seeding time.
+// -----------------------------------------------------------------------------
+class nhRandom
+{
+public:
+
+    using State = std::array<uint64_t, 4>;
+
+    explicit nhRandom( uint64_t seed = 0, uint64_t stream = 0 )
+    {
+        Seed( seed, stream );
+    }
+
+    void Seed( uint64_t seed, uint64_t stream = 0 )
+    {
+        uint64_t sm = seed ^ (stream * 0xd1342543de82ef95ull);
+        for ( auto &word : p_state )
+        {
+            word = SplitMix64( sm );
+        }
+    }
+
+    // raw generator state, to checkpoint and resume a sequence
+    const State &GetState() const { return p_state; }
+    void SetState( const State &state ) { p_state = state; }
+
+    uint64_t NextU64()
+    {
+        const uint64_t result = Rotl( p_state[1] * 5, 7 ) * 9;
+        const uint64_t t = p_state[1] << 17;
+
+        p_state[2] ^= p_state[0];
+        p_state[3] ^= p_state[1];
+        p_state[1] ^= p_state[2];
+        p_state[0] ^= p_state[3];
+        p_state[2] ^= t;
+        p_state[3] = Rotl( p_state[3], 45 );
+
+        return result;
+    }
+
+    // uniform double in [0, 1) using the top 53 bits
+    double NextDouble()
+    {
+        return (NextU64() >> 11) * 0x1.0p-53;
+    }
+
+    // uniform double in [lo, hi)
+    double NextDouble( double lo, double hi )
+    {
+        return lo + (hi - lo) * NextDouble();
+    }
+
+    // fills out with count uniform doubles in [lo, hi)
+    void Fill( double *out, size_t count, double lo, double hi )
+    {
+        const double span = hi - lo;
+        for ( size_t ii = 0; ii < count; ++ii )
+        {
+            out[ii] = lo + span * NextDouble();
+        }
+    }
+
+private:
+
+    static uint64_t Rotl( uint64_t x, int k )
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static uint64_t SplitMix64( uint64_t &x )
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    State p_state;
+};
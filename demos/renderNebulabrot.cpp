@@ -0,0 +1,359 @@
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "nebulabrot.h"
+#include "arguments.h"
+#include "../imageWriter.h"
+
+// -----------------------------------------------------------------------------
+// Renders a Buddhabrot or nebulabrot without a window, for batch and render
+// farm use:
+//
+//   renderNebulabrot [options] OUTPUT.png|OUTPUT.exr
+//
+//   --view XMIN XMAX YMIN YMAX   viewport, -2 1 -1 1 by default
+//   --size WxH                   resolution, 1200x800 by default
+//   --iterations MIN:MAX         orbit lengths kept, 50:10000 by default
+//   --band MIN:MAX[:RRGGBB]      repeated for each band of a nebulabrot
+//   --orbits N                   stops after N orbits
+//   --seconds S                  stops after S seconds of sampling
+//   --threads N --seed N --metropolis --replay --counter uint32|uint64|float
+//   --splat --tiled --batch-deposits
+//   --checkpoint FILE            histogram file, OUTPUT.ckpt by default
+//
+// Sampling runs on every core until the first budget is spent, or until
+// interrupted with Ctrl+C, which still writes the image and histogram; a
+// second Ctrl+C kills the render. The histogram is kept in an nhCheckpoint
+// file, so an interrupted render resumes and shards of several machines sum
+// with mergeShards. Float and tiled histograms are written to the same file
+// as merged 64 bit counts once sampling ends, float counts rounded to whole
+// hits, and do not resume. The image is a 16 bit RGB PNG or a float RGB EXR of
+// the heat plot.
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static bool EndsWith( const std::string &text, const std::string &suffix )
+{
+    return text.size() >= suffix.size() &&
+           text.compare( text.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+// raised by SIGINT, polled by Render
+static std::atomic<bool> s_interrupted( false );
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+extern "C" void OnInterrupt( int )
+{
+    s_interrupted.store( true, std::memory_order_relaxed );
+    std::signal( SIGINT, SIG_DFL );
+}
+
+// -----------------------------------------------------------------------------
+// Runs every worker of fractal as a job until the orbit budget or seconds are
+// spent or SIGINT arrives, reporting progress once a second. seconds <= 0 has
+// no time limit
+// -----------------------------------------------------------------------------
+static void Render( nhNebulabrot &fractal, double seconds )
+{
+    using Clock = std::chrono::steady_clock;
+
+    nhJobSystem jobs( fractal.WorkerCount() );
+    std::vector<std::shared_ptr<nhJob>> paintJobs;
+    for ( unsigned worker = 0; worker < fractal.WorkerCount(); ++worker )
+    {
+        paintJobs.push_back( jobs.Submit( [&fractal, worker]( nhJob &job ) { fractal.Paint( worker, job ); } ) );
+    }
+
+    const Clock::time_point start = Clock::now();
+    Clock::time_point report = start;
+    uint64_t reportedOrbits = fractal.OrbitCount();
+    while ( true )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+
+        bool done = true;
+        for ( const auto &job : paintJobs )
+        {
+            done = done && job->Done();
+        }
+        const Clock::time_point now = Clock::now();
+        if ( done || s_interrupted.load( std::memory_order_relaxed ) ||
+             (seconds > 0.0 && std::chrono::duration<double>( now - start ).count() >= seconds) )
+        {
+            break;
+        }
+
+        if ( now - report >= std::chrono::seconds( 1 ) )
+        {
+            uint64_t orbits = fractal.OrbitCount();
+            double interval = std::chrono::duration<double>( now - report ).count();
+            std::cout << orbits << " orbits, " << (orbits - reportedOrbits) / interval
+                      << " orbits/s" << std::endl;
+            report = now;
+            reportedOrbits = orbits;
+        }
+    }
+
+    // raises RequestStop on every worker, which ends at its next orbit
+    jobs.StopAll();
+
+    // StopAll swallows what the workers threw
+    for ( const auto &job : paintJobs )
+    {
+        job->Wait();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void WriteImage( nhNebulabrot &fractal, const std::string &path, unsigned threads,
+                        uint32_t width, uint32_t height )
+{
+    nhToneMapper toneMapper( threads );
+    std::vector<float> rgb( 3 * static_cast<size_t>(width) * height );
+    fractal.GetHeatPlot( toneMapper, rgb.data() );
+
+    if ( EndsWith( path, ".exr" ) )
+    {
+        writeExr( path, rgb.data(), width, height, 3 );
+        return;
+    }
+
+    std::vector<uint16_t> pixels( rgb.size() );
+    for ( size_t ii = 0; ii < rgb.size(); ++ii )
+    {
+        pixels[ii] = static_cast<uint16_t>(std::lround( rgb[ii] * 65535.0f ));
+    }
+    writePng( path, pixels.data(), width, height, 3, 16 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    double view[4] = { -2.0, 1.0, -1.0, 1.0 };
+    int width = 1200, height = 800;
+    int minIter = 50, maxIter = 10000;
+    double seconds = 0.0;
+    nhNebulabrot::Options options;
+    std::string output;
+    try
+    {
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--view" && ii + 4 < argc )
+            {
+                for ( double &bound : view )
+                {
+                    bound = ParseDouble( arg, argv[++ii] );
+                }
+            }
+            else if ( arg == "--size" && ii + 1 < argc )
+            {
+                std::string size( argv[++ii] );
+                size_t split = size.find( 'x' );
+                if ( split == std::string::npos )
+                {
+                    throw std::runtime_error( "size " + size + " is not WxH!" );
+                }
+
+                // 65536 on a side is already 16 GiB of 32 bit counts
+                const uint64_t w = ParseUnsigned( arg, size.substr( 0, split ) );
+                const uint64_t h = ParseUnsigned( arg, size.substr( split + 1 ) );
+                if ( w > 65536 || h > 65536 )
+                {
+                    throw std::runtime_error( "size " + size + " is larger than 65536x65536!" );
+                }
+                width = static_cast<int>(w);
+                height = static_cast<int>(h);
+            }
+            else if ( arg == "--iterations" && ii + 1 < argc )
+            {
+                // a band without a color is parsed the same way
+                nhNebulabrot::Band range = nhNebulabrot::ParseBand( argv[++ii] );
+                minIter = range.minIter;
+                maxIter = range.maxIter;
+            }
+            else if ( arg == "--band" && ii + 1 < argc )
+            {
+                options.bands.push_back( nhNebulabrot::ParseBand( argv[++ii] ) );
+            }
+            else if ( arg == "--orbits" && ii + 1 < argc )
+            {
+                options.orbitBudget = ParseUnsigned( arg, argv[++ii] );
+            }
+            else if ( arg == "--seconds" && ii + 1 < argc )
+            {
+                seconds = ParseNonNegative( arg, argv[++ii] );
+            }
+            else if ( arg == "--threads" && ii + 1 < argc )
+            {
+                options.workerCount = static_cast<unsigned>(std::min<uint64_t>(
+                    ParseUnsigned( arg, argv[++ii] ), std::numeric_limits<unsigned>::max() ));
+            }
+            else if ( arg == "--seed" && ii + 1 < argc )
+            {
+                options.seed = ParseUnsigned( arg, argv[++ii] );
+            }
+            else if ( arg == "--metropolis" )
+            {
+                options.sampler = nhNebulabrot::METROPOLIS;
+            }
+            else if ( arg == "--replay" )
+            {
+                options.replayOrbits = true;
+            }
+            else if ( arg == "--counter" && ii + 1 < argc )
+            {
+                std::string counter( argv[++ii] );
+                if ( counter == "uint32" )
+                {
+                    options.counter = nhNebulabrot::COUNT_UINT32;
+                }
+                else if ( counter == "uint64" )
+                {
+                    options.counter = nhNebulabrot::COUNT_UINT64;
+                }
+                else if ( counter == "float" )
+                {
+                    options.counter = nhNebulabrot::COUNT_FLOAT;
+                }
+                else
+                {
+                    throw std::runtime_error( "unknown counter " + counter + "!" );
+                }
+            }
+            else if ( arg == "--splat" )
+            {
+                options.deposit = nhNebulabrot::BILINEAR;
+                options.counter = nhNebulabrot::COUNT_FLOAT;
+            }
+            else if ( arg == "--tiled" )
+            {
+                options.layout = nhHistogramLayout::TILED;
+            }
+            else if ( arg == "--batch-deposits" )
+            {
+                options.batchDeposits = true;
+            }
+            else if ( arg == "--checkpoint" && ii + 1 < argc )
+            {
+                options.checkpointFile = argv[++ii];
+            }
+            else if ( arg.size() > 1 && arg[0] == '-' )
+            {
+                // an unknown flag, or a known one missing its value
+                throw std::runtime_error( "unknown argument " + arg + "!" );
+            }
+            else if ( !output.empty() )
+            {
+                throw std::runtime_error( "more than one output, " + output + " and " + arg + "!" );
+            }
+            else
+            {
+                output = arg;
+            }
+        }
+
+        if ( !EndsWith( output, ".png" ) && !EndsWith( output, ".exr" ) )
+        {
+            throw std::runtime_error( "output must be a .png or .exr file!" );
+        }
+
+        if ( width <= 0 || height <= 0 )
+        {
+            throw std::runtime_error( "size must be at least 1x1!" );
+        }
+        if ( !(view[0] < view[1]) || !(view[2] < view[3]) )
+        {
+            throw std::runtime_error( "view must have XMIN < XMAX and YMIN < YMAX!" );
+        }
+        if ( minIter >= maxIter )
+        {
+            throw std::runtime_error( "iterations must have MIN < MAX!" );
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "usage: renderNebulabrot [--view XMIN XMAX YMIN YMAX] [--size WxH] "
+                     "[--iterations MIN:MAX] [--band MIN:MAX[:RRGGBB]]... [--orbits N] "
+                     "[--seconds S] [--threads N] [--seed N] [--metropolis] [--replay] "
+                     "[--counter uint32|uint64|float] [--splat] [--tiled] [--batch-deposits] "
+                     "[--checkpoint FILE] OUTPUT.png|OUTPUT.exr" << std::endl;
+        return 1;
+    }
+
+    if ( options.checkpointFile.empty() )
+    {
+        options.checkpointFile = output.substr( 0, output.size() - 4 ) + ".ckpt";
+    }
+
+    // float and tiled histograms cannot live in the file while sampling, they
+    // are written once at the end and the render cannot be resumed
+    const std::string histogramFile = options.checkpointFile;
+    const bool checkpointed = options.counter != nhNebulabrot::COUNT_FLOAT &&
+                              options.layout == nhHistogramLayout::ROW_MAJOR;
+    if ( !checkpointed )
+    {
+        options.checkpointFile.clear();
+    }
+
+    try
+    {
+        nhNebulabrot fractal( view[0], view[1], view[2], view[3], width, height, maxIter, minIter, options );
+        if ( fractal.Resumed() )
+        {
+            std::cout << "resuming " << options.checkpointFile << " at "
+                      << fractal.OrbitCount() << " orbits" << std::endl;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        const uint64_t startOrbits = fractal.OrbitCount();
+        std::signal( SIGINT, OnInterrupt );
+        Render( fractal, seconds );
+        const double elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+        if ( s_interrupted.load( std::memory_order_relaxed ) )
+        {
+            std::cout << "interrupted" << std::endl;
+        }
+
+        const uint64_t orbits = fractal.OrbitCount();
+        std::cout << orbits << " orbits, " << (orbits - startOrbits) / elapsed << " orbits/s over "
+                  << elapsed << " s on " << fractal.WorkerCount() << " workers, sampler duty cycle "
+                  << 100.0 * fractal.DutyCycle() << "%" << std::endl;
+
+        WriteImage( fractal, output, options.workerCount, static_cast<uint32_t>(width),
+                    static_cast<uint32_t>(height) );
+        if ( checkpointed )
+        {
+            fractal.FlushCheckpoint();
+        }
+        else
+        {
+            fractal.WriteHistogram( histogramFile );
+        }
+
+        std::cout << "wrote " << output << " and " << histogramFile << std::endl;
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "random.h"
+#include "toneMapper.h"
+#include "arguments.h"
+
+// -----------------------------------------------------------------------------
+// Per pixel std::pow mapping nhToneMapper replaces, kept as the reference
+// for speed and output
+// -----------------------------------------------------------------------------
+static void ReferenceHeatPlot( const std::vector<uint32_t> &hits, std::vector<unsigned char> &hitPixels )
+{
+    uint32_t maxHits = 0u;
+    for ( size_t ii = 0; ii < hits.size(); ++ii )
+    {
+        maxHits = std::max( maxHits, hits[ii] );
+    }
+
+    std::fill( hitPixels.begin(), hitPixels.end(), 0 );
+    for ( size_t ii = 0; ii < hits.size(); ++ii )
+    {
+        uint8_t *pixel = &hitPixels[4 * ii];
+        pixel[3] = 255;
+        if ( hits[ii] == 0 || maxHits == 0 )
+        {
+            continue;
+        }
+        float density = 1.0f * hits[ii] / maxHits;
+        density = std::clamp( std::pow( density, 0.85f ), 0.0f, 1.0f );
+        uint8_t intensity = static_cast<uint8_t>(255 * density);
+        if ( intensity != 0 )
+        {
+            pixel[0] = intensity;
+            pixel[1] = intensity;
+            pixel[2] = static_cast<uint8_t>(std::pow( (intensity / 255.0f), 0.85f ) * 255);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Buddhabrot like histogram: mostly small counts, a long tail of bright
+// pixels and a fraction of empty ones
+// -----------------------------------------------------------------------------
+static std::vector<uint32_t> SyntheticHits( uint32_t width, uint32_t height )
+{
+    nhRandom rng( 1 );
+    std::vector<uint32_t> hits( static_cast<size_t>(width) * height );
+    for ( auto &count : hits )
+    {
+        double u = rng.NextDouble();
+        count = u < 0.2 ? 0 : static_cast<uint32_t>(std::exp( 14.0 * u * u * u ));
+    }
+    return hits;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class F>
+static double MegapixelsPerSecond( size_t pixels, double seconds, const F &map )
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    map();  // warm up caches and threads
+
+    int runs = 0;
+    auto start = Clock::now();
+    double elapsed = 0.0;
+    while ( elapsed < seconds )
+    {
+        map();
+        ++runs;
+        elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+    }
+    return elapsed > 0.0 ? pixels * runs / elapsed * 1.0e-6 : 0.0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    unsigned threads = 0;
+    double seconds = 1.0;
+    try
+    {
+        for ( int ii = 1; ii < argc; ++ii )
+        {
+            std::string arg( argv[ii] );
+            if ( arg == "--threads" && ii + 1 < argc )
+            {
+                threads = static_cast<unsigned>(std::min<uint64_t>(
+                    ParseUnsigned( arg, argv[++ii] ), std::numeric_limits<unsigned>::max() ));
+            }
+            else if ( arg == "--seconds" && ii + 1 < argc )
+            {
+                seconds = ParseDouble( arg, argv[++ii] );
+            }
+            else
+            {
+                throw std::runtime_error( "unknown argument " + arg + "!" );
+            }
+        }
+
+        // zero seconds measure nothing
+        if ( seconds <= 0.0 )
+        {
+            throw std::runtime_error( "--seconds must be positive!" );
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "usage: toneMapBench [--threads N] [--seconds S]" << std::endl;
+        return 1;
+    }
+
+    struct Resolution
+    {
+        const char *name;
+        uint32_t    width;
+        uint32_t    height;
+    };
+    const Resolution resolutions[] = { { "1200x800", 1200, 800 }, { "8K", 7680, 4320 } };
+
+    nhToneMapper single( 1 );
+    nhToneMapper banded( threads );
+
+    for ( const auto &res : resolutions )
+    {
+        std::vector<uint32_t> hits = SyntheticHits( res.width, res.height );
+        std::vector<unsigned char> reference( 4 * hits.size() );
+        std::vector<unsigned char> pixels( 4 * hits.size() );
+
+        double referenceRate = MegapixelsPerSecond( hits.size(), seconds, [&]
+        {
+            ReferenceHeatPlot( hits, reference );
+        } );
+        double singleRate = MegapixelsPerSecond( hits.size(), seconds, [&]
+        {
+            single.Map( hits.data(), res.width, res.height, pixels.data() );
+        } );
+        double bandedRate = MegapixelsPerSecond( hits.size(), seconds, [&]
+        {
+            banded.Map( hits.data(), res.width, res.height, pixels.data() );
+        } );
+
+        int maxDiff = 0;
+        size_t differing = 0;
+        for ( size_t ii = 0; ii < pixels.size(); ++ii )
+        {
+            int diff = std::abs( pixels[ii] - reference[ii] );
+            maxDiff = std::max( maxDiff, diff );
+            differing += diff != 0 ? 1 : 0;
+        }
+
+        std::cout << res.name << ": reference " << referenceRate << " MP/s, 1 band "
+                  << singleRate << " MP/s, " << banded.Threads() << " bands "
+                  << bandedRate << " MP/s, max channel difference " << maxDiff
+                  << " on " << differing << " channels" << std::endl;
+    }
+
+    return 0;
+}
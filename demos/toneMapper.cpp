@@ -0,0 +1,374 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NH_TONE_MAPPER_SSE2
+#endif
+
+#include "toneMapper.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+nhToneMapper::nhToneMapper( unsigned threads )
+    : p_threads( threads != 0 ? threads : std::max( 1u, std::thread::hardware_concurrency() ) )
+{
+    // same curve as nhNebulabrot used per pixel: density^0.85 for red and
+    // green, and that intensity once more through ^0.85 for blue
+    for ( size_t ii = 0; ii < LUT_SIZE; ++ii )
+    {
+        float density = static_cast<float>(ii) / (LUT_SIZE - 1);
+        density = std::clamp( std::pow( density, 0.85f ), 0.0f, 1.0f );
+        uint8_t intensity = static_cast<uint8_t>(255 * density);
+        p_intensity[ii] = 255 * density;
+
+        auto &pixel = p_lut[ii];
+        pixel = { 0, 0, 0, 255 };
+        if ( intensity != 0 )
+        {
+            pixel[0] = intensity;
+            pixel[1] = intensity;
+            pixel[2] = static_cast<uint8_t>(std::pow( (intensity / 255.0f), 0.85f ) * 255);
+        }
+    }
+
+    if ( p_threads > 1 )
+    {
+        p_pool = std::make_unique<nhJobSystem>( p_threads - 1 );
+    }
+    p_bandJobs.reserve( p_threads );
+    p_bandMax.resize( p_threads );
+}
+
+// -----------------------------------------------------------------------------
+// 32 bit counts use fixed point, with hits never above maxHits the product
+// stays below 2^(32 + LUT_BITS)
+// -----------------------------------------------------------------------------
+template <>
+struct nhToneMapper::Quantizer<uint32_t>
+{
+    explicit Quantizer( double maxHits )
+        : scale( maxHits != 0 ? ((uint64_t( LUT_SIZE - 1 ) << 32) / static_cast<uint64_t>(maxHits)) : 0 )
+    {
+    }
+
+    size_t operator()( uint32_t count ) const
+    {
+        return static_cast<size_t>((count * scale + 0x80000000u) >> 32);
+    }
+
+    uint64_t scale;
+};
+
+// -----------------------------------------------------------------------------
+// wider and fractional counts go through double
+// -----------------------------------------------------------------------------
+template <class Count>
+struct nhToneMapper::Quantizer
+{
+    explicit Quantizer( double maxHits )
+        : scale( maxHits > 0 ? (LUT_SIZE - 1) / maxHits : 0.0 )
+    {
+    }
+
+    size_t operator()( Count count ) const
+    {
+        return static_cast<size_t>(static_cast<double>(count) * scale + 0.5);
+    }
+
+    double scale;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <>
+uint32_t nhToneMapper::MaxHits( const uint32_t *hits, size_t count )
+{
+    size_t ii = 0;
+    uint32_t maxHits = 0;
+
+#if defined(NH_TONE_MAPPER_SSE2)
+    // SSE2 only compares signed lanes: flipping the sign bit maps unsigned
+    // order onto signed order
+    const __m128i bias = _mm_set1_epi32( static_cast<int>(0x80000000u) );
+    __m128i max0 = bias, max1 = bias;
+    for ( ; ii + 8 <= count; ii += 8 )
+    {
+        __m128i a = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast<const __m128i *>(hits + ii) ), bias );
+        __m128i b = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast<const __m128i *>(hits + ii + 4) ), bias );
+        __m128i gtA = _mm_cmpgt_epi32( a, max0 );
+        __m128i gtB = _mm_cmpgt_epi32( b, max1 );
+        max0 = _mm_or_si128( _mm_and_si128( gtA, a ), _mm_andnot_si128( gtA, max0 ) );
+        max1 = _mm_or_si128( _mm_and_si128( gtB, b ), _mm_andnot_si128( gtB, max1 ) );
+    }
+
+    alignas(16) uint32_t lanes[8];
+    _mm_store_si128( reinterpret_cast<__m128i *>(lanes), _mm_xor_si128( max0, bias ) );
+    _mm_store_si128( reinterpret_cast<__m128i *>(lanes + 4), _mm_xor_si128( max1, bias ) );
+    for ( uint32_t lane : lanes )
+    {
+        maxHits = std::max( maxHits, lane );
+    }
+#endif
+
+    for ( ; ii < count; ++ii )
+    {
+        maxHits = std::max( maxHits, hits[ii] );
+    }
+    return maxHits;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+Count nhToneMapper::MaxHits( const Count *hits, size_t count )
+{
+    Count maxHits = 0;
+    for ( size_t ii = 0; ii < count; ++ii )
+    {
+        maxHits = std::max( maxHits, hits[ii] );
+    }
+    return maxHits;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhToneMapper::MapRange( const Count *hits, size_t count, const Quantizer<Count> &quantize,
+                             unsigned char *rgba ) const
+{
+    for ( size_t ii = 0; ii < count; ++ii )
+    {
+        std::memcpy( rgba + 4 * ii, p_lut[quantize( hits[ii] )].data(), 4 );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// The band jobs refer to job, so whatever throws, be it a band, the
+// submission or a wait, every band job has returned before this does. The
+// first exception is rethrown once all of them have
+// -----------------------------------------------------------------------------
+template <class Job>
+void nhToneMapper::ForEachBand( uint32_t height, const Job &job )
+{
+    const uint32_t bands = std::min<uint32_t>( p_threads, std::max( height, 1u ) );
+    const uint32_t bandRows = (height + bands - 1) / bands;
+
+    struct WaitForBands
+    {
+        std::vector<std::shared_ptr<nhJob>> &jobs;
+
+        ~WaitForBands()
+        {
+            for ( auto &bandJob : jobs )
+            {
+                try
+                {
+                    bandJob->Wait();
+                }
+                catch ( ... )
+                {
+                }
+            }
+            jobs.clear();
+        }
+    } waitForBands{ p_bandJobs };
+
+    for ( uint32_t band = 1; band < bands; ++band )
+    {
+        uint32_t first = band * bandRows;
+        uint32_t rows = first < height ? std::min( bandRows, height - first ) : 0;
+        p_bandJobs.push_back( p_pool->Submit( [&job, band, first, rows]( nhJob & )
+        {
+            job( band, first, rows );
+        } ) );
+    }
+
+    job( 0, 0, std::min( bandRows, height ) );
+
+    // rethrows what a band threw, waitForBands waits out the rest
+    for ( auto &bandJob : p_bandJobs )
+    {
+        bandJob->Wait();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhToneMapper::Map( const Count *hits, uint32_t width, uint32_t height, unsigned char *rgba )
+{
+    p_bandMax.assign( p_threads, 0.0 );
+    ForEachBand( height, [this, hits, width]( uint32_t band, uint32_t first, uint32_t rows )
+    {
+        p_bandMax[band] = static_cast<double>(MaxHits( hits + static_cast<size_t>(first) * width,
+                                                       static_cast<size_t>(rows) * width ));
+    } );
+
+    // an empty histogram maps every count (all 0) to the first entry
+    const Quantizer<Count> quantize( *std::max_element( p_bandMax.begin(), p_bandMax.end() ) );
+
+    ForEachBand( height, [this, hits, rgba, width, &quantize]( uint32_t, uint32_t first, uint32_t rows )
+    {
+        size_t offset = static_cast<size_t>(first) * width;
+        MapRange( hits + offset, static_cast<size_t>(rows) * width, quantize, rgba + 4 * offset );
+    } );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhToneMapper::ReduceLayers( const Count *hits, uint32_t layers, size_t layerSize,
+                                 uint32_t band, uint32_t first, uint32_t rows, uint32_t width )
+{
+    for ( uint32_t layer = 0; layer < layers; ++layer )
+    {
+        p_bandMax[band * layers + layer] =
+            static_cast<double>(MaxHits( hits + layer * layerSize + static_cast<size_t>(first) * width,
+                                         static_cast<size_t>(rows) * width ));
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhToneMapper::Compose( const Count *hits, const Color *colors, uint32_t layers,
+                            uint32_t width, uint32_t height, unsigned char *rgba )
+{
+    const size_t layerSize = static_cast<size_t>(width) * height;
+
+    std::vector<Quantizer<Count>> quantizers;
+    for ( double maxHits : LayerMaxHits( hits, layers, width, height ) )
+    {
+        quantizers.emplace_back( maxHits );
+    }
+
+    ForEachBand( height, [&]( uint32_t, uint32_t first, uint32_t rows )
+    {
+        const size_t begin = static_cast<size_t>(first) * width;
+        const size_t end = begin + static_cast<size_t>(rows) * width;
+        for ( size_t ii = begin; ii < end; ++ii )
+        {
+            float rgb[3] = { 0.0f, 0.0f, 0.0f };
+            for ( uint32_t layer = 0; layer < layers; ++layer )
+            {
+                float intensity = p_intensity[quantizers[layer]( hits[layer * layerSize + ii] )];
+                rgb[0] += intensity * colors[layer][0];
+                rgb[1] += intensity * colors[layer][1];
+                rgb[2] += intensity * colors[layer][2];
+            }
+
+            unsigned char *pixel = rgba + 4 * ii;
+            pixel[0] = static_cast<unsigned char>(std::min( rgb[0], 255.0f ));
+            pixel[1] = static_cast<unsigned char>(std::min( rgb[1], 255.0f ));
+            pixel[2] = static_cast<unsigned char>(std::min( rgb[2], 255.0f ));
+            pixel[3] = 255;
+        }
+    } );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+std::vector<double> nhToneMapper::LayerMaxHits( const Count *hits, uint32_t layers,
+                                                uint32_t width, uint32_t height )
+{
+    const size_t layerSize = static_cast<size_t>(width) * height;
+
+    p_bandMax.assign( static_cast<size_t>(p_threads) * layers, 0.0 );
+    ForEachBand( height, [&]( uint32_t band, uint32_t first, uint32_t rows )
+    {
+        ReduceLayers( hits, layers, layerSize, band, first, rows, width );
+    } );
+
+    std::vector<double> maxHits( layers, 0.0 );
+    for ( uint32_t layer = 0; layer < layers; ++layer )
+    {
+        for ( unsigned band = 0; band < p_threads; ++band )
+        {
+            maxHits[layer] = std::max( maxHits[layer], p_bandMax[band * layers + layer] );
+        }
+    }
+    return maxHits;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhToneMapper::MapFloat( const Count *hits, uint32_t width, uint32_t height, float *rgb )
+{
+    const double maxHits = LayerMaxHits( hits, 1, width, height )[0];
+    const double scale = maxHits > 0.0 ? 1.0 / maxHits : 0.0;
+
+    ForEachBand( height, [&]( uint32_t, uint32_t first, uint32_t rows )
+    {
+        const size_t begin = static_cast<size_t>(first) * width;
+        const size_t end = begin + static_cast<size_t>(rows) * width;
+        for ( size_t ii = begin; ii < end; ++ii )
+        {
+            float density = static_cast<float>(std::min( static_cast<double>(hits[ii]) * scale, 1.0 ));
+            float intensity = std::pow( density, 0.85f );
+            rgb[3 * ii] = intensity;
+            rgb[3 * ii + 1] = intensity;
+            rgb[3 * ii + 2] = std::pow( intensity, 0.85f );
+        }
+    } );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Count>
+void nhToneMapper::ComposeFloat( const Count *hits, const Color *colors, uint32_t layers,
+                                 uint32_t width, uint32_t height, float *rgb )
+{
+    const size_t layerSize = static_cast<size_t>(width) * height;
+
+    std::vector<double> scales = LayerMaxHits( hits, layers, width, height );
+    for ( double &scale : scales )
+    {
+        scale = scale > 0.0 ? 1.0 / scale : 0.0;
+    }
+
+    ForEachBand( height, [&]( uint32_t, uint32_t first, uint32_t rows )
+    {
+        const size_t begin = static_cast<size_t>(first) * width;
+        const size_t end = begin + static_cast<size_t>(rows) * width;
+        for ( size_t ii = begin; ii < end; ++ii )
+        {
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            for ( uint32_t layer = 0; layer < layers; ++layer )
+            {
+                double density = std::min( static_cast<double>(hits[layer * layerSize + ii]) * scales[layer], 1.0 );
+                float intensity = std::pow( static_cast<float>(density), 0.85f );
+                sum[0] += intensity * colors[layer][0];
+                sum[1] += intensity * colors[layer][1];
+                sum[2] += intensity * colors[layer][2];
+            }
+
+            rgb[3 * ii] = std::min( sum[0], 1.0f );
+            rgb[3 * ii + 1] = std::min( sum[1], 1.0f );
+            rgb[3 * ii + 2] = std::min( sum[2], 1.0f );
+        }
+    } );
+}
+
+// the count types nhHistogram is used with
+template uint64_t nhToneMapper::MaxHits( const uint64_t *, size_t );
+template float nhToneMapper::MaxHits( const float *, size_t );
+
+template void nhToneMapper::Map( const uint32_t *, uint32_t, uint32_t, unsigned char * );
+template void nhToneMapper::Map( const uint64_t *, uint32_t, uint32_t, unsigned char * );
+template void nhToneMapper::Map( const float *, uint32_t, uint32_t, unsigned char * );
+
+template void nhToneMapper::Compose( const uint32_t *, const Color *, uint32_t, uint32_t, uint32_t, unsigned char * );
+template void nhToneMapper::Compose( const uint64_t *, const Color *, uint32_t, uint32_t, uint32_t, unsigned char * );
+template void nhToneMapper::Compose( const float *, const Color *, uint32_t, uint32_t, uint32_t, unsigned char * );
+
+template void nhToneMapper::MapFloat( const uint32_t *, uint32_t, uint32_t, float * );
+template void nhToneMapper::MapFloat( const uint64_t *, uint32_t, uint32_t, float * );
+template void nhToneMapper::MapFloat( const float *, uint32_t, uint32_t, float * );
+
+template void nhToneMapper::ComposeFloat( const uint32_t *, const Color *, uint32_t, uint32_t, uint32_t, float * );
+template void nhToneMapper::ComposeFloat( const uint64_t *, const Color *, uint32_t, uint32_t, uint32_t, float * );
+template void nhToneMapper::ComposeFloat( const float *, const Color *, uint32_t, uint32_t, uint32_t, float * );
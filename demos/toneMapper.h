@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "jobSystem.h"
+
+// -----------------------------------------------------------------------------
+// Heat plot of a hit count histogram, the CPU counterpart of
+// shaders/tonemap.comp. Counts are normalized by the largest one and looked
+// up in a table of finished pixels indexed by quantized density, so mapping
+// a pixel takes a multiply, a shift and a load instead of two std::pow
+// calls. The table only depends on density and is built once. Rows are split
+// into bands that are reduced and mapped in parallel on a pool of threads
+// started with the mapper. Output goes to a caller provided buffer.
+// Several histograms, such as the iteration bands of a Nebulabrot, are
+// composed into one image by weighting each one's intensity with a color.
+// Counts are uint32_t, uint64_t or float, see nhHistogram.
+// -----------------------------------------------------------------------------
+class nhToneMapper
+{
+public:
+
+    // rgb weights in [0, 1]
+    using Color = std::array<float, 3>;
+
+    // 0 sizes the band count to the hardware concurrency
+    explicit nhToneMapper( unsigned threads = 0 );
+
+    unsigned Threads() const { return p_threads; }
+
+    // writes width * height rgba8 pixels for hits, both row major, to rgba
+    template <class Count>
+    void Map( const Count *hits, uint32_t width, uint32_t height, unsigned char *rgba );
+
+    // writes width * height rgba8 pixels for layers histograms of
+    // width * height counts stored back to back in hits. Each histogram is
+    // normalized on its own and adds its intensity times its color, sums
+    // saturate
+    template <class Count>
+    void Compose( const Count *hits, const Color *colors, uint32_t layers,
+                  uint32_t width, uint32_t height, unsigned char *rgba );
+
+    // the curves of Map and Compose computed exactly instead of through the
+    // table, into width * height rgb floats in [0, 1], for 16 bit and float
+    // images
+    template <class Count>
+    void MapFloat( const Count *hits, uint32_t width, uint32_t height, float *rgb );
+    template <class Count>
+    void ComposeFloat( const Count *hits, const Color *colors, uint32_t layers,
+                       uint32_t width, uint32_t height, float *rgb );
+
+    // largest of count hit counts, a SIMD reduction for uint32_t
+    template <class Count>
+    static Count MaxHits( const Count *hits, size_t count );
+
+private:
+
+    // density steps of the table, fine enough that neighbouring entries
+    // differ by less than one intensity level
+    static constexpr int    LUT_BITS = 14;
+    static constexpr size_t LUT_SIZE = size_t( 1 ) << LUT_BITS;
+
+    // table index of a count, normalized by the largest count
+    template <class Count>
+    struct Quantizer;
+
+    template <class Count>
+    void MapRange( const Count *hits, size_t count, const Quantizer<Count> &quantize,
+                   unsigned char *rgba ) const;
+
+    // largest count of each layer over rows [first, first + rows) into
+    // p_bandMax[band * layers + layer]
+    template <class Count>
+    void ReduceLayers( const Count *hits, uint32_t layers, size_t layerSize,
+                       uint32_t band, uint32_t first, uint32_t rows, uint32_t width );
+
+    // largest count of each of layers histograms of width * height counts
+    template <class Count>
+    std::vector<double> LayerMaxHits( const Count *hits, uint32_t layers,
+                                      uint32_t width, uint32_t height );
+
+    // runs job( band, firstRow, rowCount ) for every band, band 0 on the
+    // calling thread and the others on p_pool
+    template <class Job>
+    void ForEachBand( uint32_t height, const Job &job );
+
+    std::array<std::array<unsigned char, 4>, LUT_SIZE> p_lut;
+
+    // the red channel of p_lut before rounding, for composing
+    std::array<float, LUT_SIZE> p_intensity;
+
+    unsigned                            p_threads;
+    std::unique_ptr<nhJobSystem>        p_pool;
+    std::vector<std::shared_ptr<nhJob>> p_bandJobs;
+    std::vector<double>                 p_bandMax;
+};
+
+// SSE2 reduction, defined in toneMapper.cpp
+template <>
+uint32_t nhToneMapper::MaxHits( const uint32_t *hits, size_t count );
@@ -0,0 +1,285 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+#include "frameTimer.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+const char *FrameTimer::phaseName( PHASE phase )
+{
+    switch ( phase )
+    {
+    case WAIT_FENCE:      return "wait fence";
+    case ACQUIRE:         return "acquire";
+    case UPDATE_UNIFORMS: return "update uniforms";
+    case SUBMIT:          return "submit";
+    case PRESENT:         return "present";
+    case PHASE_COUNT:     break;
+    }
+    return "unknown";
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t FrameTimer::Frame::cpuNanos() const
+{
+    uint64_t total = 0;
+    for ( uint64_t nanos : phaseNanos )
+    {
+        total += nanos;
+    }
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t FrameTimer::Frame::phaseEnd( PHASE phase ) const
+{
+    uint64_t end = start;
+    for ( int ii = 0; ii <= phase; ++ii )
+    {
+        end += phaseNanos[ii];
+    }
+    return end;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+FrameTimer::FrameTimer( size_t capacity )
+    : _slots( new Slot[std::max<size_t>( capacity, 1 )] ),
+      _capacity( std::max<size_t>( capacity, 1 ) )
+{
+}
+
+// -----------------------------------------------------------------------------
+// Single writer sequence lock per slot: readers copy the words and keep them
+// when the sequence was even and unchanged around the copy
+// -----------------------------------------------------------------------------
+void FrameTimer::commit( Frame frame )
+{
+    if ( frame.gpuNanos > 0 )
+    {
+        // the device cannot start a frame before it was submitted, a frame
+        // that would shows the offset hid some queue latency of the frame
+        // it was taken from, so it moves up to the tighter bound
+        const int64_t offset = static_cast<int64_t>(frame.phaseEnd( SUBMIT ) - frame.gpuStart);
+        if ( !_gpuClockMapped || offset > _gpuClockOffset )
+        {
+            _gpuClockOffset = offset;
+            _gpuClockMapped = true;
+        }
+        frame.gpuStart += _gpuClockOffset;
+    }
+
+    uint64_t words[FRAME_WORDS];
+    std::memcpy( words, &frame, sizeof( frame ) );
+
+    const uint64_t committed = _committed.load( std::memory_order_relaxed );
+    Slot &slot = _slots[committed % _capacity];
+    const uint64_t sequence = slot.sequence.load( std::memory_order_relaxed );
+    slot.sequence.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    for ( size_t ii = 0; ii < FRAME_WORDS; ++ii )
+    {
+        slot.words[ii].store( words[ii], std::memory_order_relaxed );
+    }
+    slot.sequence.store( sequence + 2, std::memory_order_release );
+    _committed.store( committed + 1, std::memory_order_release );
+}
+
+// -----------------------------------------------------------------------------
+// A slot rewritten during the copy is skipped, so a reader racing the render
+// thread may miss a few of the oldest frames
+// -----------------------------------------------------------------------------
+std::vector<FrameTimer::Frame> FrameTimer::snapshot() const
+{
+    const uint64_t committed = _committed.load( std::memory_order_acquire );
+    const uint64_t first = committed > _capacity ? committed - _capacity : 0;
+
+    std::vector<Frame> frames;
+    frames.reserve( static_cast<size_t>(committed - first) );
+    for ( uint64_t ii = first; ii < committed; ++ii )
+    {
+        const Slot &slot = _slots[ii % _capacity];
+        const uint64_t sequence = slot.sequence.load( std::memory_order_acquire );
+        if ( sequence == 0 || (sequence & 1) != 0 )
+        {
+            continue;
+        }
+
+        uint64_t words[FRAME_WORDS];
+        for ( size_t word = 0; word < FRAME_WORDS; ++word )
+        {
+            words[word] = slot.words[word].load( std::memory_order_relaxed );
+        }
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( slot.sequence.load( std::memory_order_relaxed ) != sequence )
+        {
+            continue;
+        }
+
+        Frame frame;
+        std::memcpy( &frame, words, sizeof( frame ) );
+        frames.push_back( frame );
+    }
+
+    // slots overwritten since committed was read hold newer frames
+    std::sort( frames.begin(), frames.end(), []( const Frame &a, const Frame &b ) { return a.index < b.index; } );
+    return frames;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+template <class Value>
+FrameTimer::Percentiles FrameTimer::percentilesOf( const std::vector<Frame> &frames, const Value &value )
+{
+    std::vector<uint64_t> nanos;
+    nanos.reserve( frames.size() );
+    for ( const Frame &frame : frames )
+    {
+        value( frame, nanos );
+    }
+
+    Percentiles percentiles{ nanos.size(), 0.0, 0.0, 0.0 };
+    if ( nanos.empty() )
+    {
+        return percentiles;
+    }
+
+    std::sort( nanos.begin(), nanos.end() );
+    auto rank = [&nanos]( double p )
+    {
+        size_t index = static_cast<size_t>(std::ceil( p * nanos.size() ));
+        return nanos[std::min( std::max<size_t>( index, 1 ), nanos.size() ) - 1] * 1.0e-6;
+    };
+    percentiles.p50 = rank( 0.50 );
+    percentiles.p95 = rank( 0.95 );
+    percentiles.p99 = rank( 0.99 );
+    return percentiles;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+FrameTimer::Percentiles FrameTimer::phasePercentiles( const std::vector<Frame> &frames, PHASE phase )
+{
+    return percentilesOf( frames, [phase]( const Frame &frame, std::vector<uint64_t> &nanos )
+    {
+        nanos.push_back( frame.phaseNanos[phase] );
+    } );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+FrameTimer::Percentiles FrameTimer::cpuPercentiles( const std::vector<Frame> &frames )
+{
+    return percentilesOf( frames, []( const Frame &frame, std::vector<uint64_t> &nanos )
+    {
+        nanos.push_back( frame.cpuNanos() );
+    } );
+}
+
+// -----------------------------------------------------------------------------
+// Frames whose render pass was not measured are left out
+// -----------------------------------------------------------------------------
+FrameTimer::Percentiles FrameTimer::gpuPercentiles( const std::vector<Frame> &frames )
+{
+    return percentilesOf( frames, []( const Frame &frame, std::vector<uint64_t> &nanos )
+    {
+        if ( frame.gpuNanos > 0 )
+        {
+            nanos.push_back( frame.gpuNanos );
+        }
+    } );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void FrameTimer::writeReport( std::ostream &out ) const
+{
+    auto line = [&out]( const char *name, const Percentiles &percentiles )
+    {
+        out << std::left << std::setw( 16 ) << name << std::right << std::fixed << std::setprecision( 3 )
+            << " p50 " << std::setw( 8 ) << percentiles.p50 << " ms"
+            << "  p95 " << std::setw( 8 ) << percentiles.p95 << " ms"
+            << "  p99 " << std::setw( 8 ) << percentiles.p99 << " ms" << std::endl;
+    };
+
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+
+    const std::vector<Frame> frames = snapshot();
+    out << frames.size() << " frames timed" << std::endl;
+    for ( int phase = 0; phase < PHASE_COUNT; ++phase )
+    {
+        line( phaseName( static_cast<PHASE>(phase) ), phasePercentiles( frames, static_cast<PHASE>(phase) ) );
+    }
+    line( "cpu frame", cpuPercentiles( frames ) );
+
+    Percentiles gpu = gpuPercentiles( frames );
+    if ( gpu.frames > 0 )
+    {
+        line( "gpu render pass", gpu );
+    }
+
+    out.flags( flags );
+    out.precision( precision );
+}
+
+// -----------------------------------------------------------------------------
+// Trace event format, complete events in microseconds
+// -----------------------------------------------------------------------------
+void FrameTimer::writeChromeTrace( const std::string &path ) const
+{
+    static const int CPU_TRACK = 1;
+    static const int GPU_TRACK = 2;
+
+    std::ofstream file( path );
+    if ( !file )
+    {
+        throw std::runtime_error( "failed to open " + path + "!" );
+    }
+
+    file << std::fixed << std::setprecision( 3 );
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << CPU_TRACK
+         << ",\"args\":{\"name\":\"drawFrame\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_TRACK
+         << ",\"args\":{\"name\":\"gpu\"}}";
+
+    auto event = [&file]( const std::string &name, int track, uint64_t start, uint64_t nanos )
+    {
+        file << ",\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track
+             << ",\"ts\":" << start * 1.0e-3 << ",\"dur\":" << nanos * 1.0e-3 << "}";
+    };
+
+    for ( const Frame &frame : snapshot() )
+    {
+        event( "frame " + std::to_string( frame.index ), CPU_TRACK, frame.start, frame.cpuNanos() );
+
+        uint64_t start = frame.start;
+        for ( int phase = 0; phase < PHASE_COUNT; ++phase )
+        {
+            // phases drawFrame skips, such as present when headless
+            if ( frame.phaseNanos[phase] > 0 )
+            {
+                event( phaseName( static_cast<PHASE>(phase) ), CPU_TRACK, start, frame.phaseNanos[phase] );
+            }
+            start += frame.phaseNanos[phase];
+        }
+
+        if ( frame.gpuNanos > 0 )
+        {
+            event( "render pass " + std::to_string( frame.index ), GPU_TRACK, frame.gpuStart, frame.gpuNanos );
+        }
+    }
+    file << "\n]}\n";
+
+    if ( !file )
+    {
+        throw std::runtime_error( "failed to write " + path + "!" );
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+// -----------------------------------------------------------------------------
+// Per frame timings of VulkanApp::drawFrame: the CPU time of each phase and
+// the GPU time of the render pass. The render thread commits finished frames
+// to a ring of the last capacity frames, which any other thread may read
+// while it is written, without locks. Disabled, recording costs a test of a
+// bool per call.
+// -----------------------------------------------------------------------------
+class FrameTimer
+{
+public:
+
+    // consecutive parts of drawFrame, each begins where the previous ends
+    enum PHASE
+    {
+        WAIT_FENCE,         // the frame in flight last using the slot retires
+        ACQUIRE,            // swapchain image, and the frame last drawing it
+        UPDATE_UNIFORMS,
+        SUBMIT,
+        PRESENT,
+        PHASE_COUNT,
+    };
+
+    static const char *phaseName( PHASE phase );
+
+    // times in nanoseconds since the timer was created
+    struct Frame
+    {
+        uint64_t index;
+        uint64_t start;
+        uint64_t phaseNanos[PHASE_COUNT];
+
+        // render pass on the device, gpuNanos 0 when not measured. gpuStart
+        // is in the device's clock until the frame is committed
+        uint64_t gpuStart;
+        uint64_t gpuNanos;
+
+        uint64_t cpuNanos() const;
+
+        // end of phase, nanoseconds since the timer was created
+        uint64_t phaseEnd( PHASE phase ) const;
+    };
+
+    // milliseconds, nearest rank over the frames in the ring
+    struct Percentiles
+    {
+        uint64_t frames;
+        double   p50;
+        double   p95;
+        double   p99;
+    };
+
+    explicit FrameTimer( size_t capacity = 4096 );
+
+    bool enabled() const { return _enabled; }
+
+    // render thread only
+    void setEnabled( bool enabled ) { _enabled = enabled; }
+
+    // recording, on the render thread
+
+    void beginFrame()
+    {
+        if ( !_enabled )
+        {
+            return;
+        }
+        _frame = Frame{};
+        _frame.index = _frameCount++;
+        _frame.start = _phaseStart = now();
+        _open = true;
+    }
+
+    void endPhase( PHASE phase )
+    {
+        if ( !_open )
+        {
+            return;
+        }
+        uint64_t time = now();
+        _frame.phaseNanos[phase] += time - _phaseStart;
+        _phaseStart = time;
+    }
+
+    // hands out the frame begun last, false when none was begun. Its GPU
+    // time is filled in and the frame committed once the device is done
+    bool endFrame( Frame &frame )
+    {
+        if ( !_open )
+        {
+            return false;
+        }
+        _open = false;
+        frame = _frame;
+        return true;
+    }
+
+    // adds frame to the ring. The device clock is mapped to the timer's by
+    // the largest offset seen between the end of a frame's submit and its
+    // render pass start, so GPU times line up with the CPU to within the
+    // shortest queue latency of the frames so far
+    void commit( Frame frame );
+
+    uint64_t now() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _created ).count());
+    }
+
+    // reading, on any thread
+
+    // the frames in the ring, oldest first
+    std::vector<Frame> snapshot() const;
+
+    Percentiles phasePercentiles( PHASE phase ) const { return phasePercentiles( snapshot(), phase ); }
+    Percentiles cpuPercentiles() const { return cpuPercentiles( snapshot() ); }
+    Percentiles gpuPercentiles() const { return gpuPercentiles( snapshot() ); }
+
+    // same over frames of a snapshot
+    static Percentiles phasePercentiles( const std::vector<Frame> &frames, PHASE phase );
+    static Percentiles cpuPercentiles( const std::vector<Frame> &frames );
+    static Percentiles gpuPercentiles( const std::vector<Frame> &frames );
+
+    // percentiles of every phase, one line each
+    void writeReport( std::ostream &out ) const;
+
+    // the frames in the ring as a Chrome trace (chrome://tracing, Perfetto),
+    // one track for the CPU phases and one for the render pass. Throws
+    // std::runtime_error when the file cannot be written
+    void writeChromeTrace( const std::string &path ) const;
+
+private:
+
+    static constexpr size_t FRAME_WORDS = sizeof( Frame ) / sizeof( uint64_t );
+
+    // one frame behind a sequence number, odd while it is being written
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence{ 0 };
+        std::atomic<uint64_t> words[FRAME_WORDS];
+    };
+
+    template <class Value>
+    static Percentiles percentilesOf( const std::vector<Frame> &frames, const Value &value );
+
+    std::chrono::steady_clock::time_point _created = std::chrono::steady_clock::now();
+    bool                     _enabled = false;
+    bool                     _open = false;
+    Frame                    _frame{};
+    uint64_t                 _phaseStart = 0;
+    uint64_t                 _frameCount = 0;
+    bool                     _gpuClockMapped = false;
+    int64_t                  _gpuClockOffset = 0;
+
+    std::unique_ptr<Slot[]>  _slots;
+    size_t                   _capacity;
+    std::atomic<uint64_t>    _committed{ 0 };
+};
@@ -0,0 +1,356 @@
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+
+#include "imageWriter.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static uint32_t updateCrc( uint32_t crc, const unsigned char *data, size_t size )
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for ( uint32_t n = 0; n < 256; ++n )
+        {
+            uint32_t c = n;
+            for ( int k = 0; k < 8; ++k )
+            {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    for ( size_t ii = 0; ii < size; ++ii )
+    {
+        crc = table[(crc ^ data[ii]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void putBigEndian32( unsigned char *out, uint32_t value )
+{
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void writeChunk( std::ofstream &file, const char *type,
+                        const unsigned char *data, size_t size )
+{
+    unsigned char header[8];
+    putBigEndian32( header, static_cast<uint32_t>(size) );
+    std::copy( type, type + 4, header + 4 );
+
+    uint32_t crc = updateCrc( 0xffffffffu, header + 4, 4 );
+    crc = updateCrc( crc, data, size );
+
+    unsigned char footer[4];
+    putBigEndian32( footer, crc ^ 0xffffffffu );
+
+    file.write( reinterpret_cast<const char *>(header), sizeof( header ) );
+    file.write( reinterpret_cast<const char *>(data), size );
+    file.write( reinterpret_cast<const char *>(footer), sizeof( footer ) );
+}
+
+// -----------------------------------------------------------------------------
+// Zlib stream of stored (uncompressed) deflate blocks, cut into IDAT chunks
+// as it is produced so the image is never held twice in memory
+// -----------------------------------------------------------------------------
+class StoredDeflateWriter
+{
+public:
+
+    StoredDeflateWriter( std::ofstream &file, uint64_t rawSize )
+        : _file( file ), _rawLeft( rawSize )
+    {
+        _chunk.reserve( CHUNK_SIZE );
+        _chunk.push_back( 0x78 );   // deflate, 32K window
+        _chunk.push_back( 0x01 );   // no preset dictionary, fastest
+        if ( _rawLeft == 0 )
+        {
+            beginBlock();
+        }
+    }
+
+    void write( const unsigned char *data, size_t size )
+    {
+        while ( size > 0 )
+        {
+            if ( _blockLeft == 0 )
+            {
+                beginBlock();
+            }
+
+            size_t run = std::min<size_t>( { size, _blockLeft, CHUNK_SIZE - _chunk.size() } );
+            _chunk.insert( _chunk.end(), data, data + run );
+            updateAdler( data, run );
+            _blockLeft -= static_cast<uint32_t>(run);
+            _rawLeft -= run;
+            data += run;
+            size -= run;
+
+            if ( _chunk.size() >= CHUNK_SIZE )
+            {
+                flush();
+            }
+        }
+    }
+
+    void finish()
+    {
+        unsigned char adler[4];
+        putBigEndian32( adler, (_adlerB << 16) | _adlerA );
+        _chunk.insert( _chunk.end(), adler, adler + 4 );
+        flush();
+    }
+
+private:
+
+    static constexpr size_t   CHUNK_SIZE = 1 << 20;
+    static constexpr uint32_t MAX_BLOCK = 65535;
+
+    void beginBlock()
+    {
+        uint32_t length = static_cast<uint32_t>(std::min<uint64_t>( _rawLeft, MAX_BLOCK ));
+        bool final = _rawLeft <= MAX_BLOCK;
+
+        _chunk.push_back( final ? 1 : 0 );
+        _chunk.push_back( static_cast<unsigned char>(length) );
+        _chunk.push_back( static_cast<unsigned char>(length >> 8) );
+        _chunk.push_back( static_cast<unsigned char>(~length) );
+        _chunk.push_back( static_cast<unsigned char>(~length >> 8) );
+        _blockLeft = length;
+    }
+
+    // sums are reduced every 5552 bytes, the most that cannot overflow
+    void updateAdler( const unsigned char *data, size_t size )
+    {
+        while ( size > 0 )
+        {
+            size_t run = std::min<size_t>( size, 5552 );
+            for ( size_t ii = 0; ii < run; ++ii )
+            {
+                _adlerA += data[ii];
+                _adlerB += _adlerA;
+            }
+            _adlerA %= 65521;
+            _adlerB %= 65521;
+            data += run;
+            size -= run;
+        }
+    }
+
+    void flush()
+    {
+        writeChunk( _file, "IDAT", _chunk.data(), _chunk.size() );
+        _chunk.clear();
+    }
+
+    std::ofstream               &_file;
+    std::vector<unsigned char>  _chunk;
+    uint64_t                    _rawLeft;
+    uint32_t                    _blockLeft = 0;
+    uint32_t                    _adlerA = 1;
+    uint32_t                    _adlerB = 0;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void writePng( const std::string &path, const void *pixels,
+               uint32_t width, uint32_t height,
+               int channels, int bitDepth )
+{
+    static const unsigned char COLOR_TYPES[] = { 0, 4, 2, 6 };
+
+    if ( channels < 1 || channels > 4 || (bitDepth != 8 && bitDepth != 16) )
+    {
+        throw std::runtime_error( "unsupported png pixel format!" );
+    }
+
+    std::ofstream file( path, std::ios::binary );
+    if ( !file.is_open() )
+    {
+        throw std::runtime_error( "failed to open " + path + " for writing!" );
+    }
+
+    static const unsigned char SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    file.write( reinterpret_cast<const char *>(SIGNATURE), sizeof( SIGNATURE ) );
+
+    unsigned char header[13];
+    putBigEndian32( header, width );
+    putBigEndian32( header + 4, height );
+    header[8] = static_cast<unsigned char>(bitDepth);
+    header[9] = COLOR_TYPES[channels - 1];
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering, every row uses filter 0 (none)
+    header[12] = 0; // not interlaced
+    writeChunk( file, "IHDR", header, sizeof( header ) );
+
+    const size_t rowBytes = static_cast<size_t>(width) * channels * (bitDepth / 8);
+    StoredDeflateWriter deflate( file, static_cast<uint64_t>(rowBytes + 1) * height );
+
+    // png samples are big endian, 16 bit rows are swapped into a scratch row
+    std::vector<unsigned char> row( rowBytes + 1, 0 );
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        if ( bitDepth == 8 )
+        {
+            const unsigned char *src = static_cast<const unsigned char *>(pixels) + y * rowBytes;
+            std::copy( src, src + rowBytes, row.begin() + 1 );
+        }
+        else
+        {
+            const uint16_t *src = static_cast<const uint16_t *>(pixels) + y * (rowBytes / 2);
+            for ( size_t ii = 0; ii < rowBytes / 2; ++ii )
+            {
+                row[1 + 2 * ii] = static_cast<unsigned char>(src[ii] >> 8);
+                row[2 + 2 * ii] = static_cast<unsigned char>(src[ii]);
+            }
+        }
+        deflate.write( row.data(), row.size() );
+    }
+    deflate.finish();
+
+    writeChunk( file, "IEND", nullptr, 0 );
+
+    if ( !file )
+    {
+        throw std::runtime_error( "failed to write " + path + "!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void putLittleEndian( std::vector<unsigned char> &out, uint64_t value, int bytes )
+{
+    for ( int ii = 0; ii < bytes; ++ii )
+    {
+        out.push_back( static_cast<unsigned char>(value >> (8 * ii)) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static void putAttribute( std::vector<unsigned char> &out, const char *name, const char *type,
+                          const std::vector<unsigned char> &value )
+{
+    out.insert( out.end(), name, name + std::strlen( name ) + 1 );
+    out.insert( out.end(), type, type + std::strlen( type ) + 1 );
+    putLittleEndian( out, value.size(), 4 );
+    out.insert( out.end(), value.begin(), value.end() );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static uint32_t floatBits( float value )
+{
+    uint32_t bits = 0;
+    std::memcpy( &bits, &value, sizeof( bits ) );
+    return bits;
+}
+
+// -----------------------------------------------------------------------------
+// One scanline per block, channels stored one after the other in name order
+// -----------------------------------------------------------------------------
+void writeExr( const std::string &path, const float *pixels,
+               uint32_t width, uint32_t height, int channels )
+{
+    // channel names in file order and the pixel component each one is
+    static const char *const NAMES[4][4] = { { "Y" }, {}, { "B", "G", "R" }, { "A", "B", "G", "R" } };
+    static const int COMPONENTS[4][4] = { { 0 }, {}, { 2, 1, 0 }, { 3, 2, 1, 0 } };
+    static const int PIXEL_FLOAT = 2;
+
+    if ( channels != 1 && channels != 3 && channels != 4 )
+    {
+        throw std::runtime_error( "unsupported exr pixel format!" );
+    }
+
+    std::vector<unsigned char> header = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+
+    std::vector<unsigned char> value;
+    for ( int ii = 0; ii < channels; ++ii )
+    {
+        const char *name = NAMES[channels - 1][ii];
+        value.insert( value.end(), name, name + std::strlen( name ) + 1 );
+        putLittleEndian( value, PIXEL_FLOAT, 4 );
+        putLittleEndian( value, 0, 4 );     // pLinear and reserved
+        putLittleEndian( value, 1, 4 );     // x sampling
+        putLittleEndian( value, 1, 4 );     // y sampling
+    }
+    value.push_back( 0 );
+    putAttribute( header, "channels", "chlist", value );
+
+    putAttribute( header, "compression", "compression", { 0 } );
+
+    value.clear();
+    putLittleEndian( value, 0, 4 );
+    putLittleEndian( value, 0, 4 );
+    putLittleEndian( value, width - 1, 4 );
+    putLittleEndian( value, height - 1, 4 );
+    putAttribute( header, "dataWindow", "box2i", value );
+    putAttribute( header, "displayWindow", "box2i", value );
+
+    putAttribute( header, "lineOrder", "lineOrder", { 0 } );
+
+    value.clear();
+    putLittleEndian( value, floatBits( 1.0f ), 4 );
+    putAttribute( header, "pixelAspectRatio", "float", value );
+    putAttribute( header, "screenWindowWidth", "float", value );
+
+    value.clear();
+    putLittleEndian( value, 0, 8 );
+    putAttribute( header, "screenWindowCenter", "v2f", value );
+
+    header.push_back( 0 );
+
+    const uint64_t lineBytes = static_cast<uint64_t>(width) * channels * sizeof( float );
+    const uint64_t blockBytes = 8 + lineBytes;
+    const uint64_t firstBlock = header.size() + 8 * static_cast<uint64_t>(height);
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        putLittleEndian( header, firstBlock + y * blockBytes, 8 );
+    }
+
+    std::ofstream file( path, std::ios::binary );
+    if ( !file.is_open() )
+    {
+        throw std::runtime_error( "failed to open " + path + " for writing!" );
+    }
+    file.write( reinterpret_cast<const char *>(header.data()), header.size() );
+
+    std::vector<unsigned char> block;
+    block.reserve( blockBytes );
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        block.clear();
+        putLittleEndian( block, y, 4 );
+        putLittleEndian( block, lineBytes, 4 );
+
+        const float *row = pixels + static_cast<size_t>(y) * width * channels;
+        for ( int ii = 0; ii < channels; ++ii )
+        {
+            const int component = COMPONENTS[channels - 1][ii];
+            for ( uint32_t x = 0; x < width; ++x )
+            {
+                putLittleEndian( block, floatBits( row[static_cast<size_t>(x) * channels + component] ), 4 );
+            }
+        }
+        file.write( reinterpret_cast<const char *>(block.data()), block.size() );
+    }
+
+    if ( !file )
+    {
+        throw std::runtime_error( "failed to write " + path + "!" );
+    }
+}
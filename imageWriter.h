@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// Writes an uncompressed PNG. Pixels are rows of channels (1 gray, 2 gray and
+// alpha, 3 RGB, 4 RGBA) samples, top row first, each sample a uint8_t for a
+// bitDepth of 8 or a uint16_t in host byte order for a bitDepth of 16.
+// Throws std::runtime_error when the file cannot be written.
+// -----------------------------------------------------------------------------
+void writePng( const std::string &path, const void *pixels,
+               uint32_t width, uint32_t height,
+               int channels, int bitDepth = 8 );
+
+// -----------------------------------------------------------------------------
+// Writes an uncompressed scanline OpenEXR image of 32 bit float channels
+// (1 Y, 3 RGB, 4 RGBA). Pixels are rows of channels floats, top row first.
+// Throws std::runtime_error when the file cannot be written.
+// -----------------------------------------------------------------------------
+void writeExr( const std::string &path, const float *pixels,
+               uint32_t width, uint32_t height, int channels );
@@ -1,1708 +1,3030 @@
-
-#include <set>
-#include <array>
-#include <iostream>
-#include <stdexcept>
-#include <optional>
-#include <algorithm>
-#include <fstream>
-
-#define GLM_FORCE_RADIANS
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-
-#include <chrono>
-
-#include <cstring> // for memcpy
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
-#include "vulkanApp.h"
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static const int MAX_FRAMES_IN_FLIGHT = 2;
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static const std::vector<const char *> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static const std::vector<const char *> validationLayers = { "VK_LAYER_KHRONOS_validation" };
-
-#ifdef NDEBUG
-static const bool enableValidationLayers = false;
-#else
-static const bool enableValidationLayers = true;
-#endif
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-struct Vertex
-{
-    glm::vec2 pos;
-    glm::vec3 color;
-    glm::vec2 texCoord;
-
-    static VkVertexInputBindingDescription getBindingDescription()
-    {
-        VkVertexInputBindingDescription bindingDescription{};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        return bindingDescription;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions()
-    {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
-
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-        attributeDescriptions[1].binding = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof( Vertex, texCoord );
-
-        return attributeDescriptions;
-    }
-};
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static const std::vector<Vertex> vertices = { {{-2.0f, -1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-                                              {{ 1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-                                              {{ 1.0f,  1.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
-                                              {{-2.0f,  1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}}
-                                            };
-
-static const std::vector<uint16_t> indices = { 0, 1, 2, 2, 3, 0 };
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-struct UniformBufferObject
-{
-    glm::mat4 model;
-    glm::mat4 view;
-    glm::mat4 proj;
-};
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-struct VulkanApp::QueueFamilyIndices
-{
-    std::optional<uint32_t> graphicsFamily;
-    std::optional<uint32_t> presentFamily;
-
-    bool isComplete() const
-    {
-        return graphicsFamily.has_value() && presentFamily.has_value();
-    }
-};
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-struct VulkanApp::SwapChainSupportDetails
-{
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> presentModes;
-};
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static std::vector<char> readFile( const std::string &filename )
-{
-    std::ifstream file( filename, std::ios::ate | std::ios::binary );
-
-    if ( !file.is_open() )
-    {
-        throw std::runtime_error( "failed to open file!" );
-    }
-
-    size_t fileSize = (size_t)file.tellg();
-    std::vector<char> buffer( fileSize );
-    file.seekg( 0 );
-    file.read( buffer.data(), fileSize );
-    file.close();
-    return buffer;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback( VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-                                                     VkDebugUtilsMessageTypeFlagsEXT messageType,
-                                                     const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-                                                     void *pUserData )
-{
-    std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-    return VK_FALSE;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::run()
-{
-    initWindow();
-    initVulkan();
-    mainLoop();
-    cleanup();
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::initWindow()
-{
-    glfwInit();
-
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint( GLFW_RESIZABLE, GLFW_TRUE );
-    auto wp = GetWindowParams();
-    _window = glfwCreateWindow(wp.width, wp.height, wp.title.c_str(), nullptr, nullptr);
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::initVulkan()
-{
-    createInstance();
-    setupDebugMessenger();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice(_physicalDevice);
-    createSwapChain(_physicalDevice);
-    createImageViews();
-    createRenderPass();
-    createDiscriptorSetLayout();
-    createGraphicsPipeline();
-    createFrameBuffers();
-    createCommandPool(_physicalDevice);
-    createTextureImage("textures/texture.jpg");
-    createTextureImageView();
-    createTextureSampler();
-    createVertexBuffer();
-    createIndexBuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffers();
-    createSyncObjects();
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-static VkResult CreateDebugUtilsMessengerEXT( VkInstance instance,
-                                              const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-                                              const VkAllocationCallbacks *pAllocator,
-                                              VkDebugUtilsMessengerEXT *pDebugMessenger )
-{
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr( instance, "vkCreateDebugUtilsMessengerEXT" );
-    if ( func != nullptr )
-    {
-        return func( instance, pCreateInfo, pAllocator, pDebugMessenger );
-    }
-    else
-    {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void DestroyDebugUtilsMessengerEXT( VkInstance instance,
-                                    VkDebugUtilsMessengerEXT debugMessenger,
-                                    const VkAllocationCallbacks *pAllocator )
-{
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr( instance, "vkDestroyDebugUtilsMessengerEXT" );
-    if ( func != nullptr )
-    {
-        func( instance, debugMessenger, pAllocator );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void populateDebugMessengerCreateInfo( VkDebugUtilsMessengerCreateInfoEXT &createInfo )
-{
-    createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-    createInfo.pfnUserCallback = debugCallback;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::setupDebugMessenger()
-{
-    if ( !enableValidationLayers )
-        return;
-
-    VkDebugUtilsMessengerCreateInfoEXT createInfo{};
-    populateDebugMessengerCreateInfo( createInfo );
-
-    if ( CreateDebugUtilsMessengerEXT( _instance, &createInfo, nullptr, &_debugMessenger ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to set up debug messenger!" );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createSurface()
-{
-    if (glfwCreateWindowSurface(_instance, _window, nullptr, &_surface) != VK_SUCCESS)
-        throw std::runtime_error("failed to create window surface!");
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::pickPhysicalDevice()
-{
-    uint32_t deviceCnt = 0;
-    vkEnumeratePhysicalDevices(_instance, &deviceCnt, nullptr);
-    if (deviceCnt == 0)
-        throw std::runtime_error("failed to find GPUs with Vulkan support!");
-
-    std::vector<VkPhysicalDevice> devices(deviceCnt);
-    vkEnumeratePhysicalDevices(_instance, &deviceCnt, devices.data());
-
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-
-    for (const auto &device : devices)
-    {
-        if (isDeviceSuitable(device))
-        {
-            physicalDevice = device;
-            break;
-        }
-    }
-
-    if (physicalDevice == VK_NULL_HANDLE)
-    {
-        throw std::runtime_error("failed to find a suitable GPU!");
-    }
-
-    _physicalDevice = physicalDevice;
-}
-
-// -------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VulkanApp::SwapChainSupportDetails VulkanApp::querySwapChainSupport(VkPhysicalDevice device)
-{
-    SwapChainSupportDetails details;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
-
-    uint32_t formatCount;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, nullptr);
-
-    if (formatCount != 0)
-    {
-        details.formats.resize(formatCount);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, details.formats.data());
-    }
-
-    uint32_t presentModeCount;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, nullptr);
-
-    if (presentModeCount != 0)
-    {
-        details.presentModes.resize(presentModeCount);
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, details.presentModes.data());
-    }
-
-    return details;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VkSurfaceFormatKHR VulkanApp::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats)
-{
-    for (const auto &availableFormat : availableFormats)
-    {
-        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-        {
-            return availableFormat;
-        }
-    }
-
-    return availableFormats[0];
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VkPresentModeKHR VulkanApp::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
-{
-    for (const auto &availablePresentMode : availablePresentModes)
-    {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-        {
-            return availablePresentMode;
-        }
-    }
-
-    return VK_PRESENT_MODE_FIFO_KHR;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VkExtent2D VulkanApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities)
-{
-    if (capabilities.currentExtent.width != UINT32_MAX)
-    {
-        return capabilities.currentExtent;
-    }
-
-    int width, height;
-    glfwGetFramebufferSize(_window, &width, &height);
-
-    VkExtent2D actualExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
-
-    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-    actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-
-    return actualExtent;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-bool VulkanApp::checkDeviceExtensionSupport(VkPhysicalDevice device)
-{
-    uint32_t extensionCount;
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
-    for (const auto &extension : availableExtensions)
-    {
-        requiredExtensions.erase(extension.extensionName);
-    }
-
-    return requiredExtensions.empty();
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-bool VulkanApp::checkValidationLayerSupport()
-{
-    uint32_t layerCount;
-    vkEnumerateInstanceLayerProperties( &layerCount, nullptr );
-
-    std::vector<VkLayerProperties> availableLayers( layerCount );
-    vkEnumerateInstanceLayerProperties( &layerCount, availableLayers.data() );
-
-    for ( const char *layerName : validationLayers )
-    {
-        bool layerFound = false;
-
-        for ( const auto &layerProperties : availableLayers )
-        {
-            if ( strcmp( layerName, layerProperties.layerName ) == 0 )
-            {
-                layerFound = true;
-                break;
-            }
-        }
-
-        if ( !layerFound )
-        {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-std::vector<const char *> VulkanApp::getRequiredExtensions()
-{
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
-
-    std::vector<const char *> extensions( glfwExtensions, glfwExtensions + glfwExtensionCount );
-
-    if ( enableValidationLayers )
-    {
-        extensions.push_back( VK_EXT_DEBUG_UTILS_EXTENSION_NAME );
-    }
-
-    return extensions;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-bool VulkanApp::isDeviceSuitable(VkPhysicalDevice device)
-{
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-    QueueFamilyIndices indices = findQueueFamilies(device);
-
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
-    bool swapChainAdequate = false;
-    if (extensionsSupported)
-    {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-        swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
-    }
-
-    return indices.isComplete()                                                     &&
-           swapChainAdequate                                                        &&
-           (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
-            deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)    &&
-           deviceFeatures.geometryShader                                            &&
-           deviceFeatures.samplerAnisotropy;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VulkanApp::QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice device)
-{
-    QueueFamilyIndices indices;
-
-    uint32_t queueFamilyCnt = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCnt, nullptr);
-
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCnt);
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCnt, queueFamilies.data());
-
-    for (uint32_t ii = 0; ii < (uint32_t)queueFamilies.size(); ++ii)
-    {
-        if (indices.isComplete())
-            break;
-
-        if (queueFamilies[ii].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-        {
-            indices.graphicsFamily = ii;
-        }
-
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, ii, _surface, &presentSupport);
-        if (presentSupport)
-        {
-            indices.presentFamily = ii;
-        }
-    }
-
-    return indices;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-uint32_t VulkanApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-    {
-        if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("failed to find suitable memory type!");
-    return 0;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createRenderPass()
-{
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = _swapChainImageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-
-    if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create render pass!");
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VkShaderModule VulkanApp::createShaderModule(const std::vector<char> &code)
-{
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create shader module!");
-    }
-
-    return shaderModule;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createSyncObjects()
-{
-    _imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    _renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    _inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    _imagesInFlight.resize(_swapChainImages.size(), VK_NULL_HANDLE);
-
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(_device, &fenceInfo, nullptr, &_inFlightFences[i]) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create synchronization objects for a frame!");
-        }
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VkCommandBuffer VulkanApp::beginSingleTimeCommands()
-{
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = _commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers( _device, &allocInfo, &commandBuffer );
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer( commandBuffer, &beginInfo );
-
-    return commandBuffer;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::endSingleTimeCommands( VkCommandBuffer commandBuffer )
-{
-    vkEndCommandBuffer( commandBuffer );
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit( _graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-    vkQueueWaitIdle( _graphicsQueue );
-
-    vkFreeCommandBuffers( _device, _commandPool, 1, &commandBuffer );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createCommandBuffers()
-{
-    _commandBuffers.resize(_swapChainFramebuffers.size());
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = _commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)_commandBuffers.size();
-
-    if (vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data()) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to allocate command buffers!");
-    }
-
-    for (size_t i = 0; i < _commandBuffers.size(); i++)
-    {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-        if (vkBeginCommandBuffer(_commandBuffers[i], &beginInfo) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to begin recording command buffer!");
-        }
-
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = _renderPass;
-        renderPassInfo.framebuffer = _swapChainFramebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = _swapChainExtent;
-
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
-
-        vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-
-        VkBuffer vertexBuffers[] = {_vertexBuffer};
-        VkDeviceSize offsets[] ={0};
-        vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
-
-        vkCmdBindIndexBuffer( _commandBuffers[i], _indexBuffer, 0, VK_INDEX_TYPE_UINT16 );
-
-        vkCmdBindDescriptorSets( _commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                 _pipelineLayout, 0, 1, &_descriptorSets[_currentFrame], 0, nullptr );
-
-        vkCmdDrawIndexed( _commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0 );
-
-        vkCmdEndRenderPass(_commandBuffers[i]);
-
-        if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to record command buffer!");
-        }
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createCommandPool(VkPhysicalDevice physicalDevice)
-{
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    poolInfo.flags = 0; // Optional
-    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create command pool!");
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createBuffer( VkDeviceSize size,
-                              VkBufferUsageFlags usage,
-                              VkMemoryPropertyFlags properties,
-                              VkBuffer &buffer,
-                              VkDeviceMemory &bufferMemory )
-{
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if ( vkCreateBuffer( _device, &bufferInfo, nullptr, &buffer ) != VK_SUCCESS ) {
-        throw std::runtime_error( "failed to create buffer!" );
-    }
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements( _device, buffer, &memRequirements );
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType( memRequirements.memoryTypeBits, properties );
-
-    if ( vkAllocateMemory( _device, &allocInfo, nullptr, &bufferMemory ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to allocate buffer memory!" );
-    }
-
-    vkBindBufferMemory( _device, buffer, bufferMemory, 0 );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createVertexBuffer()
-{
-    VkDeviceSize bufferSize = sizeof( vertices[0] ) * vertices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  stagingBuffer, stagingBufferMemory );
-
-    void *data;
-    vkMapMemory( _device, stagingBufferMemory, 0, bufferSize, 0, &data );
-    memcpy( data, vertices.data(), (size_t)bufferSize );
-    vkUnmapMemory( _device, stagingBufferMemory );
-
-    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory );
-
-    copyBuffer( stagingBuffer, _vertexBuffer, bufferSize );
-
-    vkDestroyBuffer( _device, stagingBuffer, nullptr );
-    vkFreeMemory( _device, stagingBufferMemory, nullptr );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::copyBuffer( VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size )
-{
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0; // Optional
-    copyRegion.dstOffset = 0; // Optional
-    copyRegion.size = size;
-    vkCmdCopyBuffer( commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion );
-
-    endSingleTimeCommands( commandBuffer );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createImage( uint32_t width,
-                             uint32_t height,
-                             VkFormat format,
-                             VkImageTiling tiling,
-                             VkImageUsageFlags usage,
-                             VkMemoryPropertyFlags properties,
-                             VkImage &image,
-                             VkDeviceMemory &imageMemory )
-{
-    VkImageCreateInfo imageInfo{};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = width;
-    imageInfo.extent.height = height;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = format;
-    imageInfo.tiling = tiling;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = usage;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if ( vkCreateImage( _device, &imageInfo, nullptr, &image ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to create image!" );
-    }
-
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements( _device, image, &memRequirements );
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType( memRequirements.memoryTypeBits, properties );
-
-    if ( vkAllocateMemory( _device, &allocInfo, nullptr, &imageMemory ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to allocate image memory!" );
-    }
-
-    vkBindImageMemory( _device, image, imageMemory, 0 );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createDescriptorSets()
-{
-    std::vector<VkDescriptorSetLayout> layouts( MAX_FRAMES_IN_FLIGHT, _descriptorSetLayout );
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    allocInfo.pSetLayouts = layouts.data();
-
-    _descriptorSets.resize( MAX_FRAMES_IN_FLIGHT );
-    if ( vkAllocateDescriptorSets( _device, &allocInfo, _descriptorSets.data() ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to allocate descriptor sets!" );
-    }
-
-    updateDescriptorSets();
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createDescriptorPool()
-{
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-    if ( vkCreateDescriptorPool( _device, &poolInfo, nullptr, &_descriptorPool ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to create descriptor pool!" );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::updateUniformBuffer( uint32_t currentImage )
-{
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>( currentTime - startTime ).count();
-
-    time = 2.0f;
-    UniformBufferObject ubo{};
-    ubo.model = glm::rotate( glm::mat4( 1.0f ), time * glm::radians( 90.0f ), glm::vec3( 0.0f, 0.0f, 1.0f ) );
-
-    // ubo.view = glm::lookAt( glm::vec3( 2.0f, 2.0f, 2.0f ), glm::vec3( 0.0f, 0.0f, 0.0f ), glm::vec3( 0.0f, 0.0f, 1.0f ) );
-    ubo.view = glm::lookAt( glm::vec3( 0.5f, 0.0f, 2.5f ), glm::vec3( 0.5f, 0.0f, 0.0f ), glm::vec3( 0.0f, 1.0f, 0.0f ) );
-    ubo.proj = glm::perspective( glm::radians( 45.0f ), _swapChainExtent.width / (float)_swapChainExtent.height, 0.1f, 10.0f );
-    ubo.proj[1][1] *= -1;
-
-    memcpy( _uniformBuffersMapped[currentImage], &ubo, sizeof( ubo ) );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createUniformBuffers()
-{
-    VkDeviceSize bufferSize = sizeof( UniformBufferObject );
-
-    _uniformBuffers.resize( MAX_FRAMES_IN_FLIGHT );
-    _uniformBuffersMemory.resize( MAX_FRAMES_IN_FLIGHT );
-    _uniformBuffersMapped.resize( MAX_FRAMES_IN_FLIGHT );
-
-    for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
-    {
-        createBuffer( bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                      _uniformBuffers[i], _uniformBuffersMemory[i] );
-
-        vkMapMemory( _device, _uniformBuffersMemory[i], 0, bufferSize, 0, &_uniformBuffersMapped[i] );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createIndexBuffer()
-{
-    VkDeviceSize bufferSize = sizeof( indices[0] ) * indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  stagingBuffer, stagingBufferMemory );
-
-    void *data;
-    vkMapMemory( _device, stagingBufferMemory, 0, bufferSize, 0, &data );
-    memcpy( data, indices.data(), (size_t)bufferSize );
-    vkUnmapMemory( _device, stagingBufferMemory );
-
-    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                  _indexBuffer, _indexBufferMemory );
-
-    copyBuffer( stagingBuffer, _indexBuffer, bufferSize );
-
-    vkDestroyBuffer( _device, stagingBuffer, nullptr );
-    vkFreeMemory( _device, stagingBufferMemory, nullptr );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::transitionImageLayout( VkImage image, VkFormat format,
-                                       VkImageLayout oldLayout,
-                                       VkImageLayout newLayout )
-{
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
-    {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    }
-    else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL )
-    {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    }
-    else
-    {
-        throw std::invalid_argument( "unsupported layout transition!" );
-    }
-
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        sourceStage, destinationStage,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-
-    endSingleTimeCommands( commandBuffer );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createTextureImage( const std::string &texImgFile )
-{
-    int texWidth, texHeight, texChannels;
-    stbi_uc *pixels = stbi_load( texImgFile.c_str(),
-                                 &texWidth, &texHeight, &texChannels, STBI_rgb_alpha );
-    VkDeviceSize imageSize = texWidth * texHeight * 4u;
-
-    if ( !pixels )
-    {
-        throw std::runtime_error( "failed to load texture image!" );
-    }
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer( imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  stagingBuffer, stagingBufferMemory );
-
-    void *data;
-    vkMapMemory( _device, stagingBufferMemory, 0, imageSize, 0, &data );
-    memcpy( data, pixels, static_cast<size_t>(imageSize) );
-    vkUnmapMemory( _device, stagingBufferMemory );
-
-    stbi_image_free( pixels );
-
-    createImage( texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory );
-
-    transitionImageLayout( _textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                           VK_IMAGE_LAYOUT_UNDEFINED,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-
-    copyBufferToImage( stagingBuffer, _textureImage,
-                       static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight) );
-
-    transitionImageLayout( _textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-
-    vkDestroyBuffer( _device, stagingBuffer, nullptr );
-    vkFreeMemory( _device, stagingBufferMemory, nullptr );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createTextureImage( const std::vector<unsigned char> &pixels,
-                                    uint32_t width, uint32_t height )
-{
-    if ( pixels.empty() || pixels.size() != width * height * 4 )
-    {
-        throw std::runtime_error( "invalid texture data!" );
-    }
-
-    VkDeviceSize imageSize = pixels.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer( imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  stagingBuffer, stagingBufferMemory );
-
-    void *data;
-    vkMapMemory( _device, stagingBufferMemory, 0, imageSize, 0, &data );
-    memcpy( data, pixels.data(), static_cast<size_t>(imageSize) );
-    vkUnmapMemory( _device, stagingBufferMemory );
-
-    createImage( width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory );
-
-    transitionImageLayout( _textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                           VK_IMAGE_LAYOUT_UNDEFINED,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-
-    copyBufferToImage( stagingBuffer, _textureImage, width, height );
-
-    transitionImageLayout( _textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-
-    vkDestroyBuffer( _device, stagingBuffer, nullptr );
-    vkFreeMemory( _device, stagingBufferMemory, nullptr );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createFrameBuffers()
-{
-    _swapChainFramebuffers.resize(_swapChainImageViews.size());
-    for (size_t i = 0; i < _swapChainImageViews.size(); i++)
-    {
-        VkImageView attachments[] = {_swapChainImageViews[i]};
-
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = _renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = _swapChainExtent.width;
-        framebufferInfo.height = _swapChainExtent.height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_swapChainFramebuffers[i]) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::copyBufferToImage( VkBuffer buffer, VkImage image,
-                                   uint32_t width, uint32_t height )
-{
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = {
-        width,
-        height,
-        1
-    };
-    vkCmdCopyBufferToImage(
-        commandBuffer,
-        buffer,
-        image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &region
-    );
-    endSingleTimeCommands( commandBuffer );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createGraphicsPipeline()
-{
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-    auto bindingDescription    = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)_swapChainExtent.width;
-    viewport.height = (float)_swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = _swapChainExtent;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
-
-    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr; // Optional
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr; // Optional
-    pipelineInfo.layout = _pipelineLayout;
-    pipelineInfo.renderPass = _renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-    pipelineInfo.basePipelineIndex = -1;              // Optional
-
-    if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create graphics pipeline!");
-    }
-
-    vkDestroyShaderModule(_device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(_device, vertShaderModule, nullptr);
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-VkImageView VulkanApp::createImageView( VkImage image, VkFormat format )
-{
-    VkImageViewCreateInfo viewInfo{};
-    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    viewInfo.image = image;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = format;
-    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
-    viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
-
-    VkImageView imageView;
-    if ( vkCreateImageView( _device, &viewInfo, nullptr, &imageView ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to create texture image view!" );
-    }
-
-    return imageView;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::updateDescriptorSets()
-{
-    for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
-    {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = _uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof( UniformBufferObject );
-
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = _textureImageView;
-        imageInfo.sampler = _textureSampler;
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = _descriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = _descriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets( _device, static_cast<uint32_t>(descriptorWrites.size()),
-                                descriptorWrites.data(), 0, nullptr );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createImageViews()
-{
-    _swapChainImageViews.resize(_swapChainImages.size());
-    for (size_t i = 0; i < _swapChainImages.size(); i++)
-    {
-        _swapChainImageViews[i] = createImageView( _swapChainImages[i], _swapChainImageFormat );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createSwapChain(VkPhysicalDevice physicalDevice)
-{
-    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
-
-    VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-    VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
-
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
-    {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
-
-    VkSwapchainCreateInfoKHR createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    createInfo.surface = _surface;
-    createInfo.minImageCount = imageCount;
-    createInfo.imageFormat = surfaceFormat.format;
-    createInfo.imageColorSpace = surfaceFormat.colorSpace;
-    createInfo.imageExtent = extent;
-    createInfo.imageArrayLayers = 1;
-    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-    uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
-
-    if (indices.graphicsFamily != indices.presentFamily)
-    {
-        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-        createInfo.queueFamilyIndexCount = 2;
-        createInfo.pQueueFamilyIndices = queueFamilyIndices;
-    }
-    else
-    {
-        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        createInfo.queueFamilyIndexCount = 0;     // Optional
-        createInfo.pQueueFamilyIndices = nullptr; // Optional
-    }
-
-    createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    createInfo.presentMode = presentMode;
-    createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
-
-    if (vkCreateSwapchainKHR(_device, &createInfo, nullptr, &_swapChain) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create swap chain!");
-    }
-
-    vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, nullptr);
-    _swapChainImages.resize(imageCount);
-    vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, _swapChainImages.data());
-
-    _swapChainExtent = extent;
-    _swapChainImageFormat = surfaceFormat.format;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createTextureImageView()
-{
-    _textureImageView = createImageView( _textureImage, VK_FORMAT_R8G8B8A8_SRGB );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::cleanupImageTexture()
-{
-    vkDestroyImageView( _device, _textureImageView, nullptr );
-    vkDestroyImage( _device, _textureImage, nullptr );
-    vkFreeMemory( _device, _textureImageMemory, nullptr );
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createTextureSampler()
-{
-    VkSamplerCreateInfo samplerInfo{};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = VK_FILTER_LINEAR;
-    samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.anisotropyEnable = VK_TRUE;
-
-    VkPhysicalDeviceProperties properties{};
-    vkGetPhysicalDeviceProperties( _physicalDevice, &properties );
-
-    samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
-    samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
-
-    if ( vkCreateSampler( _device, &samplerInfo, nullptr, &_textureSampler ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to create texture sampler!" );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createLogicalDevice(VkPhysicalDevice physicalDevice)
-{
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
-
-    float queuePriority = 1.0f;
-    for (uint32_t queueFamily : uniqueQueueFamilies)
-    {
-        VkDeviceQueueCreateInfo queueCreateInfo{};
-        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfo.queueFamilyIndex = queueFamily;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriority;
-        queueCreateInfos.push_back(queueCreateInfo);
-    }
-
-    VkPhysicalDeviceFeatures deviceFeatures{};
-    deviceFeatures.samplerAnisotropy = VK_TRUE;
-    vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
-
-    VkDeviceCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.pQueueCreateInfos = queueCreateInfos.data();
-    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-
-    createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
-    createInfo.enabledLayerCount = 0;
-
-    if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &_device) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create logical device!");
-    }
-
-    vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
-    vkGetDeviceQueue(_device, indices.presentFamily.value(), 0, &_presentQueue);
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createInstance()
-{
-    if ( enableValidationLayers && !checkValidationLayerSupport() )
-    {
-        throw std::runtime_error( "validation layers requested, but not available!" );
-    }
-
-    VkApplicationInfo appInfo{};
-    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.pApplicationName = "Hello Triangle";
-    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.pEngineName = "No Engine";
-    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
-
-    VkInstanceCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    createInfo.pApplicationInfo = &appInfo;
-
-    auto extensions = getRequiredExtensions();
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-    createInfo.ppEnabledExtensionNames = extensions.data();
-
-    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-    if ( enableValidationLayers )
-    {
-        createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-        createInfo.ppEnabledLayerNames = validationLayers.data();
-        populateDebugMessengerCreateInfo( debugCreateInfo );
-        createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
-    }
-    else
-    {
-        createInfo.enabledLayerCount = 0;
-        createInfo.pNext = nullptr;
-    }
-
-    if (vkCreateInstance(&createInfo, nullptr, &_instance) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create vulkan instance!");
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::mainLoop()
-{
-    while (!glfwWindowShouldClose(_window))
-    {
-        glfwPollEvents();
-        drawFrame();
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::createDiscriptorSetLayout()
-{
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
-
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
-
-    if ( vkCreateDescriptorSetLayout( _device, &layoutInfo, nullptr, &_descriptorSetLayout ) != VK_SUCCESS )
-    {
-        throw std::runtime_error( "failed to create descriptor set layout!" );
-    }
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::drawFrame()
-{
-    vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
-
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
-
-    if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
-    {
-        vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
-    }
-    _imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
-
-    updateUniformBuffer( static_cast<uint32_t>(_currentFrame) );
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore waitSemaphores[] = {_imageAvailableSemaphores[_currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
-
-    VkSemaphore signalSemaphores[] = {_renderFinishedSemaphores[_currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
-
-    vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
-
-    if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to submit draw command buffer!");
-    }
-
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-
-    VkSwapchainKHR swapChains[] = {_swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-
-    presentInfo.pImageIndices = &imageIndex;
-
-    vkQueuePresentKHR(_presentQueue, &presentInfo);
-
-    _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-void VulkanApp::cleanup()
-{
-    if ( enableValidationLayers )
-    {
-        DestroyDebugUtilsMessengerEXT( _instance, _debugMessenger, nullptr );
-    }
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
-        vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(_device, _inFlightFences[i], nullptr);
-    }
-
-    vkDestroyCommandPool(_device, _commandPool, nullptr);
-
-    for (auto framebuffer : _swapChainFramebuffers)
-    {
-        vkDestroyFramebuffer(_device, framebuffer, nullptr);
-    }
-
-    vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
-    vkDestroyRenderPass(_device, _renderPass, nullptr);
-
-    for (auto imageView : _swapChainImageViews)
-    {
-        vkDestroyImageView(_device, imageView, nullptr);
-    }
-
-    vkDestroySwapchainKHR(_device, _swapChain, nullptr);
-
-    for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
-    {
-        vkDestroyBuffer( _device, _uniformBuffers[i], nullptr );
-        vkFreeMemory( _device, _uniformBuffersMemory[i], nullptr );
-    }
-
-    vkDestroyDescriptorPool( _device, _descriptorPool, nullptr );
-    vkDestroyDescriptorSetLayout( _device, _descriptorSetLayout, nullptr );
-
-    vkDestroyBuffer( _device, _indexBuffer, nullptr );
-    vkFreeMemory( _device, _indexBufferMemory, nullptr );
-    vkDestroyBuffer(_device, _vertexBuffer, nullptr);
-    vkFreeMemory(_device, _vertexBufferMemory, nullptr);
-
-    vkDestroySampler( _device, _textureSampler, nullptr );
-    cleanupImageTexture();
-
-    vkDestroyDevice(_device, nullptr);
-    vkDestroySurfaceKHR(_instance, _surface, nullptr);
-    vkDestroyInstance(_instance, nullptr);
-    glfwDestroyWindow(_window);
-    glfwTerminate();
-}
+
+#include <set>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <optional>
+#include <algorithm>
+#include <fstream>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+
+#include <cstring> // for memcpy
+#include <cstdio>  // for snprintf
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "vulkanApp.h"
+#include "imageWriter.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static const int MAX_FRAMES_IN_FLIGHT = 2;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static const std::vector<const char *> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+// offscreen rendering needs no device extension at all
+static const std::vector<const char *> headlessDeviceExtensions = {};
+
+// -----------------------------------------------------------------------------
+// staging allocations are rounded up to this, more than any texel size or
+// optimalBufferCopyOffsetAlignment asks for
+// -----------------------------------------------------------------------------
+static const VkDeviceSize STAGING_ALIGNMENT = 256;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static const std::vector<const char *> validationLayers = { "VK_LAYER_KHRONOS_validation" };
+
+#ifdef NDEBUG
+static const bool enableValidationLayers = false;
+#else
+static const bool enableValidationLayers = true;
+#endif
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct Vertex
+{
+    glm::vec2 pos;
+    glm::vec3 color;
+    glm::vec2 texCoord;
+
+    static VkVertexInputBindingDescription getBindingDescription()
+    {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Vertex, color);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[2].offset = offsetof( Vertex, texCoord );
+
+        return attributeDescriptions;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static const std::vector<Vertex> vertices = { {{-2.0f, -1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+                                              {{ 1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+                                              {{ 1.0f,  1.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
+                                              {{-2.0f,  1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}}
+                                            };
+
+static const std::vector<uint16_t> indices = { 0, 1, 2, 2, 3, 0 };
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct UniformBufferObject
+{
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 proj;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct VulkanApp::QueueFamilyIndices
+{
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentFamily;
+
+    // family that can copy but not draw, uploads go there when there is one.
+    // Families that draw or compute copy any region, others only those
+    // aligned to their granularity
+    std::optional<uint32_t> transferFamily;
+    VkExtent3D              transferGranularity = { 1, 1, 1 };
+
+    // family running compute dispatches, the graphics family whenever it
+    // can compute so storage buffers never change hands between families
+    std::optional<uint32_t> computeFamily;
+
+    bool isComplete() const
+    {
+        return graphicsFamily.has_value() && presentFamily.has_value();
+    }
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct VulkanApp::SwapChainSupportDetails
+{
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static std::vector<char> readFile( const std::string &filename )
+{
+    std::ifstream file( filename, std::ios::ate | std::ios::binary );
+
+    if ( !file.is_open() )
+    {
+        throw std::runtime_error( "failed to open file!" );
+    }
+
+    size_t fileSize = (size_t)file.tellg();
+    std::vector<char> buffer( fileSize );
+    file.seekg( 0 );
+    file.read( buffer.data(), fileSize );
+    file.close();
+    return buffer;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback( VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+                                                     VkDebugUtilsMessageTypeFlagsEXT messageType,
+                                                     const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+                                                     void *pUserData )
+{
+    std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+    return VK_FALSE;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::run()
+{
+    initWindow();
+    initVulkan();
+    mainLoop();
+    cleanup();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::runHeadless( const HeadlessParams &params )
+{
+    _headless = true;
+    _headlessParams = params;
+
+    initVulkan();
+    headlessLoop();
+    cleanup();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::initWindow()
+{
+    glfwInit();
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint( GLFW_RESIZABLE, GLFW_TRUE );
+    auto wp = GetWindowParams();
+    _window = glfwCreateWindow(wp.width, wp.height, wp.title.c_str(), nullptr, nullptr);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::initVulkan()
+{
+    createInstance();
+    setupDebugMessenger();
+    if ( !_headless )
+    {
+        createSurface();
+    }
+    pickPhysicalDevice();
+    createLogicalDevice(_physicalDevice);
+    if ( _headless )
+    {
+        createOffscreenTarget();
+    }
+    else
+    {
+        createSwapChain(_physicalDevice);
+    }
+    createImageViews();
+    createRenderPass();
+    createDiscriptorSetLayout();
+    createGraphicsPipeline();
+    createFrameBuffers();
+    createCommandPool(_physicalDevice);
+    createUploadObjects();
+
+    // room for two full window sized uploads, grows on demand
+    auto wp = GetWindowParams();
+    createStagingRing( 2 * static_cast<VkDeviceSize>(wp.width) * wp.height * 4 );
+
+    createTextureImage("textures/texture.jpg");
+    createTextureImageView();
+    createTextureSampler();
+    createVertexBuffer();
+    createIndexBuffer();
+    createUniformBuffers();
+    createDescriptorPool();
+    createDescriptorSets();
+    createTimestampQueries();
+    createCommandBuffers();
+    createSyncObjects();
+
+    initResources();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static VkResult CreateDebugUtilsMessengerEXT( VkInstance instance,
+                                              const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+                                              const VkAllocationCallbacks *pAllocator,
+                                              VkDebugUtilsMessengerEXT *pDebugMessenger )
+{
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr( instance, "vkCreateDebugUtilsMessengerEXT" );
+    if ( func != nullptr )
+    {
+        return func( instance, pCreateInfo, pAllocator, pDebugMessenger );
+    }
+    else
+    {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void DestroyDebugUtilsMessengerEXT( VkInstance instance,
+                                    VkDebugUtilsMessengerEXT debugMessenger,
+                                    const VkAllocationCallbacks *pAllocator )
+{
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr( instance, "vkDestroyDebugUtilsMessengerEXT" );
+    if ( func != nullptr )
+    {
+        func( instance, debugMessenger, pAllocator );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void populateDebugMessengerCreateInfo( VkDebugUtilsMessengerCreateInfoEXT &createInfo )
+{
+    createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    createInfo.pfnUserCallback = debugCallback;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::setupDebugMessenger()
+{
+    if ( !enableValidationLayers )
+        return;
+
+    VkDebugUtilsMessengerCreateInfoEXT createInfo{};
+    populateDebugMessengerCreateInfo( createInfo );
+
+    if ( CreateDebugUtilsMessengerEXT( _instance, &createInfo, nullptr, &_debugMessenger ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to set up debug messenger!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createSurface()
+{
+    if (glfwCreateWindowSurface(_instance, _window, nullptr, &_surface) != VK_SUCCESS)
+        throw std::runtime_error("failed to create window surface!");
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::pickPhysicalDevice()
+{
+    uint32_t deviceCnt = 0;
+    vkEnumeratePhysicalDevices(_instance, &deviceCnt, nullptr);
+    if (deviceCnt == 0)
+        throw std::runtime_error("failed to find GPUs with Vulkan support!");
+
+    std::vector<VkPhysicalDevice> devices(deviceCnt);
+    vkEnumeratePhysicalDevices(_instance, &deviceCnt, devices.data());
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+
+    for (const auto &device : devices)
+    {
+        if (isDeviceSuitable(device))
+        {
+            physicalDevice = device;
+            break;
+        }
+    }
+
+    if (physicalDevice == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("failed to find a suitable GPU!");
+    }
+
+    _physicalDevice = physicalDevice;
+}
+
+// -------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VulkanApp::SwapChainSupportDetails VulkanApp::querySwapChainSupport(VkPhysicalDevice device)
+{
+    SwapChainSupportDetails details;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
+
+    uint32_t formatCount;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, nullptr);
+
+    if (formatCount != 0)
+    {
+        details.formats.resize(formatCount);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, details.formats.data());
+    }
+
+    uint32_t presentModeCount;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, nullptr);
+
+    if (presentModeCount != 0)
+    {
+        details.presentModes.resize(presentModeCount);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, details.presentModes.data());
+    }
+
+    return details;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VkSurfaceFormatKHR VulkanApp::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats)
+{
+    for (const auto &availableFormat : availableFormats)
+    {
+        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+        {
+            return availableFormat;
+        }
+    }
+
+    return availableFormats[0];
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VkPresentModeKHR VulkanApp::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
+{
+    for (const auto &availablePresentMode : availablePresentModes)
+    {
+        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        {
+            return availablePresentMode;
+        }
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VkExtent2D VulkanApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities)
+{
+    if (capabilities.currentExtent.width != UINT32_MAX)
+    {
+        return capabilities.currentExtent;
+    }
+
+    int width, height;
+    glfwGetFramebufferSize(_window, &width, &height);
+
+    VkExtent2D actualExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+    return actualExtent;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool VulkanApp::checkDeviceExtensionSupport(VkPhysicalDevice device)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    const auto &extensions = getRequiredDeviceExtensions();
+    std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
+
+    for (const auto &extension : availableExtensions)
+    {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    return requiredExtensions.empty();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool VulkanApp::checkValidationLayerSupport()
+{
+    uint32_t layerCount;
+    vkEnumerateInstanceLayerProperties( &layerCount, nullptr );
+
+    std::vector<VkLayerProperties> availableLayers( layerCount );
+    vkEnumerateInstanceLayerProperties( &layerCount, availableLayers.data() );
+
+    for ( const char *layerName : validationLayers )
+    {
+        bool layerFound = false;
+
+        for ( const auto &layerProperties : availableLayers )
+        {
+            if ( strcmp( layerName, layerProperties.layerName ) == 0 )
+            {
+                layerFound = true;
+                break;
+            }
+        }
+
+        if ( !layerFound )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+std::vector<const char *> VulkanApp::getRequiredExtensions()
+{
+    std::vector<const char *> extensions;
+
+    // glfw is never initialized without a window
+    if ( !_headless )
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
+        extensions.assign( glfwExtensions, glfwExtensions + glfwExtensionCount );
+    }
+
+    if ( enableValidationLayers )
+    {
+        extensions.push_back( VK_EXT_DEBUG_UTILS_EXTENSION_NAME );
+    }
+
+    return extensions;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+bool VulkanApp::isDeviceSuitable(VkPhysicalDevice device)
+{
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+    VkPhysicalDeviceFeatures deviceFeatures;
+    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+
+    QueueFamilyIndices indices = findQueueFamilies(device);
+
+    // uploads signal a timeline semaphore
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &timelineFeatures;
+    bool timelineSupported = deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+    if ( timelineSupported )
+    {
+        vkGetPhysicalDeviceFeatures2( device, &features2 );
+        timelineSupported = timelineFeatures.timelineSemaphore == VK_TRUE;
+    }
+
+    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    bool swapChainAdequate = _headless;
+    if (extensionsSupported && !_headless)
+    {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+        swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+    }
+
+    return indices.isComplete()                                                     &&
+           indices.computeFamily.has_value()                                        &&
+           swapChainAdequate                                                        &&
+           (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
+            deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)    &&
+           deviceFeatures.samplerAnisotropy                                         &&
+           timelineSupported;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VulkanApp::QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice device)
+{
+    QueueFamilyIndices indices;
+
+    uint32_t queueFamilyCnt = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCnt, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCnt);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCnt, queueFamilies.data());
+
+    for (uint32_t ii = 0; ii < (uint32_t)queueFamilies.size(); ++ii)
+    {
+        if (indices.isComplete())
+            break;
+
+        if (queueFamilies[ii].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            indices.graphicsFamily = ii;
+        }
+
+        // nothing is presented offscreen, the graphics queue stands in
+        if ( _headless )
+        {
+            indices.presentFamily = indices.graphicsFamily;
+            continue;
+        }
+
+        VkBool32 presentSupport = false;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, ii, _surface, &presentSupport);
+        if (presentSupport)
+        {
+            indices.presentFamily = ii;
+        }
+    }
+
+    // a copy engine only, then a family that computes but does not draw
+    for ( VkQueueFlags excluded : { VkQueueFlags( VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT ),
+                                    VkQueueFlags( VK_QUEUE_GRAPHICS_BIT ) } )
+    {
+        for (uint32_t ii = 0; ii < (uint32_t)queueFamilies.size() && !indices.transferFamily.has_value(); ++ii)
+        {
+            VkQueueFlags flags = queueFamilies[ii].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & excluded))
+            {
+                indices.transferFamily = ii;
+                indices.transferGranularity = queueFamilies[ii].minImageTransferGranularity;
+            }
+        }
+    }
+
+    if ( indices.graphicsFamily.has_value() &&
+         (queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) )
+    {
+        indices.computeFamily = indices.graphicsFamily;
+    }
+    else
+    {
+        for (uint32_t ii = 0; ii < (uint32_t)queueFamilies.size(); ++ii)
+        {
+            if (queueFamilies[ii].queueFlags & VK_QUEUE_COMPUTE_BIT)
+            {
+                indices.computeFamily = ii;
+                break;
+            }
+        }
+    }
+
+    return indices;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint32_t VulkanApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createRenderPass()
+{
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = _swapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                            : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create render pass!");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VkShaderModule VulkanApp::createShaderModule(const std::vector<char> &code)
+{
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    return shaderModule;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createSyncObjects()
+{
+    _imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    _renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    _inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    _imagesInFlight.resize(_swapChainImages.size(), VK_NULL_HANDLE);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS ||
+            vkCreateFence(_device, &fenceInfo, nullptr, &_inFlightFences[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create synchronization objects for a frame!");
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VkCommandBuffer VulkanApp::beginSingleTimeCommands()
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = _commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers( _device, &allocInfo, &commandBuffer );
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer( commandBuffer, &beginInfo );
+
+    return commandBuffer;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::endSingleTimeCommands( VkCommandBuffer commandBuffer )
+{
+    vkEndCommandBuffer( commandBuffer );
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkQueueSubmit( _graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
+    vkQueueWaitIdle( _graphicsQueue );
+
+    vkFreeCommandBuffers( _device, _commandPool, 1, &commandBuffer );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createCommandBuffers()
+{
+    _commandBuffers.resize(_swapChainFramebuffers.size() * MAX_FRAMES_IN_FLIGHT);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = (uint32_t)_commandBuffers.size();
+
+    if (vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    for (size_t j = 0; j < _commandBuffers.size(); j++)
+    {
+        // image i sampling texture copy j % MAX_FRAMES_IN_FLIGHT, see
+        // commandBufferFor
+        const size_t i = j / MAX_FRAMES_IN_FLIGHT;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        if (vkBeginCommandBuffer(_commandBuffers[j], &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = _renderPass;
+        renderPassInfo.framebuffer = _swapChainFramebuffers[i];
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = _swapChainExtent;
+
+        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        // the queries are read before the buffer is submitted again, see
+        // collectFrameTiming
+        if ( _timestampPool != VK_NULL_HANDLE )
+        {
+            uint32_t query = 2 * static_cast<uint32_t>(i);
+            vkCmdResetQueryPool( _commandBuffers[j], _timestampPool, query, 2 );
+            vkCmdWriteTimestamp( _commandBuffers[j], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestampPool, query );
+        }
+
+        vkCmdBeginRenderPass(_commandBuffers[j], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        vkCmdBindPipeline(_commandBuffers[j], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+
+        VkBuffer vertexBuffers[] = {_vertexBuffer};
+        VkDeviceSize offsets[] ={0};
+        vkCmdBindVertexBuffers(_commandBuffers[j], 0, 1, vertexBuffers, offsets);
+
+        vkCmdBindIndexBuffer( _commandBuffers[j], _indexBuffer, 0, VK_INDEX_TYPE_UINT16 );
+
+        // the uniform buffer of image i and the texture copy, see
+        // updateDescriptorSets
+        vkCmdBindDescriptorSets( _commandBuffers[j], VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                 _pipelineLayout, 0, 1, &_descriptorSets[j], 0, nullptr );
+
+        vkCmdDrawIndexed( _commandBuffers[j], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0 );
+
+        vkCmdEndRenderPass(_commandBuffers[j]);
+
+        if ( _timestampPool != VK_NULL_HANDLE )
+        {
+            vkCmdWriteTimestamp( _commandBuffers[j], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 _timestampPool, 2 * static_cast<uint32_t>(i) + 1 );
+        }
+
+        if ( _headless )
+        {
+            // the render pass leaves the image in transfer source layout,
+            // wait for the color writes and copy it out for the host
+            VkImageMemoryBarrier imageBarrier{};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = _swapChainImages[i];
+            imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            imageBarrier.subresourceRange.levelCount = 1;
+            imageBarrier.subresourceRange.layerCount = 1;
+            imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            vkCmdPipelineBarrier( _commandBuffers[j],
+                                  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                  VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                  0, 0, nullptr, 0, nullptr, 1, &imageBarrier );
+
+            VkBufferImageCopy region{};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = { _swapChainExtent.width, _swapChainExtent.height, 1 };
+
+            vkCmdCopyImageToBuffer( _commandBuffers[j], _swapChainImages[i],
+                                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                    _readbackBuffers[i], 1, &region );
+
+            VkBufferMemoryBarrier bufferBarrier{};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.buffer = _readbackBuffers[i];
+            bufferBarrier.size = VK_WHOLE_SIZE;
+
+            vkCmdPipelineBarrier( _commandBuffers[j],
+                                  VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                  VK_PIPELINE_STAGE_HOST_BIT,
+                                  0, 0, nullptr, 1, &bufferBarrier, 0, nullptr );
+        }
+
+        if (vkEndCommandBuffer(_commandBuffers[j]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// The command buffers of an image differ only in the texture copy they sample
+// -----------------------------------------------------------------------------
+VkCommandBuffer VulkanApp::commandBufferFor( uint32_t imageIndex ) const
+{
+    return _commandBuffers[imageIndex * MAX_FRAMES_IN_FLIGHT + _textureCurrent];
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createCommandPool(VkPhysicalDevice physicalDevice)
+{
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    poolInfo.flags = 0; // Optional
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create command pool!");
+    }
+
+    // compute command buffers are rerecorded for every dispatch
+    VkCommandPoolCreateInfo computePoolInfo{};
+    computePoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    computePoolInfo.queueFamilyIndex = _computeFamily;
+    computePoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if ( vkCreateCommandPool( _device, &computePoolInfo, nullptr, &_computeCommandPool ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create compute command pool!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createBuffer( VkDeviceSize size,
+                              VkBufferUsageFlags usage,
+                              VkMemoryPropertyFlags properties,
+                              VkBuffer &buffer,
+                              VkDeviceMemory &bufferMemory,
+                              const std::vector<uint32_t> &queueFamilies )
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+
+    // same as createImage, shared when used by more than one queue family
+    if ( queueFamilies.size() > 1 )
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+    else
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if ( vkCreateBuffer( _device, &bufferInfo, nullptr, &buffer ) != VK_SUCCESS ) {
+        throw std::runtime_error( "failed to create buffer!" );
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements( _device, buffer, &memRequirements );
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType( memRequirements.memoryTypeBits, properties );
+
+    if ( vkAllocateMemory( _device, &allocInfo, nullptr, &bufferMemory ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to allocate buffer memory!" );
+    }
+
+    vkBindBufferMemory( _device, buffer, bufferMemory, 0 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createVertexBuffer()
+{
+    VkDeviceSize bufferSize = sizeof( vertices[0] ) * vertices.size();
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+
+    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  stagingBuffer, stagingBufferMemory );
+
+    void *data;
+    vkMapMemory( _device, stagingBufferMemory, 0, bufferSize, 0, &data );
+    memcpy( data, vertices.data(), (size_t)bufferSize );
+    vkUnmapMemory( _device, stagingBufferMemory );
+
+    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory );
+
+    copyBuffer( stagingBuffer, _vertexBuffer, bufferSize );
+
+    vkDestroyBuffer( _device, stagingBuffer, nullptr );
+    vkFreeMemory( _device, stagingBufferMemory, nullptr );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::copyBuffer( VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size )
+{
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0; // Optional
+    copyRegion.dstOffset = 0; // Optional
+    copyRegion.size = size;
+    vkCmdCopyBuffer( commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion );
+
+    endSingleTimeCommands( commandBuffer );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createImage( uint32_t width,
+                             uint32_t height,
+                             VkFormat format,
+                             VkImageTiling tiling,
+                             VkImageUsageFlags usage,
+                             VkMemoryPropertyFlags properties,
+                             VkImage &image,
+                             VkDeviceMemory &imageMemory,
+                             const std::vector<uint32_t> &queueFamilies )
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = tiling;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    // images used by more than one queue family are shared rather than
+    // handed over with ownership transfers
+    if ( queueFamilies.size() > 1 )
+    {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        imageInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+    else
+    {
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if ( vkCreateImage( _device, &imageInfo, nullptr, &image ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create image!" );
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements( _device, image, &memRequirements );
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType( memRequirements.memoryTypeBits, properties );
+
+    if ( vkAllocateMemory( _device, &allocInfo, nullptr, &imageMemory ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to allocate image memory!" );
+    }
+
+    vkBindImageMemory( _device, image, imageMemory, 0 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createDescriptorSets()
+{
+    // one per command buffer
+    const size_t setCount = _swapChainImages.size() * MAX_FRAMES_IN_FLIGHT;
+    std::vector<VkDescriptorSetLayout> layouts( setCount, _descriptorSetLayout );
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(setCount);
+    allocInfo.pSetLayouts = layouts.data();
+
+    _descriptorSets.resize( setCount );
+    if ( vkAllocateDescriptorSets( _device, &allocInfo, _descriptorSets.data() ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to allocate descriptor sets!" );
+    }
+
+    updateDescriptorSets();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createDescriptorPool()
+{
+    const uint32_t setCount = static_cast<uint32_t>(_swapChainImages.size() * MAX_FRAMES_IN_FLIGHT);
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = setCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = setCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = setCount;
+
+    if ( vkCreateDescriptorPool( _device, &poolInfo, nullptr, &_descriptorPool ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create descriptor pool!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::updateUniformBuffer( uint32_t currentImage )
+{
+    static auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    float time = std::chrono::duration<float, std::chrono::seconds::period>( currentTime - startTime ).count();
+
+    time = 2.0f;
+    UniformBufferObject ubo{};
+    ubo.model = glm::rotate( glm::mat4( 1.0f ), time * glm::radians( 90.0f ), glm::vec3( 0.0f, 0.0f, 1.0f ) );
+
+    // ubo.view = glm::lookAt( glm::vec3( 2.0f, 2.0f, 2.0f ), glm::vec3( 0.0f, 0.0f, 0.0f ), glm::vec3( 0.0f, 0.0f, 1.0f ) );
+    ubo.view = glm::lookAt( glm::vec3( 0.5f, 0.0f, 2.5f ), glm::vec3( 0.5f, 0.0f, 0.0f ), glm::vec3( 0.0f, 1.0f, 0.0f ) );
+    ubo.proj = glm::perspective( glm::radians( 45.0f ), _swapChainExtent.width / (float)_swapChainExtent.height, 0.1f, 10.0f );
+    ubo.proj[1][1] *= -1;
+
+    memcpy( _uniformBuffersMapped[currentImage], &ubo, sizeof( ubo ) );
+}
+
+// -----------------------------------------------------------------------------
+// One per swapchain image, like the command buffers reading them. A frame
+// writes the buffer of its image once the last frame drawn into the image is
+// done, see drawFrame
+// -----------------------------------------------------------------------------
+void VulkanApp::createUniformBuffers()
+{
+    VkDeviceSize bufferSize = sizeof( UniformBufferObject );
+
+    _uniformBuffers.resize( _swapChainImages.size() );
+    _uniformBuffersMemory.resize( _swapChainImages.size() );
+    _uniformBuffersMapped.resize( _swapChainImages.size() );
+
+    for ( size_t i = 0; i < _uniformBuffers.size(); i++ )
+    {
+        createBuffer( bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      _uniformBuffers[i], _uniformBuffersMemory[i] );
+
+        vkMapMemory( _device, _uniformBuffersMemory[i], 0, bufferSize, 0, &_uniformBuffersMapped[i] );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createIndexBuffer()
+{
+    VkDeviceSize bufferSize = sizeof( indices[0] ) * indices.size();
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  stagingBuffer, stagingBufferMemory );
+
+    void *data;
+    vkMapMemory( _device, stagingBufferMemory, 0, bufferSize, 0, &data );
+    memcpy( data, indices.data(), (size_t)bufferSize );
+    vkUnmapMemory( _device, stagingBufferMemory );
+
+    createBuffer( bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  _indexBuffer, _indexBufferMemory );
+
+    copyBuffer( stagingBuffer, _indexBuffer, bufferSize );
+
+    vkDestroyBuffer( _device, stagingBuffer, nullptr );
+    vkFreeMemory( _device, stagingBufferMemory, nullptr );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::transitionImageLayout( VkImage image, VkFormat format,
+                                       VkImageLayout oldLayout,
+                                       VkImageLayout newLayout )
+{
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    recordImageBarrier( commandBuffer, image, oldLayout, newLayout );
+    endSingleTimeCommands( commandBuffer );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::recordImageBarrier( VkCommandBuffer commandBuffer, VkImage image,
+                                    VkImageLayout oldLayout,
+                                    VkImageLayout newLayout )
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkPipelineStageFlags sourceStage;
+    VkPipelineStageFlags destinationStage;
+
+    if ( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+    {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL )
+    {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+    else
+    {
+        throw std::invalid_argument( "unsupported layout transition!" );
+    }
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        sourceStage, destinationStage,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier
+    );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createTextureImage( const std::string &texImgFile )
+{
+    int texWidth, texHeight, texChannels;
+    stbi_uc *pixels = stbi_load( texImgFile.c_str(),
+                                 &texWidth, &texHeight, &texChannels, STBI_rgb_alpha );
+
+    if ( !pixels )
+    {
+        throw std::runtime_error( "failed to load texture image!" );
+    }
+
+    uploadTextureImage( pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight) );
+
+    stbi_image_free( pixels );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createTextureImage( const std::vector<unsigned char> &pixels,
+                                    uint32_t width, uint32_t height )
+{
+    if ( pixels.empty() || pixels.size() != width * height * 4 )
+    {
+        throw std::runtime_error( "invalid texture data!" );
+    }
+
+    uploadTextureImage( pixels.data(), width, height );
+}
+
+// -----------------------------------------------------------------------------
+// Layout transition of a texture on the upload queue. A dedicated transfer
+// queue supports no shader stages, the uploads that follow on the same queue
+// are ordered by the transfer stage and the graphics queue picks the image up
+// through the upload timeline semaphore
+// -----------------------------------------------------------------------------
+static void recordUploadBarrier( VkCommandBuffer commandBuffer, VkImage image,
+                                 VkImageLayout oldLayout, VkImageLayout newLayout )
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkPipelineStageFlags sourceStage;
+    VkPipelineStageFlags destinationStage;
+
+    if ( newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+    {
+        // after earlier copies into the same image
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    else if ( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL )
+    {
+        // made visible to the fragment shader by the semaphore wait
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+    else
+    {
+        throw std::invalid_argument( "unsupported layout transition!" );
+    }
+
+    vkCmdPipelineBarrier( commandBuffer, sourceStage, destinationStage,
+                          0, 0, nullptr, 0, nullptr, 1, &barrier );
+}
+
+// -----------------------------------------------------------------------------
+// Smallest rectangle holding a and b, a rectangle without extent holds nothing
+// -----------------------------------------------------------------------------
+static VkRect2D UnionRect( const VkRect2D &a, const VkRect2D &b )
+{
+    if ( a.extent.width == 0 || a.extent.height == 0 )
+    {
+        return b;
+    }
+    if ( b.extent.width == 0 || b.extent.height == 0 )
+    {
+        return a;
+    }
+
+    int32_t x0 = std::min( a.offset.x, b.offset.x );
+    int32_t y0 = std::min( a.offset.y, b.offset.y );
+    int32_t x1 = std::max( a.offset.x + static_cast<int32_t>(a.extent.width), b.offset.x + static_cast<int32_t>(b.extent.width) );
+    int32_t y1 = std::max( a.offset.y + static_cast<int32_t>(a.extent.height), b.offset.y + static_cast<int32_t>(b.extent.height) );
+    return VkRect2D{ { x0, y0 }, { static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0) } };
+}
+
+// -----------------------------------------------------------------------------
+// Creates the texture from rgba8 pixels, one copy of it per frame in flight.
+// Frames sample the current copy and writes go to another, so a write only
+// waits for the frame that last sampled the copy it overwrites. Transitions
+// and copies go to the upload queue as one submission, the first frame
+// sampling the texture waits for it on the device
+// -----------------------------------------------------------------------------
+void VulkanApp::uploadTextureImage( const unsigned char *pixels,
+                                    uint32_t width, uint32_t height )
+{
+    VkDeviceSize imageSize = static_cast<VkDeviceSize>(width) * height * 4;
+
+    // written by uploads and by texture writes on the compute queue
+    std::vector<uint32_t> families = { _graphicsFamily };
+    for ( uint32_t family : { _transferFamily, _computeFamily } )
+    {
+        if ( std::find( families.begin(), families.end(), family ) == families.end() )
+        {
+            families.push_back( family );
+        }
+    }
+
+    _textureImages.resize( MAX_FRAMES_IN_FLIGHT );
+    _textureImagesMemory.resize( MAX_FRAMES_IN_FLIGHT );
+    for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+        createImage( width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+                     VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImages[i], _textureImagesMemory[i],
+                     families );
+    }
+    _textureExtent = { width, height };
+    _textureCurrent = 0;
+    _textureFences.assign( MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE );
+    _textureStale.assign( MAX_FRAMES_IN_FLIGHT, VkRect2D{} );
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    StagingAllocation staging = allocateStaging( imageSize );
+    memcpy( staging.data, pixels, static_cast<size_t>(imageSize) );
+
+    VkCommandBuffer commandBuffer = beginUpload( _transferQueue );
+
+    VkBufferImageCopy copy{};
+    copy.bufferOffset = staging.offset;
+    copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageExtent = { width, height, 1 };
+
+    // every copy starts out with the same pixels, staged once
+    for ( VkImage image : _textureImages )
+    {
+        recordUploadBarrier( commandBuffer, image,
+                             VK_IMAGE_LAYOUT_UNDEFINED,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+
+        vkCmdCopyBufferToImage( commandBuffer, _stagingBuffer, image,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+
+        recordUploadBarrier( commandBuffer, image,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+    }
+
+    _textureReadyValue = submitUpload( commandBuffer );
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    _uploadStats.uploads += 1;
+    _uploadStats.bytes += imageSize;
+    _uploadStats.seconds += std::chrono::duration<double>( endTime - startTime ).count();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::updateTexture( const std::vector<unsigned char> &pixels )
+{
+    updateTexture( pixels, VkRect2D{ { 0, 0 }, _textureExtent } );
+}
+
+// -----------------------------------------------------------------------------
+// Only the rows of region are staged, together with what the copy written
+// missed of earlier writes, and barriers and copy go out in a single
+// submission. Regions the transfer queue cannot copy go to the graphics queue
+// -----------------------------------------------------------------------------
+void VulkanApp::updateTexture( const std::vector<unsigned char> &pixels,
+                               const VkRect2D &region )
+{
+    const uint32_t width = _textureExtent.width;
+    const uint32_t height = _textureExtent.height;
+
+    if ( pixels.size() != static_cast<size_t>(width) * height * 4 )
+    {
+        throw std::runtime_error( "invalid texture data!" );
+    }
+
+    if ( region.offset.x < 0 || region.offset.y < 0 ||
+         region.offset.x + region.extent.width > width ||
+         region.offset.y + region.extent.height > height )
+    {
+        throw std::invalid_argument( "texture region out of bounds!" );
+    }
+
+    if ( region.extent.width == 0 || region.extent.height == 0 )
+    {
+        return;
+    }
+
+    const size_t textureCopy = nextTextureCopy();
+    waitForTextureCopy( textureCopy );
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    const VkRect2D written = UnionRect( _textureStale[textureCopy], region );
+    const size_t rowSize = static_cast<size_t>(written.extent.width) * 4;
+    const VkDeviceSize regionSize = static_cast<VkDeviceSize>(rowSize) * written.extent.height;
+
+    StagingAllocation staging = allocateStaging( regionSize );
+    for ( uint32_t row = 0; row < written.extent.height; ++row )
+    {
+        size_t src = ((static_cast<size_t>(written.offset.y) + row) * width + written.offset.x) * 4;
+        memcpy( static_cast<unsigned char *>(staging.data) + row * rowSize, pixels.data() + src, rowSize );
+    }
+
+    VkCommandBuffer commandBuffer = beginUpload( transferCanCopy( written ) ? _transferQueue : _graphicsQueue );
+
+    recordUploadBarrier( commandBuffer, _textureImages[textureCopy],
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+
+    VkBufferImageCopy copy{};
+    copy.bufferOffset = staging.offset;
+    copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageOffset = { written.offset.x, written.offset.y, 0 };
+    copy.imageExtent = { written.extent.width, written.extent.height, 1 };
+    vkCmdCopyBufferToImage( commandBuffer, _stagingBuffer, _textureImages[textureCopy],
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+
+    recordUploadBarrier( commandBuffer, _textureImages[textureCopy],
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+
+    _textureReadyValue = submitUpload( commandBuffer );
+    finishTextureWrite( textureCopy, region );
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    _uploadStats.uploads += 1;
+    _uploadStats.bytes += regionSize;
+    _uploadStats.seconds += std::chrono::duration<double>( endTime - startTime ).count();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::replaceTexture( const std::vector<unsigned char> &pixels,
+                                uint32_t width, uint32_t height )
+{
+    // the old texture may still be sampled and the command buffers in use
+    vkDeviceWaitIdle( _device );
+
+    cleanupImageTexture();
+    createTextureImage( pixels, width, height );
+    createTextureImageView();
+    updateDescriptorSets();
+    vkFreeCommandBuffers( _device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data() );
+    createCommandBuffers();
+}
+
+// -----------------------------------------------------------------------------
+// Uploads are recorded into command buffers of their own pool on the
+// transfer queue, or on the graphics queue when the device has no dedicated
+// transfer family. Region updates the transfer family cannot copy use a
+// second pool on the graphics family. Each submission signals the next value
+// of a timeline semaphore, which also tells when its command buffer and
+// staging range can be reused
+// -----------------------------------------------------------------------------
+void VulkanApp::createUploadObjects()
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = _transferFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if ( vkCreateCommandPool( _device, &poolInfo, nullptr, &_uploadCommandPool ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create upload command pool!" );
+    }
+
+    if ( _transferFamily != _graphicsFamily )
+    {
+        poolInfo.queueFamilyIndex = _graphicsFamily;
+        if ( vkCreateCommandPool( _device, &poolInfo, nullptr, &_graphicsUploadCommandPool ) != VK_SUCCESS )
+        {
+            throw std::runtime_error( "failed to create upload command pool!" );
+        }
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    if ( vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_uploadTimeline ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create upload timeline semaphore!" );
+    }
+
+    _uploadValue = 0;
+    _textureReadyValue = 0;
+    _textureWaitedValue = 0;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::cleanupUploadObjects()
+{
+    cleanupStagingRing();
+
+    vkDestroyCommandPool( _device, _uploadCommandPool, nullptr );
+    if ( _graphicsUploadCommandPool != VK_NULL_HANDLE )
+    {
+        vkDestroyCommandPool( _device, _graphicsUploadCommandPool, nullptr );
+        _graphicsUploadCommandPool = VK_NULL_HANDLE;
+    }
+    vkDestroySemaphore( _device, _uploadTimeline, nullptr );
+    _uploadCommandBuffers.clear();
+    _uploadCommandValues.clear();
+    _uploadCommandQueues.clear();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+uint64_t VulkanApp::completedUploadValue()
+{
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue( _device, _uploadTimeline, &value );
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// Starts recording an upload for queue, _transferQueue or _graphicsQueue,
+// into a command buffer the device is done with. The pools only grow while
+// more uploads are in flight than ever before
+// -----------------------------------------------------------------------------
+VkCommandBuffer VulkanApp::beginUpload( VkQueue queue )
+{
+    uint64_t completed = completedUploadValue();
+
+    size_t index = 0;
+    while ( index < _uploadCommandBuffers.size() &&
+            (_uploadCommandValues[index] > completed || _uploadCommandQueues[index] != queue) )
+    {
+        ++index;
+    }
+
+    if ( index == _uploadCommandBuffers.size() )
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = queue == _transferQueue ? _uploadCommandPool : _graphicsUploadCommandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if ( vkAllocateCommandBuffers( _device, &allocInfo, &commandBuffer ) != VK_SUCCESS )
+        {
+            throw std::runtime_error( "failed to allocate upload command buffer!" );
+        }
+        _uploadCommandBuffers.push_back( commandBuffer );
+        _uploadCommandValues.push_back( 0 );
+        _uploadCommandQueues.push_back( queue );
+    }
+    else
+    {
+        vkResetCommandBuffer( _uploadCommandBuffers[index], 0 );
+    }
+
+    // marks the buffer busy until submitUpload assigns its real value
+    _uploadCommandValues[index] = UINT64_MAX;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer( _uploadCommandBuffers[index], &beginInfo );
+
+    return _uploadCommandBuffers[index];
+}
+
+// -----------------------------------------------------------------------------
+// Submits a texture write on queue and returns the upload timeline value it
+// signals. Writes may come from different queues, so each waits for the one
+// before it and the timeline is always signalled in order. Staging ranges
+// handed out since the last write are tied to the new value
+// -----------------------------------------------------------------------------
+uint64_t VulkanApp::submitTimelined( VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence )
+{
+    vkEndCommandBuffer( commandBuffer );
+
+    uint64_t previous = _uploadValue;
+    uint64_t value = ++_uploadValue;
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = previous > 0 ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &previous;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &value;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = previous > 0 ? 1 : 0;
+    submitInfo.pWaitSemaphores = &_uploadTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_uploadTimeline;
+
+    if ( vkQueueSubmit( queue, 1, &submitInfo, fence ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to submit texture write!" );
+    }
+
+    for ( auto segment = _stagingSegments.rbegin(); segment != _stagingSegments.rend() && segment->value == 0; ++segment )
+    {
+        segment->value = value;
+    }
+
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// Submits an upload without waiting for it and returns the timeline value it
+// signals
+// -----------------------------------------------------------------------------
+uint64_t VulkanApp::submitUpload( VkCommandBuffer commandBuffer )
+{
+    const size_t index = std::find( _uploadCommandBuffers.begin(), _uploadCommandBuffers.end(), commandBuffer ) -
+                         _uploadCommandBuffers.begin();
+    uint64_t value = submitTimelined( _uploadCommandQueues[index], commandBuffer, VK_NULL_HANDLE );
+    _uploadCommandValues[index] = value;
+
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// Copies on the transfer queue start on multiples of its family's
+// minImageTransferGranularity and span multiples of it, or reach the edge of
+// the texture. A zero granularity only allows whole textures
+// -----------------------------------------------------------------------------
+bool VulkanApp::transferCanCopy( const VkRect2D &region ) const
+{
+    auto aligned = []( int32_t offset, uint32_t extent, uint32_t granularity, uint32_t size )
+    {
+        if ( granularity == 0 )
+        {
+            return offset == 0 && extent == size;
+        }
+        return offset % granularity == 0 && (extent % granularity == 0 || offset + extent == size);
+    };
+
+    return aligned( region.offset.x, region.extent.width, _transferGranularity.width, _textureExtent.width ) &&
+           aligned( region.offset.y, region.extent.height, _transferGranularity.height, _textureExtent.height );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+size_t VulkanApp::nextTextureCopy() const
+{
+    return (_textureCurrent + 1) % _textureImages.size();
+}
+
+// -----------------------------------------------------------------------------
+// Frames in flight sampling the other copies keep running
+// -----------------------------------------------------------------------------
+void VulkanApp::waitForTextureCopy( size_t textureCopy )
+{
+    if ( _textureFences[textureCopy] != VK_NULL_HANDLE )
+    {
+        vkWaitForFences( _device, 1, &_textureFences[textureCopy], VK_TRUE, UINT64_MAX );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// The copy written holds the whole texture now, the others miss region
+// -----------------------------------------------------------------------------
+void VulkanApp::finishTextureWrite( size_t textureCopy, const VkRect2D &region )
+{
+    for ( size_t i = 0; i < _textureStale.size(); i++ )
+    {
+        _textureStale[i] = i == textureCopy ? VkRect2D{} : UnionRect( _textureStale[i], region );
+    }
+    _textureCurrent = textureCopy;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::recordTextureCopy( VkCommandBuffer commandBuffer, VkBuffer source )
+{
+    VkImage image = _textureImages[nextTextureCopy()];
+
+    recordUploadBarrier( commandBuffer, image,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+
+    VkBufferImageCopy copy{};
+    copy.bufferOffset = 0;
+    copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageExtent = { _textureExtent.width, _textureExtent.height, 1 };
+    vkCmdCopyBufferToImage( commandBuffer, source, image,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+
+    recordUploadBarrier( commandBuffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::submitTextureWrite( VkCommandBuffer commandBuffer, VkFence fence )
+{
+    // the copy recordTextureCopy wrote into
+    const size_t textureCopy = nextTextureCopy();
+    waitForTextureCopy( textureCopy );
+
+    _textureReadyValue = submitTimelined( _computeQueue, commandBuffer, fence );
+    finishTextureWrite( textureCopy, VkRect2D{ { 0, 0 }, _textureExtent } );
+}
+
+// -----------------------------------------------------------------------------
+// One persistently mapped host coherent buffer all texture uploads are staged
+// in. Ranges are handed out round robin and come back once the upload
+// reading them has completed, so steady state uploads neither allocate nor
+// map memory
+// -----------------------------------------------------------------------------
+void VulkanApp::createStagingRing( VkDeviceSize size )
+{
+    // read by the transfer queue and by region updates it cannot copy
+    std::vector<uint32_t> families = { _transferFamily };
+    if ( _graphicsFamily != _transferFamily )
+    {
+        families.push_back( _graphicsFamily );
+    }
+    createBuffer( size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  _stagingBuffer, _stagingBufferMemory, families );
+
+    vkMapMemory( _device, _stagingBufferMemory, 0, size, 0, &_stagingBufferMapped );
+
+    _stagingSize = size;
+    _stagingHead = 0;
+    ++_uploadStats.stagingAllocations;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::cleanupStagingRing()
+{
+    while ( !_stagingSegments.empty() )
+    {
+        retireStaging( true );
+    }
+
+    if ( _stagingBuffer != VK_NULL_HANDLE )
+    {
+        vkUnmapMemory( _device, _stagingBufferMemory );
+        vkDestroyBuffer( _device, _stagingBuffer, nullptr );
+        vkFreeMemory( _device, _stagingBufferMemory, nullptr );
+    }
+
+    _stagingBuffer = VK_NULL_HANDLE;
+    _stagingBufferMemory = VK_NULL_HANDLE;
+    _stagingBufferMapped = nullptr;
+    _stagingSize = 0;
+    _stagingHead = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Releases the oldest staging range once the device is done reading it.
+// Returns false if it is still in use and wait is not set
+// -----------------------------------------------------------------------------
+bool VulkanApp::retireStaging( bool wait )
+{
+    const StagingSegment &segment = _stagingSegments.front();
+    if ( segment.value == 0 )
+    {
+        throw std::runtime_error( "staging ring too small for a single upload!" );
+    }
+
+    if ( wait )
+    {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &_uploadTimeline;
+        waitInfo.pValues = &segment.value;
+        vkWaitSemaphores( _device, &waitInfo, UINT64_MAX );
+    }
+    else if ( completedUploadValue() < segment.value )
+    {
+        return false;
+    }
+
+    _stagingSegments.pop_front();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Hands out size bytes of the staging ring, waiting for older uploads when
+// the ring is full. The range is tied to the next submitted upload
+// -----------------------------------------------------------------------------
+VulkanApp::StagingAllocation VulkanApp::allocateStaging( VkDeviceSize size )
+{
+    size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+    if ( size > _stagingSize )
+    {
+        VkDeviceSize grown = std::max( size, 2 * _stagingSize );
+        cleanupStagingRing();
+        createStagingRing( grown );
+    }
+
+    while ( !_stagingSegments.empty() && retireStaging( false ) )
+    {
+    }
+
+    VkDeviceSize begin = _stagingHead;
+    if ( begin + size > _stagingSize )
+    {
+        begin = 0;
+    }
+
+    auto overlaps = [&]( const StagingSegment &segment )
+    {
+        return segment.begin < begin + size && begin < segment.end;
+    };
+
+    while ( std::any_of( _stagingSegments.begin(), _stagingSegments.end(), overlaps ) )
+    {
+        retireStaging( true );
+    }
+
+    _stagingSegments.push_back( { begin, begin + size, 0 } );
+    _stagingHead = begin + size;
+
+    return { begin, static_cast<char *>(_stagingBufferMapped) + begin };
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createFrameBuffers()
+{
+    _swapChainFramebuffers.resize(_swapChainImageViews.size());
+    for (size_t i = 0; i < _swapChainImageViews.size(); i++)
+    {
+        VkImageView attachments[] = {_swapChainImageViews[i]};
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = _renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.width = _swapChainExtent.width;
+        framebufferInfo.height = _swapChainExtent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_swapChainFramebuffers[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::copyBufferToImage( VkBuffer buffer, VkImage image,
+                                   uint32_t width, uint32_t height,
+                                   VkDeviceSize bufferOffset )
+{
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    VkBufferImageCopy region{};
+    region.bufferOffset = bufferOffset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = {
+        width,
+        height,
+        1
+    };
+    vkCmdCopyBufferToImage(
+        commandBuffer,
+        buffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1,
+        &region
+    );
+    endSingleTimeCommands( commandBuffer );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createGraphicsPipeline()
+{
+    auto vertShaderCode = readFile("shaders/vert.spv");
+    auto fragShaderCode = readFile("shaders/frag.spv");
+
+    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+    auto bindingDescription    = Vertex::getBindingDescription();
+    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)_swapChainExtent.width;
+    viewport.height = (float)_swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = _swapChainExtent;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = &viewport;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = &scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+    colorBlending.blendConstants[0] = 0.0f;
+    colorBlending.blendConstants[1] = 0.0f;
+    colorBlending.blendConstants[2] = 0.0f;
+    colorBlending.blendConstants[3] = 0.0f;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+
+    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = nullptr; // Optional
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = nullptr; // Optional
+    pipelineInfo.layout = _pipelineLayout;
+    pipelineInfo.renderPass = _renderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+    pipelineInfo.basePipelineIndex = -1;              // Optional
+
+    if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+
+    vkDestroyShaderModule(_device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createComputePipeline( const std::string &shaderFile,
+                                       const std::vector<VkBuffer> &storageBuffers,
+                                       uint32_t pushConstantSize,
+                                       ComputePipeline &compute )
+{
+    const uint32_t bufferCount = static_cast<uint32_t>(storageBuffers.size());
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings( bufferCount );
+    for ( uint32_t ii = 0; ii < bufferCount; ++ii )
+    {
+        bindings[ii].binding = ii;
+        bindings[ii].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[ii].descriptorCount = 1;
+        bindings[ii].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[ii].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bufferCount;
+    layoutInfo.pBindings = bindings.data();
+    if ( vkCreateDescriptorSetLayout( _device, &layoutInfo, nullptr, &compute.setLayout ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create compute descriptor set layout!" );
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = bufferCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+    if ( vkCreateDescriptorPool( _device, &poolInfo, nullptr, &compute.descriptorPool ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create compute descriptor pool!" );
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = compute.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &compute.setLayout;
+    if ( vkAllocateDescriptorSets( _device, &allocInfo, &compute.descriptorSet ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to allocate compute descriptor set!" );
+    }
+
+    std::vector<VkDescriptorBufferInfo> bufferInfos( bufferCount );
+    std::vector<VkWriteDescriptorSet> descriptorWrites( bufferCount );
+    for ( uint32_t ii = 0; ii < bufferCount; ++ii )
+    {
+        bufferInfos[ii].buffer = storageBuffers[ii];
+        bufferInfos[ii].offset = 0;
+        bufferInfos[ii].range = VK_WHOLE_SIZE;
+
+        descriptorWrites[ii].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[ii].dstSet = compute.descriptorSet;
+        descriptorWrites[ii].dstBinding = ii;
+        descriptorWrites[ii].dstArrayElement = 0;
+        descriptorWrites[ii].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[ii].descriptorCount = 1;
+        descriptorWrites[ii].pBufferInfo = &bufferInfos[ii];
+    }
+    vkUpdateDescriptorSets( _device, bufferCount, descriptorWrites.data(), 0, nullptr );
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &compute.setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if ( vkCreatePipelineLayout( _device, &pipelineLayoutInfo, nullptr, &compute.layout ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create compute pipeline layout!" );
+    }
+
+    VkShaderModule shaderModule = createShaderModule( readFile( shaderFile ) );
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = compute.layout;
+
+    VkResult result = vkCreateComputePipelines( _device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &compute.pipeline );
+    vkDestroyShaderModule( _device, shaderModule, nullptr );
+    if ( result != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create compute pipeline!" );
+    }
+
+    compute.pushConstantSize = pushConstantSize;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::destroyComputePipeline( ComputePipeline &compute )
+{
+    vkDestroyPipeline( _device, compute.pipeline, nullptr );
+    vkDestroyPipelineLayout( _device, compute.layout, nullptr );
+    vkDestroyDescriptorPool( _device, compute.descriptorPool, nullptr );
+    vkDestroyDescriptorSetLayout( _device, compute.setLayout, nullptr );
+    compute = ComputePipeline{};
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::recordDispatch( VkCommandBuffer commandBuffer,
+                                const ComputePipeline &compute,
+                                const void *pushConstants,
+                                uint32_t groupCountX )
+{
+    vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline );
+    vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.layout,
+                             0, 1, &compute.descriptorSet, 0, nullptr );
+    if ( compute.pushConstantSize > 0 )
+    {
+        vkCmdPushConstants( commandBuffer, compute.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                            0, compute.pushConstantSize, pushConstants );
+    }
+    vkCmdDispatch( commandBuffer, groupCountX, 1, 1 );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+VkImageView VulkanApp::createImageView( VkImage image, VkFormat format )
+{
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkImageView imageView;
+    if ( vkCreateImageView( _device, &viewInfo, nullptr, &imageView ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create texture image view!" );
+    }
+
+    return imageView;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::updateDescriptorSets()
+{
+    // set i pairs the uniform buffer of image i / MAX_FRAMES_IN_FLIGHT with
+    // texture copy i % MAX_FRAMES_IN_FLIGHT, as command buffer i draws
+    for ( size_t i = 0; i < _descriptorSets.size(); i++ )
+    {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = _uniformBuffers[i / MAX_FRAMES_IN_FLIGHT];
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof( UniformBufferObject );
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = _textureImageViews[i % MAX_FRAMES_IN_FLIGHT];
+        imageInfo.sampler = _textureSampler;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = _descriptorSets[i];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = _descriptorSets[i];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets( _device, static_cast<uint32_t>(descriptorWrites.size()),
+                                descriptorWrites.data(), 0, nullptr );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createImageViews()
+{
+    _swapChainImageViews.resize(_swapChainImages.size());
+    for (size_t i = 0; i < _swapChainImages.size(); i++)
+    {
+        _swapChainImageViews[i] = createImageView( _swapChainImages[i], _swapChainImageFormat );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createSwapChain(VkPhysicalDevice physicalDevice)
+{
+    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+    VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+    VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
+    {
+        imageCount = swapChainSupport.capabilities.maxImageCount;
+    }
+
+    VkSwapchainCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = _surface;
+    createInfo.minImageCount = imageCount;
+    createInfo.imageFormat = surfaceFormat.format;
+    createInfo.imageColorSpace = surfaceFormat.colorSpace;
+    createInfo.imageExtent = extent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+    if (indices.graphicsFamily != indices.presentFamily)
+    {
+        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = queueFamilyIndices;
+    }
+    else
+    {
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.queueFamilyIndexCount = 0;     // Optional
+        createInfo.pQueueFamilyIndices = nullptr; // Optional
+    }
+
+    createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = VK_NULL_HANDLE;
+
+    if (vkCreateSwapchainKHR(_device, &createInfo, nullptr, &_swapChain) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create swap chain!");
+    }
+
+    vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, nullptr);
+    _swapChainImages.resize(imageCount);
+    vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, _swapChainImages.data());
+
+    _swapChainExtent = extent;
+    _swapChainImageFormat = surfaceFormat.format;
+}
+
+// -----------------------------------------------------------------------------
+// Stands in for the swapchain when headless: one color image per frame in
+// flight, each with a host visible buffer its frames are copied into
+// -----------------------------------------------------------------------------
+void VulkanApp::createOffscreenTarget()
+{
+    auto wp = GetWindowParams();
+    _swapChainExtent = { wp.width, wp.height };
+
+    // rgba so that a read back frame can be written out as is
+    _swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+    VkDeviceSize frameSize = static_cast<VkDeviceSize>(wp.width) * wp.height * 4;
+
+    _swapChainImages.resize( MAX_FRAMES_IN_FLIGHT );
+    _offscreenImagesMemory.resize( MAX_FRAMES_IN_FLIGHT );
+    _readbackBuffers.resize( MAX_FRAMES_IN_FLIGHT );
+    _readbackBuffersMemory.resize( MAX_FRAMES_IN_FLIGHT );
+    _readbackBuffersMapped.resize( MAX_FRAMES_IN_FLIGHT );
+
+    for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+        createImage( wp.width, wp.height, _swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     _swapChainImages[i], _offscreenImagesMemory[i] );
+
+        createBuffer( frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      _readbackBuffers[i], _readbackBuffersMemory[i] );
+
+        vkMapMemory( _device, _readbackBuffersMemory[i], 0, frameSize, 0, &_readbackBuffersMapped[i] );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::cleanupOffscreenTarget()
+{
+    for ( size_t i = 0; i < _swapChainImages.size(); i++ )
+    {
+        vkUnmapMemory( _device, _readbackBuffersMemory[i] );
+        vkDestroyBuffer( _device, _readbackBuffers[i], nullptr );
+        vkFreeMemory( _device, _readbackBuffersMemory[i], nullptr );
+        vkDestroyImage( _device, _swapChainImages[i], nullptr );
+        vkFreeMemory( _device, _offscreenImagesMemory[i], nullptr );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+const std::vector<const char *> &VulkanApp::getRequiredDeviceExtensions() const
+{
+    return _headless ? headlessDeviceExtensions : deviceExtensions;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createTextureImageView()
+{
+    _textureImageViews.resize( _textureImages.size() );
+    for ( size_t i = 0; i < _textureImages.size(); i++ )
+    {
+        _textureImageViews[i] = createImageView( _textureImages[i], VK_FORMAT_R8G8B8A8_SRGB );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::cleanupImageTexture()
+{
+    for ( size_t i = 0; i < _textureImages.size(); i++ )
+    {
+        vkDestroyImageView( _device, _textureImageViews[i], nullptr );
+        vkDestroyImage( _device, _textureImages[i], nullptr );
+        vkFreeMemory( _device, _textureImagesMemory[i], nullptr );
+    }
+    _textureImages.clear();
+    _textureImagesMemory.clear();
+    _textureImageViews.clear();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createTextureSampler()
+{
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.anisotropyEnable = VK_TRUE;
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties( _physicalDevice, &properties );
+
+    samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.mipLodBias = 0.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+
+    if ( vkCreateSampler( _device, &samplerInfo, nullptr, &_textureSampler ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create texture sampler!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createLogicalDevice(VkPhysicalDevice physicalDevice)
+{
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+    _graphicsFamily = indices.graphicsFamily.value();
+    _transferFamily = indices.transferFamily.value_or( _graphicsFamily );
+    _transferGranularity = indices.transferGranularity;
+    uniqueQueueFamilies.insert( _transferFamily );
+    _computeFamily = indices.computeFamily.value();
+    uniqueQueueFamilies.insert( _computeFamily );
+
+    float queuePriority = 1.0f;
+    for (uint32_t queueFamily : uniqueQueueFamilies)
+    {
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = queueFamily;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
+    VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.samplerAnisotropy = VK_TRUE;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
+
+    VkDeviceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+
+    createInfo.pEnabledFeatures = &deviceFeatures;
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+    createInfo.pNext = &timelineFeatures;
+
+    const auto &extensions = getRequiredDeviceExtensions();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
+    createInfo.enabledLayerCount = 0;
+
+    if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &_device) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create logical device!");
+    }
+
+    vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
+    vkGetDeviceQueue(_device, indices.presentFamily.value(), 0, &_presentQueue);
+    vkGetDeviceQueue(_device, _transferFamily, 0, &_transferQueue);
+    vkGetDeviceQueue(_device, _computeFamily, 0, &_computeQueue);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createInstance()
+{
+    if ( enableValidationLayers && !checkValidationLayerSupport() )
+    {
+        throw std::runtime_error( "validation layers requested, but not available!" );
+    }
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Hello Triangle";
+    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.pEngineName = "No Engine";
+    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    // 1.2 for timeline semaphores
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+
+    VkInstanceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+
+    auto extensions = getRequiredExtensions();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
+
+    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+    if ( enableValidationLayers )
+    {
+        createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+        createInfo.ppEnabledLayerNames = validationLayers.data();
+        populateDebugMessengerCreateInfo( debugCreateInfo );
+        createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
+    }
+    else
+    {
+        createInfo.enabledLayerCount = 0;
+        createInfo.pNext = nullptr;
+    }
+
+    if (vkCreateInstance(&createInfo, nullptr, &_instance) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create vulkan instance!");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::mainLoop()
+{
+    while (!glfwWindowShouldClose(_window))
+    {
+        glfwPollEvents();
+        drawFrame();
+    }
+
+    vkDeviceWaitIdle( _device );
+    reportFrameTiming();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+static std::string frameFileName( const std::string &path, uint32_t frame, uint32_t frameCount )
+{
+    if ( frameCount <= 1 )
+    {
+        return path;
+    }
+
+    char number[16];
+    snprintf( number, sizeof( number ), "_%04u", frame );
+
+    size_t dot = path.find_last_of( '.' );
+    size_t slash = path.find_last_of( "/\\" );
+    if ( dot == std::string::npos || (slash != std::string::npos && dot < slash) )
+    {
+        return path + number;
+    }
+    return path.substr( 0, dot ) + number + path.substr( dot );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::headlessLoop()
+{
+    std::vector<unsigned char> pixels;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    for ( uint32_t frame = 0; frame < _headlessParams.frameCount; ++frame )
+    {
+        drawFrame();
+
+        if ( !_headlessParams.outputFile.empty() )
+        {
+            readbackFrame( pixels );
+            writePng( frameFileName( _headlessParams.outputFile, frame, _headlessParams.frameCount ),
+                      pixels.data(), _swapChainExtent.width, _swapChainExtent.height, 4 );
+        }
+    }
+
+    vkDeviceWaitIdle( _device );
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    float ms = std::chrono::duration<float, std::chrono::milliseconds::period>( endTime - startTime ).count();
+    std::cout << _headlessParams.frameCount << " frames in " << ms << " ms, "
+              << ms / std::max( _headlessParams.frameCount, 1u ) << " ms per frame" << std::endl;
+
+    UploadStats uploads = getUploadStats();
+    std::cout << uploads.uploads << " texture uploads, "
+              << uploads.bytesPerSecond() / (1024.0 * 1024.0) << " MiB/s, "
+              << uploads.stagingAllocations << " staging allocations" << std::endl;
+
+    reportFrameTiming();
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::createDiscriptorSetLayout()
+{
+    VkDescriptorSetLayoutBinding uboLayoutBinding{};
+    uboLayoutBinding.binding = 0;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorCount = 1;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+    samplerLayoutBinding.binding = 1;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.pImmutableSamplers = nullptr;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if ( vkCreateDescriptorSetLayout( _device, &layoutInfo, nullptr, &_descriptorSetLayout ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create descriptor set layout!" );
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::drawFrame()
+{
+    _frameTimer.beginFrame();
+
+    if ( _headless )
+    {
+        drawOffscreenFrame();
+        return;
+    }
+
+    vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+    _frameTimer.endPhase( FrameTimer::WAIT_FENCE );
+
+    uint32_t imageIndex;
+    vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+    if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+    {
+        vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+    }
+    _imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
+    _frameTimer.endPhase( FrameTimer::ACQUIRE );
+
+    // the buffer the command buffers of imageIndex read, no longer in use
+    updateUniformBuffer( imageIndex );
+    _frameTimer.endPhase( FrameTimer::UPDATE_UNIFORMS );
+
+    // the last frame drawn into the image is done, its timestamps are read
+    // before the command buffer resets them
+    collectFrameTiming( imageIndex );
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    // the first frame sampling a newly uploaded texture waits for the upload,
+    // later frames are ordered after that wait
+    bool waitUpload = _textureReadyValue > _textureWaitedValue;
+    _textureWaitedValue = _textureReadyValue;
+
+    VkSemaphore waitSemaphores[] = {_imageAvailableSemaphores[_currentFrame], _uploadTimeline};
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
+    uint64_t waitValues[] = {0, _textureReadyValue};
+    submitInfo.waitSemaphoreCount = waitUpload ? 2 : 1;
+    submitInfo.pWaitSemaphores = waitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 2;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    submitInfo.pNext = waitUpload ? &timelineInfo : nullptr;
+
+    // the frame samples the current texture copy, which is not written again
+    // before its fence is signalled
+    VkCommandBuffer commandBuffer = commandBufferFor( imageIndex );
+    _textureFences[_textureCurrent] = _inFlightFences[_currentFrame];
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    VkSemaphore signalSemaphores[] = {_renderFinishedSemaphores[_currentFrame]};
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
+
+    if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+    _frameTimer.endPhase( FrameTimer::SUBMIT );
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+
+    VkSwapchainKHR swapChains[] = {_swapChain};
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = swapChains;
+
+    presentInfo.pImageIndices = &imageIndex;
+
+    vkQueuePresentKHR(_presentQueue, &presentInfo);
+    _frameTimer.endPhase( FrameTimer::PRESENT );
+    finishFrameTiming( imageIndex );
+
+    _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::drawOffscreenFrame()
+{
+    vkWaitForFences( _device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX );
+    _frameTimer.endPhase( FrameTimer::WAIT_FENCE );
+
+    // there is one offscreen image per frame in flight, nothing to acquire
+    uint32_t imageIndex = static_cast<uint32_t>(_currentFrame);
+
+    updateUniformBuffer( imageIndex );
+    _frameTimer.endPhase( FrameTimer::UPDATE_UNIFORMS );
+
+    // see drawFrame
+    collectFrameTiming( imageIndex );
+
+    // see drawFrame
+    VkCommandBuffer commandBuffer = commandBufferFor( imageIndex );
+    _textureFences[_textureCurrent] = _inFlightFences[_currentFrame];
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // see drawFrame
+    bool waitUpload = _textureReadyValue > _textureWaitedValue;
+    _textureWaitedValue = _textureReadyValue;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &_textureReadyValue;
+    if ( waitUpload )
+    {
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &_uploadTimeline;
+        submitInfo.pWaitDstStageMask = &waitStage;
+    }
+
+    vkResetFences( _device, 1, &_inFlightFences[_currentFrame] );
+
+    if ( vkQueueSubmit( _graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame] ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to submit draw command buffer!" );
+    }
+    _frameTimer.endPhase( FrameTimer::SUBMIT );
+    finishFrameTiming( imageIndex );
+
+    _lastImageIndex = imageIndex;
+    _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::enableFrameTiming( const std::string &traceFile )
+{
+    _frameTimer.setEnabled( true );
+    _frameTraceFile = traceFile;
+}
+
+// -----------------------------------------------------------------------------
+// Two queries per command buffer, written around its render pass. Each
+// command buffer resets its own pair, so the pool is never reset from the host
+// -----------------------------------------------------------------------------
+void VulkanApp::createTimestampQueries()
+{
+    if ( !_frameTimer.enabled() )
+    {
+        return;
+    }
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties( _physicalDevice, &familyCount, nullptr );
+    std::vector<VkQueueFamilyProperties> families( familyCount );
+    vkGetPhysicalDeviceQueueFamilyProperties( _physicalDevice, &familyCount, families.data() );
+
+    uint32_t validBits = families[_graphicsFamily].timestampValidBits;
+    if ( validBits == 0 )
+    {
+        std::cout << "no timestamps on the graphics queue, gpu times are not measured" << std::endl;
+        return;
+    }
+    _timestampMask = validBits >= 64 ? UINT64_MAX : (uint64_t( 1 ) << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties( _physicalDevice, &properties );
+    _timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * static_cast<uint32_t>(_swapChainFramebuffers.size());
+
+    if ( vkCreateQueryPool( _device, &poolInfo, nullptr, &_timestampPool ) != VK_SUCCESS )
+    {
+        throw std::runtime_error( "failed to create timestamp query pool!" );
+    }
+
+    _pendingFrameTimings.assign( _swapChainFramebuffers.size(), std::nullopt );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::collectFrameTiming( uint32_t imageIndex )
+{
+    if ( _timestampPool == VK_NULL_HANDLE || !_pendingFrameTimings[imageIndex] )
+    {
+        return;
+    }
+
+    FrameTimer::Frame frame = *_pendingFrameTimings[imageIndex];
+    _pendingFrameTimings[imageIndex].reset();
+
+    // the command buffer has completed, no need to wait
+    uint64_t ticks[2] = { 0, 0 };
+    if ( vkGetQueryPoolResults( _device, _timestampPool, 2 * imageIndex, 2, sizeof( ticks ), ticks,
+                                sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT ) == VK_SUCCESS )
+    {
+        double period = _timestampPeriod;
+        frame.gpuStart = static_cast<uint64_t>((ticks[0] & _timestampMask) * period);
+        frame.gpuNanos = static_cast<uint64_t>(((ticks[1] - ticks[0]) & _timestampMask) * period);
+    }
+    _frameTimer.commit( frame );
+}
+
+// -----------------------------------------------------------------------------
+// Frames without timestamps are committed straight away
+// -----------------------------------------------------------------------------
+void VulkanApp::finishFrameTiming( uint32_t imageIndex )
+{
+    FrameTimer::Frame frame;
+    if ( !_frameTimer.endFrame( frame ) )
+    {
+        return;
+    }
+
+    if ( _timestampPool == VK_NULL_HANDLE )
+    {
+        _frameTimer.commit( frame );
+        return;
+    }
+    _pendingFrameTimings[imageIndex] = frame;
+}
+
+// -----------------------------------------------------------------------------
+// Called with the device idle, when every pending frame has its timestamps
+// -----------------------------------------------------------------------------
+void VulkanApp::reportFrameTiming()
+{
+    if ( !_frameTimer.enabled() )
+    {
+        return;
+    }
+
+    for ( uint32_t ii = 0; ii < _pendingFrameTimings.size(); ++ii )
+    {
+        collectFrameTiming( ii );
+    }
+
+    _frameTimer.writeReport( std::cout );
+    if ( !_frameTraceFile.empty() )
+    {
+        _frameTimer.writeChromeTrace( _frameTraceFile );
+        std::cout << "wrote " << _frameTraceFile << std::endl;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Waits for the last offscreen frame and copies it out as rows of rgba8
+// -----------------------------------------------------------------------------
+void VulkanApp::readbackFrame( std::vector<unsigned char> &pixels )
+{
+    vkWaitForFences( _device, 1, &_inFlightFences[_lastImageIndex], VK_TRUE, UINT64_MAX );
+
+    size_t frameSize = static_cast<size_t>(_swapChainExtent.width) * _swapChainExtent.height * 4;
+    pixels.resize( frameSize );
+    memcpy( pixels.data(), _readbackBuffersMapped[_lastImageIndex], frameSize );
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void VulkanApp::cleanup()
+{
+    cleanupResources();
+
+    if ( enableValidationLayers )
+    {
+        DestroyDebugUtilsMessengerEXT( _instance, _debugMessenger, nullptr );
+    }
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
+        vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
+        vkDestroyFence(_device, _inFlightFences[i], nullptr);
+    }
+
+    cleanupUploadObjects();
+
+    if ( _timestampPool != VK_NULL_HANDLE )
+    {
+        vkDestroyQueryPool( _device, _timestampPool, nullptr );
+        _timestampPool = VK_NULL_HANDLE;
+    }
+
+    vkDestroyCommandPool(_device, _commandPool, nullptr);
+    vkDestroyCommandPool( _device, _computeCommandPool, nullptr );
+
+    for (auto framebuffer : _swapChainFramebuffers)
+    {
+        vkDestroyFramebuffer(_device, framebuffer, nullptr);
+    }
+
+    vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyRenderPass(_device, _renderPass, nullptr);
+
+    for (auto imageView : _swapChainImageViews)
+    {
+        vkDestroyImageView(_device, imageView, nullptr);
+    }
+
+    if ( _headless )
+    {
+        cleanupOffscreenTarget();
+    }
+    else
+    {
+        vkDestroySwapchainKHR(_device, _swapChain, nullptr);
+    }
+
+    for ( size_t i = 0; i < _uniformBuffers.size(); i++ )
+    {
+        vkDestroyBuffer( _device, _uniformBuffers[i], nullptr );
+        vkFreeMemory( _device, _uniformBuffersMemory[i], nullptr );
+    }
+
+    vkDestroyDescriptorPool( _device, _descriptorPool, nullptr );
+    vkDestroyDescriptorSetLayout( _device, _descriptorSetLayout, nullptr );
+
+    vkDestroyBuffer( _device, _indexBuffer, nullptr );
+    vkFreeMemory( _device, _indexBufferMemory, nullptr );
+    vkDestroyBuffer(_device, _vertexBuffer, nullptr);
+    vkFreeMemory(_device, _vertexBufferMemory, nullptr);
+
+    vkDestroySampler( _device, _textureSampler, nullptr );
+    cleanupImageTexture();
+
+    vkDestroyDevice(_device, nullptr);
+    if ( _headless )
+    {
+        vkDestroyInstance( _instance, nullptr );
+        return;
+    }
+    vkDestroySurfaceKHR(_instance, _surface, nullptr);
+    vkDestroyInstance(_instance, nullptr);
+    glfwDestroyWindow(_window);
+    glfwTerminate();
+}
@@ -9,7 +9,11 @@
 #endif
 #include <GLFW/glfw3native.h>
 
+#include <deque>
 #include <vector>
+#include <optional>
+
+#include "frameTimer.h"
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -20,6 +24,36 @@ struct WindowParams
     std::string title{ "Vulkan App" };
 };
 
+// -----------------------------------------------------------------------------
+// Rendering without window or swapchain into an offscreen image, for machines
+// without a display or with only a software ICD such as lavapipe
+// -----------------------------------------------------------------------------
+struct HeadlessParams
+{
+    uint32_t frameCount{ 1 };
+
+    // every frame is read back and written here as png when set, with the
+    // frame number inserted before the extension if more than one is drawn
+    std::string outputFile;
+};
+
+// -----------------------------------------------------------------------------
+// Texture upload throughput. Uploads complete asynchronously, so the time is
+// what the caller spends staging and submitting
+// -----------------------------------------------------------------------------
+struct UploadStats
+{
+    uint64_t uploads{ 0 };
+    uint64_t bytes{ 0 };
+    double   seconds{ 0.0 };
+
+    // device memory allocations made for staging, stays put once the
+    // staging ring has grown to the largest upload
+    uint64_t stagingAllocations{ 0 };
+
+    double bytesPerSecond() const { return seconds > 0.0 ? bytes / seconds : 0.0; }
+};
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 class VulkanApp
@@ -33,11 +67,56 @@ public:
 
     void run();
 
+    // draws params.frameCount frames offscreen, then cleans up and returns
+    void runHeadless( const HeadlessParams &params );
+
+    bool isHeadless() const { return _headless; }
+
+    UploadStats getUploadStats() const { return _uploadStats; }
+    void resetUploadStats() { _uploadStats = UploadStats{ 0, 0, 0.0, _uploadStats.stagingAllocations }; }
+
+    // times the phases of every frame and, when the graphics queue has
+    // timestamps, its render pass. Called before run or runHeadless, which
+    // print the percentiles when their loop ends and write a Chrome trace
+    // to traceFile when set
+    void enableFrameTiming( const std::string &traceFile = std::string() );
+
+    // readable from any thread while frames are drawn
+    const FrameTimer &getFrameTimer() const { return _frameTimer; }
+
 protected:
 
     struct QueueFamilyIndices;
     struct SwapChainSupportDetails;
 
+    // part of the staging ring handed out for one upload
+    struct StagingAllocation
+    {
+        VkDeviceSize offset;
+        void        *data;
+    };
+
+    // staging ring range still read by the upload that signals value on the
+    // upload timeline, 0 until the range has been submitted
+    struct StagingSegment
+    {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        uint64_t     value;
+    };
+
+    // compute shader with storage buffers bound in order to bindings 0.. of
+    // its only descriptor set and its parameters passed as push constants
+    struct ComputePipeline
+    {
+        VkDescriptorSetLayout   setLayout = VK_NULL_HANDLE;
+        VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet         descriptorSet = VK_NULL_HANDLE;
+        VkPipelineLayout        layout = VK_NULL_HANDLE;
+        VkPipeline              pipeline = VK_NULL_HANDLE;
+        uint32_t                pushConstantSize = 0;
+    };
+
     void                        initWindow();
     void                        initVulkan();
     void                        setupDebugMessenger();
@@ -59,12 +138,16 @@ protected:
     VkCommandBuffer             beginSingleTimeCommands();
     void                        endSingleTimeCommands( VkCommandBuffer commandBuffer );
     void                        createCommandBuffers();
+
+    // command buffer drawing into imageIndex from the current texture copy
+    VkCommandBuffer             commandBufferFor( uint32_t imageIndex ) const;
     void                        createCommandPool(VkPhysicalDevice physicalDevice);
     void                        createBuffer( VkDeviceSize size,
                                               VkBufferUsageFlags usage,
                                               VkMemoryPropertyFlags properties,
                                               VkBuffer &buffer,
-                                              VkDeviceMemory &bufferMemory );
+                                              VkDeviceMemory &bufferMemory,
+                                              const std::vector<uint32_t> &queueFamilies = {} );
     void                        createVertexBuffer();
     void                        createIndexBuffer();
     void                        createUniformBuffers();
@@ -76,48 +159,143 @@ protected:
     void                        createImage( uint32_t width, uint32_t height, VkFormat format,
                                              VkImageTiling tiling, VkImageUsageFlags usage,
                                              VkMemoryPropertyFlags properties, VkImage &image,
-                                             VkDeviceMemory &imageMemory );
+                                             VkDeviceMemory &imageMemory,
+                                             const std::vector<uint32_t> &queueFamilies = {} );
     void                        transitionImageLayout( VkImage image, VkFormat format,
                                                        VkImageLayout oldLayout,
                                                        VkImageLayout newLayout );
+    void                        recordImageBarrier( VkCommandBuffer commandBuffer, VkImage image,
+                                                    VkImageLayout oldLayout,
+                                                    VkImageLayout newLayout );
     void                        copyBufferToImage( VkBuffer buffer, VkImage image,
-                                                   uint32_t width, uint32_t height );
+                                                   uint32_t width, uint32_t height,
+                                                   VkDeviceSize bufferOffset = 0 );
+    void                        createStagingRing( VkDeviceSize size );
+    void                        cleanupStagingRing();
+    StagingAllocation           allocateStaging( VkDeviceSize size );
+    bool                        retireStaging( bool wait );
+    void                        createUploadObjects();
+    void                        cleanupUploadObjects();
+    VkCommandBuffer             beginUpload( VkQueue queue );
+    uint64_t                    submitUpload( VkCommandBuffer commandBuffer );
+    uint64_t                    submitTimelined( VkQueue queue, VkCommandBuffer commandBuffer,
+                                                 VkFence fence );
+    uint64_t                    completedUploadValue();
+    bool                        transferCanCopy( const VkRect2D &region ) const;
+    void                        uploadTextureImage( const unsigned char *pixels,
+                                                    uint32_t width, uint32_t height );
     void                        createTextureImage( const std::string &texImgFile );
     void                        createTextureImage( const std::vector<unsigned char> &pixels,
                                                     uint32_t width, uint32_t height );
     void                        createTextureImageView();
+
+    // rewrites region of the texture from pixels, a full texture sized rgba8
+    // image, into the copy frames sample next. Descriptors and command
+    // buffers are kept
+    void                        updateTexture( const std::vector<unsigned char> &pixels );
+    void                        updateTexture( const std::vector<unsigned char> &pixels,
+                                               const VkRect2D &region );
+
+    // recreates the texture at a new size and rebuilds what refers to it
+    void                        replaceTexture( const std::vector<unsigned char> &pixels,
+                                                uint32_t width, uint32_t height );
+    VkExtent2D                  textureExtent() const { return _textureExtent; }
+
+    // texture writes produced on the device: records the copy of source,
+    // rgba8 texels covering the whole texture, and submits commandBuffer of
+    // _computeCommandPool so that the next frame samples the result. No
+    // other texture write may come between the two
+    void                        recordTextureCopy( VkCommandBuffer commandBuffer, VkBuffer source );
+    void                        submitTextureWrite( VkCommandBuffer commandBuffer, VkFence fence );
+
+    // the texture copy written next, and waiting for the last frame
+    // sampling it
+    size_t                      nextTextureCopy() const;
+    void                        waitForTextureCopy( size_t textureCopy );
+    void                        finishTextureWrite( size_t textureCopy, const VkRect2D &region );
     void                        createTextureSampler();
     void                        createFrameBuffers();
     void                        createDiscriptorSetLayout();
     void                        createGraphicsPipeline();
+    void                        createComputePipeline( const std::string &shaderFile,
+                                                       const std::vector<VkBuffer> &storageBuffers,
+                                                       uint32_t pushConstantSize,
+                                                       ComputePipeline &compute );
+    void                        destroyComputePipeline( ComputePipeline &compute );
+
+    // binds compute and records a one dimensional dispatch, for command
+    // buffers of _computeCommandPool
+    void                        recordDispatch( VkCommandBuffer commandBuffer,
+                                                const ComputePipeline &compute,
+                                                const void *pushConstants,
+                                                uint32_t groupCountX );
     VkImageView                 createImageView( VkImage image, VkFormat format );
     void                        createImageViews();
     void                        createSwapChain(VkPhysicalDevice physicalDevice);
+    void                        createOffscreenTarget();
+    const std::vector<const char *> &getRequiredDeviceExtensions() const;
     void                        createLogicalDevice(VkPhysicalDevice physicalDevice);
     void                        createInstance();
     void                        mainLoop();
+    void                        headlessLoop();
     virtual void                drawFrame();
+
+    // called once the device is up and first thing when it is torn down,
+    // for the device resources of derived apps
+    virtual void                initResources() {}
+    virtual void                cleanupResources() {}
+    void                        drawOffscreenFrame();
+    void                        readbackFrame( std::vector<unsigned char> &pixels );
     void                        cleanup();
+    void                        cleanupOffscreenTarget();
     void                        cleanupImageTexture();
 
+    // timestamp queries around the render pass of each command buffer, none
+    // unless frame timing is enabled
+    void                        createTimestampQueries();
+
+    // commits the pending timing of the last frame drawn into imageIndex,
+    // whose command buffer must have completed
+    void                        collectFrameTiming( uint32_t imageIndex );
+    void                        finishFrameTiming( uint32_t imageIndex );
+    void                        reportFrameTiming();
+
     GLFWwindow*                     _window = nullptr;
+    bool                            _headless = false;
+    HeadlessParams                  _headlessParams;
     VkInstance                      _instance;
-    VkSurfaceKHR                    _surface;
+    VkSurfaceKHR                    _surface = VK_NULL_HANDLE;
     VkPhysicalDevice                _physicalDevice; 
     VkDevice                        _device;
     VkQueue                         _graphicsQueue;
     VkQueue                         _presentQueue;
+    VkQueue                         _transferQueue;
+    uint32_t                        _graphicsFamily = 0;
+    uint32_t                        _transferFamily = 0;
+    VkExtent3D                      _transferGranularity = { 1, 1, 1 };
+    VkQueue                         _computeQueue;
+    uint32_t                        _computeFamily = 0;
     VkSwapchainKHR                  _swapChain;
     VkBuffer                        _vertexBuffer;
     VkDeviceMemory                  _vertexBufferMemory;
     VkBuffer                        _indexBuffer;
     VkDeviceMemory                  _indexBufferMemory;
-    VkImage                         _textureImage;
-    VkDeviceMemory                  _textureImageMemory;
-    VkImageView                     _textureImageView;
+    std::vector<VkImage>            _textureImages;
+    std::vector<VkDeviceMemory>     _textureImagesMemory;
+    std::vector<VkImageView>        _textureImageViews;
+    VkExtent2D                      _textureExtent{ 0, 0 };
+    size_t                          _textureCurrent = 0;
+
+    // per texture copy, the fence of the last frame sampling it and the
+    // part of the texture written into other copies since it was written
+    std::vector<VkFence>            _textureFences;
+    std::vector<VkRect2D>           _textureStale;
     VkSampler                       _textureSampler;
     VkDescriptorSetLayout           _descriptorSetLayout;
     VkDescriptorPool                _descriptorPool;
+
+    // a descriptor set per command buffer and a uniform buffer per swapchain
+    // image, see updateDescriptorSets
     std::vector<VkDescriptorSet>    _descriptorSets;
     std::vector<VkBuffer>           _uniformBuffers;
     std::vector<VkDeviceMemory>     _uniformBuffersMemory;
@@ -126,17 +304,45 @@ protected:
     VkFormat                        _swapChainImageFormat;
     VkExtent2D                      _swapChainExtent;
     std::vector<VkImageView>        _swapChainImageViews;
+    std::vector<VkDeviceMemory>     _offscreenImagesMemory;
+    std::vector<VkBuffer>           _readbackBuffers;
+    std::vector<VkDeviceMemory>     _readbackBuffersMemory;
+    std::vector<void *>             _readbackBuffersMapped;
+    uint32_t                        _lastImageIndex = 0;
     VkPipelineLayout                _pipelineLayout;
     VkRenderPass                    _renderPass;
     VkPipeline                      _graphicsPipeline;
     std::vector<VkFramebuffer>      _swapChainFramebuffers;
     VkCommandPool                   _commandPool;
     std::vector<VkCommandBuffer>    _commandBuffers;
+    VkCommandPool                   _computeCommandPool = VK_NULL_HANDLE;
     std::vector<VkSemaphore>        _imageAvailableSemaphores;
     std::vector<VkSemaphore>        _renderFinishedSemaphores;
     std::vector<VkFence>            _inFlightFences;
     std::vector<VkFence>            _imagesInFlight;
+    VkBuffer                        _stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory                  _stagingBufferMemory = VK_NULL_HANDLE;
+    void                           *_stagingBufferMapped = nullptr;
+    VkDeviceSize                    _stagingSize = 0;
+    VkDeviceSize                    _stagingHead = 0;
+    std::deque<StagingSegment>      _stagingSegments;
+    VkCommandPool                   _uploadCommandPool = VK_NULL_HANDLE;
+    VkCommandPool                   _graphicsUploadCommandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer>    _uploadCommandBuffers;
+    std::vector<uint64_t>           _uploadCommandValues;
+    std::vector<VkQueue>            _uploadCommandQueues;
+    VkSemaphore                     _uploadTimeline = VK_NULL_HANDLE;
+    uint64_t                        _uploadValue = 0;
+    uint64_t                        _textureReadyValue = 0;
+    uint64_t                        _textureWaitedValue = 0;
+    UploadStats                     _uploadStats;
     size_t                          _currentFrame = 0;
+    FrameTimer                      _frameTimer;
+    std::string                     _frameTraceFile;
+    VkQueryPool                     _timestampPool = VK_NULL_HANDLE;
+    uint64_t                        _timestampMask = 0;
+    float                           _timestampPeriod = 1.0f;
+    std::vector<std::optional<FrameTimer::Frame>> _pendingFrameTimings;
 
     VkDebugUtilsMessengerEXT        _debugMessenger;
 };